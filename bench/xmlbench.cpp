@@ -0,0 +1,1066 @@
+/*	xmlbench: throughput, allocation and memory benchmarks for XMLParser.
+
+	Every benchmark runs over a corpus made by XMLCorpus, so runs are
+	repeatable, and prints one record per benchmark, as a JSON object per
+	line (or CSV with --csv), for scripts that track regressions:
+
+		corpus, bench		what was measured
+		bytes				xml bytes read or written per run
+		nodes				DOM nodes per run (for lookups and attribute
+							reads: the number of those done per run)
+		repeat				runs; best_s and mean_s are over these
+		mb_per_s			bytes / best_s, in units of 10^6 bytes
+		ns_per_node			best_s / nodes
+		allocs_per_node		heap allocations per node, over one run
+		alloc_bytes_per_node
+		peak_heap_bytes		the most heap in use during a run, above what
+							was in use when it started
+		peak_rss_kb			the peak resident size of the process so far
+
+	Allocations are counted by replacing the global operator new and delete
+	in this program, which covers everything the library allocates.
+
+	parse_stats and parse_traced measure the cost of XMLParseStats and of
+	installed XMLTraceHooks; they are run only when the library is built
+	with XML_STATS or XML_TRACE. With XML_TRACE, "parse" is the cost of
+	the trace points with no hooks installed.
+
+	Usage: xmlbench [--scale X] [--repeat N] [--threads N] [--filter TEXT]
+					[--dir DIR] [--csv] [--write-corpus DIR]
+
+	--scale multiplies the corpus sizes (1 MB each, 16 MB for 'huge').
+	--filter runs only the benchmarks whose "corpus/bench" name contains TEXT.
+	--dir is where the files for the file benchmarks go (default: the
+	current directory); they are removed at exit.
+	--write-corpus writes the corpora to DIR, and exits (messages.xml holds
+	the messages one after another).
+*/
+
+#include "xmlparser.h"
+#include "xmlbinary.h"
+#include "xmlcache.h"
+#include "xmldiff.h"
+#include "xmlfrozen.h"
+#include "xmlmemory.h"
+#include "xmlparallel.h"
+#include "xmlquery.h"
+#include "xmlsnapshot.h"
+
+#include "xmlcorpus.h"
+
+#ifndef XML_THREADS
+	#error "xmlbench needs USE_STL and a C++11 compiler"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <new>
+#include <sstream>
+
+#if defined( _WIN32 )
+	#include <windows.h>
+	#include <psapi.h>
+	#pragma comment( lib, "psapi.lib" )
+#else
+	#include <sys/resource.h>
+#endif
+
+
+// ---------------------------------------------------------------------------
+// Allocation counting.
+
+namespace
+{
+	std::atomic<size_t> allocCount( 0 );
+	std::atomic<size_t> allocBytes( 0 );
+	std::atomic<size_t> liveBytes( 0 );
+	std::atomic<size_t> peakBytes( 0 );
+
+	// Each block is prefixed with its size, so frees can be counted. The
+	// header is 16 bytes to keep malloc's alignment.
+	const size_t HEADER = 16;
+}
+
+
+static void* CountedAlloc( size_t size )
+{
+	char* block = static_cast<char*>( malloc( size + HEADER ) );
+	if ( !block )
+		throw std::bad_alloc();
+	*reinterpret_cast<size_t*>( block ) = size;
+
+	allocCount.fetch_add( 1, std::memory_order_relaxed );
+	allocBytes.fetch_add( size, std::memory_order_relaxed );
+	size_t live = liveBytes.fetch_add( size, std::memory_order_relaxed ) + size;
+	size_t peak = peakBytes.load( std::memory_order_relaxed );
+	while ( live > peak && !peakBytes.compare_exchange_weak( peak, live, std::memory_order_relaxed ) )
+		;
+	return block + HEADER;
+}
+
+
+static void CountedFree( void* p )
+{
+	if ( !p )
+		return;
+	char* block = static_cast<char*>( p ) - HEADER;
+	liveBytes.fetch_sub( *reinterpret_cast<size_t*>( block ), std::memory_order_relaxed );
+	free( block );
+}
+
+
+void* operator new( size_t size )									{ return CountedAlloc( size ); }
+void* operator new[]( size_t size )									{ return CountedAlloc( size ); }
+void operator delete( void* p ) noexcept							{ CountedFree( p ); }
+void operator delete[]( void* p ) noexcept							{ CountedFree( p ); }
+void operator delete( void* p, size_t ) noexcept					{ CountedFree( p ); }
+void operator delete[]( void* p, size_t ) noexcept					{ CountedFree( p ); }
+
+void* operator new( size_t size, const std::nothrow_t& ) noexcept
+{
+	try { return CountedAlloc( size ); } catch ( ... ) { return 0; }
+}
+void* operator new[]( size_t size, const std::nothrow_t& ) noexcept
+{
+	try { return CountedAlloc( size ); } catch ( ... ) { return 0; }
+}
+void operator delete( void* p, const std::nothrow_t& ) noexcept		{ CountedFree( p ); }
+void operator delete[]( void* p, const std::nothrow_t& ) noexcept	{ CountedFree( p ); }
+
+
+static size_t PeakRSSKb()
+{
+#if defined( _WIN32 )
+	PROCESS_MEMORY_COUNTERS counters;
+	if ( !GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) )
+		return 0;
+	return counters.PeakWorkingSetSize / 1024;
+#else
+	struct rusage usage;
+	if ( getrusage( RUSAGE_SELF, &usage ) != 0 )
+		return 0;
+	#if defined( __APPLE__ )
+	return (size_t) usage.ru_maxrss / 1024;		// bytes on macOS
+	#else
+	return (size_t) usage.ru_maxrss;			// kilobytes elsewhere
+	#endif
+#endif
+}
+
+
+// ---------------------------------------------------------------------------
+// Measurement.
+
+/// Times the parts of a run between Start() and Stop(), with the allocations made meanwhile.
+class Meter
+{
+public:
+	Meter() : seconds( 0 ), allocs( 0 ), bytes( 0 ), peak( 0 ), baseLive( 0 ), startAllocs( 0 ), startBytes( 0 ) {}
+
+	void Start()
+	{
+		baseLive = liveBytes.load();
+		peakBytes.store( baseLive );
+		startAllocs = allocCount.load();
+		startBytes = allocBytes.load();
+		start = std::chrono::steady_clock::now();
+	}
+
+	void Stop()
+	{
+		std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+		seconds += std::chrono::duration<double>( stop - start ).count();
+		allocs += allocCount.load() - startAllocs;
+		bytes += allocBytes.load() - startBytes;
+		size_t used = peakBytes.load() - baseLive;
+		if ( used > peak )
+			peak = used;
+	}
+
+	double	seconds;
+	size_t	allocs;
+	size_t	bytes;
+	size_t	peak;
+
+private:
+	size_t	baseLive;
+	size_t	startAllocs;
+	size_t	startBytes;
+	std::chrono::steady_clock::time_point start;
+};
+
+
+typedef std::function< void ( Meter* ) > BenchFunction;
+
+struct Options
+{
+	Options() : scale( 1.0 ), repeat( 3 ), threads( 0 ), csv( false ), dir( "." ) {}
+
+	double		scale;
+	int			repeat;
+	unsigned	threads;
+	bool		csv;
+	std::string	filter;
+	std::string	dir;
+	std::string	corpusDir;
+};
+
+
+class Runner
+{
+public:
+	explicit Runner( const Options& _options ) : options( _options ), header( false ) {}
+
+	/// True if the benchmark is selected by --filter.
+	bool Wants( const char* corpus, const char* name ) const
+	{
+		if ( options.filter.empty() )
+			return true;
+		std::string full = std::string( corpus ) + "/" + name;
+		return full.find( options.filter ) != std::string::npos;
+	}
+
+	/// Run 'function' options.repeat times and print the record.
+	void Run( const char* corpus, const char* name, size_t bytes, size_t nodes, const BenchFunction& function )
+	{
+		if ( !Wants( corpus, name ) )
+			return;
+
+		double best = 0, total = 0;
+		Meter last;
+		size_t peak = 0;
+		for( int i=0; i<options.repeat; ++i )
+		{
+			Meter meter;
+			function( &meter );
+			if ( i == 0 || meter.seconds < best )
+				best = meter.seconds;
+			total += meter.seconds;
+			if ( meter.peak > peak )
+				peak = meter.peak;
+			last = meter;
+		}
+		Print( corpus, name, bytes, nodes, best, total / options.repeat, last, peak );
+	}
+
+private:
+	void Print( const char* corpus, const char* name, size_t bytes, size_t nodes,
+				double best, double mean, const Meter& meter, size_t peak )
+	{
+		double mbPerSec = best > 0 ? bytes / best / 1e6 : 0;
+		double nsPerNode = nodes ? best * 1e9 / nodes : 0;
+		double allocsPerNode = nodes ? (double) meter.allocs / nodes : 0;
+		double allocBytesPerNode = nodes ? (double) meter.bytes / nodes : 0;
+		size_t rss = PeakRSSKb();
+
+		if ( options.csv )
+		{
+			if ( !header )
+			{
+				printf( "corpus,bench,bytes,nodes,repeat,best_s,mean_s,mb_per_s,ns_per_node,"
+						"allocs_per_node,alloc_bytes_per_node,peak_heap_bytes,peak_rss_kb\n" );
+				header = true;
+			}
+			printf( "%s,%s,%lu,%lu,%d,%.6f,%.6f,%.2f,%.2f,%.3f,%.1f,%lu,%lu\n",
+					corpus, name, (unsigned long) bytes, (unsigned long) nodes, options.repeat,
+					best, mean, mbPerSec, nsPerNode, allocsPerNode, allocBytesPerNode,
+					(unsigned long) peak, (unsigned long) rss );
+		}
+		else
+		{
+			printf( "{\"corpus\":\"%s\",\"bench\":\"%s\",\"bytes\":%lu,\"nodes\":%lu,\"repeat\":%d,"
+					"\"best_s\":%.6f,\"mean_s\":%.6f,\"mb_per_s\":%.2f,\"ns_per_node\":%.2f,"
+					"\"allocs_per_node\":%.3f,\"alloc_bytes_per_node\":%.1f,"
+					"\"peak_heap_bytes\":%lu,\"peak_rss_kb\":%lu}\n",
+					corpus, name, (unsigned long) bytes, (unsigned long) nodes, options.repeat,
+					best, mean, mbPerSec, nsPerNode, allocsPerNode, allocBytesPerNode,
+					(unsigned long) peak, (unsigned long) rss );
+		}
+		fflush( stdout );
+	}
+
+	const Options&	options;
+	bool			header;
+};
+
+
+// ---------------------------------------------------------------------------
+// Helpers.
+
+// Results are folded into this, so that no benchmark loop is optimized away.
+static volatile size_t sink;
+
+
+static void Fail( const char* corpus, const char* what, const char* detail )
+{
+	fprintf( stderr, "xmlbench: %s: %s failed%s%s\n", corpus, what, detail ? ": " : "", detail ? detail : "" );
+	exit( 1 );
+}
+
+
+static void Check( const char* corpus, const char* what, const XMLDocument& document )
+{
+	if ( document.Error() )
+		Fail( corpus, what, document.ErrorDesc() );
+}
+
+
+static bool WriteFile( const std::string& path, const std::string& text )
+{
+	FILE* fp = fopen( path.c_str(), "wb" );
+	if ( !fp )
+		return false;
+	bool ok = fwrite( text.data(), 1, text.size(), fp ) == text.size();
+	return fclose( fp ) == 0 && ok;
+}
+
+
+static size_t CountNodes( const XMLNode* node )
+{
+	size_t count = 1;
+	for( const XMLNode* child = node->FirstChild(); child; child = child->NextSibling() )
+		count += CountNodes( child );
+	return count;
+}
+
+
+// Visit every node and attribute in document order, without recursion
+// (the 'deep' corpus nests hundreds of levels).
+static size_t Walk( const XMLNode* root )
+{
+	size_t sum = 0;
+	const XMLNode* node = root;
+	while ( node )
+	{
+		sum += node->ValueTStr().size();
+		if ( const XMLElement* element = node->ToElement() )
+		{
+			for( const XMLAttribute* attrib = element->FirstAttribute(); attrib; attrib = attrib->Next() )
+				sum += attrib->ValueStr().size();
+		}
+
+		if ( node->FirstChild() )
+		{
+			node = node->FirstChild();
+			continue;
+		}
+		while ( node != root && !node->NextSibling() )
+			node = node->Parent();
+		node = node == root ? 0 : node->NextSibling();
+	}
+	return sum;
+}
+
+
+// The same walk over a frozen document, through handles.
+static size_t Walk( XMLFrozenNode root )
+{
+	size_t sum = 0;
+	XMLFrozenNode node = root;
+	while ( !node.IsNull() )
+	{
+		sum += node.ValueLength();
+		for( XMLFrozenAttribute attrib = node.FirstAttribute(); !attrib.IsNull(); attrib = attrib.Next() )
+			sum += attrib.ValueLength();
+
+		XMLFrozenNode child = node.FirstChild();
+		if ( !child.IsNull() )
+		{
+			node = child;
+			continue;
+		}
+		while ( node != root && node.NextSibling().IsNull() )
+			node = node.Parent();
+		node = node == root ? XMLFrozenNode() : node.NextSibling();
+	}
+	return sum;
+}
+
+
+static size_t PrintedSize( const XMLNode& node )
+{
+	XMLPrinter printer;
+	node.Accept( &printer );
+	return printer.Size();
+}
+
+
+// Build a document of 'count' elements with an int and a double attribute
+// each, and print it. Returns the size of the output.
+static size_t GenerateNumeric( size_t count )
+{
+	XMLDocument doc;
+	XMLElement* root = new XMLElement( "values" );
+	doc.LinkEndChild( root );
+	for( size_t i=0; i<count; ++i )
+	{
+		XMLElement* value = new XMLElement( "v" );
+		value->SetAttribute( "i", (int)( i * 7919 ) );
+		value->SetDoubleAttribute( "d", i * 0.37 );
+		root->LinkEndChild( value );
+	}
+	XMLPrinter printer;
+	doc.Accept( &printer );
+	return printer.Size();
+}
+
+
+static size_t CountBytes( const char*, size_t size, void* userData )
+{
+	*static_cast<size_t*>( userData ) += size;
+	return size;
+}
+
+
+static void CountElement( void* context, const XMLElement* )
+{
+	++*static_cast<size_t*>( context );
+}
+
+
+// ---------------------------------------------------------------------------
+// Benchmarks.
+
+/// The document benchmarks, run on every corpus.
+static void RunDocument( Runner* runner, const Options& options, const char* corpus, const std::string& text )
+{
+	std::string path = options.dir + "/xmlbench-" + corpus + ".xml";
+	std::string outPath = options.dir + "/xmlbench-" + corpus + "-out.xml";
+	if ( !WriteFile( path, text ) )
+		Fail( corpus, "writing", path.c_str() );
+
+	XMLDocument reference;
+	reference.Parse( text.c_str() );
+	Check( corpus, "parse", reference );
+
+	const size_t bytes = text.size();
+	const size_t nodes = CountNodes( &reference );
+	const size_t printed = PrintedSize( reference );
+
+	runner->Run( corpus, "parse", bytes, nodes, [&]( Meter* meter )
+	{
+		XMLDocument doc;
+		meter->Start();
+		doc.Parse( text.c_str() );
+		meter->Stop();
+		Check( corpus, "parse", doc );
+	} );
+
+	// Steady state of a document that keeps its memory (see SetReuseMemory()).
+	if ( runner->Wants( corpus, "parse_reuse" ) )
+	{
+		XMLDocument doc;
+		doc.SetReuseMemory( true );
+		doc.Parse( text.c_str() );
+		runner->Run( corpus, "parse_reuse", bytes, nodes, [&]( Meter* meter )
+		{
+			doc.Clear();
+			meter->Start();
+			doc.Parse( text.c_str() );
+			meter->Stop();
+			Check( corpus, "parse_reuse", doc );
+		} );
+	}
+
+	// Parsing with the instrumentation and allocators turned on.
+	if ( XMLParseStats::Enabled() )
+	{
+		runner->Run( corpus, "parse_stats", bytes, nodes, [&]( Meter* meter )
+		{
+			XMLDocument doc;
+			doc.SetCollectStats( true );
+			meter->Start();
+			doc.Parse( text.c_str() );
+			meter->Stop();
+			Check( corpus, "parse_stats", doc );
+		} );
+	}
+
+	if ( XMLTraceHooks::Enabled() && runner->Wants( corpus, "parse_traced" ) )
+	{
+		size_t elements = 0;
+		XMLTraceHooks hooks;
+		hooks.elementBegin = CountElement;
+		hooks.context = &elements;
+		XMLTraceHooks::Install( &hooks );
+		runner->Run( corpus, "parse_traced", bytes, nodes, [&]( Meter* meter )
+		{
+			XMLDocument doc;
+			meter->Start();
+			doc.Parse( text.c_str() );
+			meter->Stop();
+			Check( corpus, "parse_traced", doc );
+		} );
+		XMLTraceHooks::Install( 0 );
+		sink += elements;
+	}
+
+	runner->Run( corpus, "parse_allocator", bytes, nodes, [&]( Meter* meter )
+	{
+		XMLCountingAllocator counting;
+		{
+			XMLDocument doc;
+			doc.SetAllocator( &counting );
+			meter->Start();
+			doc.Parse( text.c_str() );
+			meter->Stop();
+			Check( corpus, "parse_allocator", doc );
+		}
+		sink += counting.Allocations();
+	} );
+
+	runner->Run( corpus, "load_file", bytes, nodes, [&]( Meter* meter )
+	{
+		XMLDocument doc;
+		meter->Start();
+		doc.LoadFile( path.c_str() );
+		meter->Stop();
+		Check( corpus, "load_file", doc );
+	} );
+
+	// The same load through the default executor, waiting for the result.
+	runner->Run( corpus, "load_file_async", bytes, nodes, [&]( Meter* meter )
+	{
+		XMLDocument doc;
+		meter->Start();
+		std::future< bool > loading = doc.LoadFileAsync( path.c_str() );
+		loading.get();
+		meter->Stop();
+		Check( corpus, "load_file_async", doc );
+	} );
+
+	runner->Run( corpus, "stream_in", bytes, nodes, [&]( Meter* meter )
+	{
+		std::istringstream in( text );
+		XMLDocument doc;
+		meter->Start();
+		in >> doc;
+		meter->Stop();
+		Check( corpus, "stream_in", doc );
+	} );
+
+	runner->Run( corpus, "print", printed, nodes, [&]( Meter* meter )
+	{
+		XMLPrinter printer;
+		meter->Start();
+		reference.Accept( &printer );
+		meter->Stop();
+		sink += printer.Size();
+	} );
+
+	runner->Run( corpus, "canonical_print", printed, nodes, [&]( Meter* meter )
+	{
+		size_t written = 0;
+		XMLCanonicalPrinter printer( CountBytes, &written );
+		meter->Start();
+		reference.Accept( &printer );
+		printer.Flush();
+		meter->Stop();
+		sink += written;
+	} );
+
+	runner->Run( corpus, "save_file", printed, nodes, [&]( Meter* meter )
+	{
+		meter->Start();
+		bool ok = reference.SaveFile( outPath.c_str() );
+		meter->Stop();
+		if ( !ok )
+			Fail( corpus, "save_file", outPath.c_str() );
+	} );
+
+	runner->Run( corpus, "clone", bytes, nodes, [&]( Meter* meter )
+	{
+		XMLDocument copy;
+		meter->Start();
+		copy = reference;
+		meter->Stop();
+	} );
+
+	runner->Run( corpus, "navigate", bytes, nodes, [&]( Meter* meter )
+	{
+		meter->Start();
+		sink += Walk( &reference );
+		meter->Stop();
+	} );
+
+	runner->Run( corpus, "memory_usage", bytes, nodes, [&]( Meter* meter )
+	{
+		meter->Start();
+		XMLMemoryUsage usage = reference.MemoryUsage();
+		meter->Stop();
+		sink += usage.TotalBytes();
+	} );
+
+	// Fingerprints: computing them all, against asking again once cached.
+	runner->Run( corpus, "fingerprint", bytes, nodes, [&]( Meter* meter )
+	{
+		XMLDocument copy;
+		copy = reference;
+		meter->Start();
+		XMLFingerprint fingerprint = copy.Fingerprint();
+		meter->Stop();
+		sink += (size_t) fingerprint.low;
+	} );
+
+	reference.Fingerprint();
+	runner->Run( corpus, "fingerprint_cached", bytes, nodes, [&]( Meter* meter )
+	{
+		meter->Start();
+		XMLFingerprint fingerprint = reference.Fingerprint();
+		meter->Stop();
+		sink += (size_t) fingerprint.low;
+	} );
+
+	remove( path.c_str() );
+	remove( outPath.c_str() );
+}
+
+
+/// Many small documents, parsed one after another.
+static void RunMessages( Runner* runner, const std::vector<std::string>& messages )
+{
+	const char* corpus = "messages";
+	size_t bytes = 0, nodes = 0;
+	for( size_t i=0; i<messages.size(); ++i )
+	{
+		XMLDocument doc;
+		doc.Parse( messages[i].c_str() );
+		Check( corpus, "parse", doc );
+		bytes += messages[i].size();
+		nodes += CountNodes( &doc );
+	}
+
+	runner->Run( corpus, "parse", bytes, nodes, [&]( Meter* meter )
+	{
+		meter->Start();
+		for( size_t i=0; i<messages.size(); ++i )
+		{
+			XMLDocument doc;
+			doc.Parse( messages[i].c_str() );
+			sink += doc.Error();
+		}
+		meter->Stop();
+	} );
+
+	runner->Run( corpus, "parse_reuse", bytes, nodes, [&]( Meter* meter )
+	{
+		XMLDocument doc;
+		doc.SetReuseMemory( true );
+		doc.Parse( messages[0].c_str() );
+		meter->Start();
+		for( size_t i=0; i<messages.size(); ++i )
+		{
+			doc.Clear();
+			doc.Parse( messages[i].c_str() );
+			sink += doc.Error();
+		}
+		meter->Stop();
+	} );
+
+	runner->Run( corpus, "parse_print", bytes, nodes, [&]( Meter* meter )
+	{
+		XMLDocument doc;
+		doc.SetReuseMemory( true );
+		meter->Start();
+		for( size_t i=0; i<messages.size(); ++i )
+		{
+			doc.Clear();
+			doc.Parse( messages[i].c_str() );
+			XMLPrinter printer;
+			doc.Accept( &printer );
+			sink += printer.Size();
+		}
+		meter->Stop();
+	} );
+}
+
+
+/// Lookups, typed attributes, alternative printers, binary images and
+/// snapshots, on the 'records' corpus.
+static void RunRecords( Runner* runner, const Options& options, const std::string& text )
+{
+	const char* corpus = "records";
+	XMLDocument reference;
+	reference.Parse( text.c_str() );
+	Check( corpus, "parse", reference );
+
+	const size_t bytes = text.size();
+	const size_t nodes = CountNodes( &reference );
+	const size_t printed = PrintedSize( reference );
+
+	size_t records = 0;
+	for( const XMLElement* record = reference.RootElement()->FirstChildElement( "record" );
+		 record;
+		 record = record->NextSiblingElement( "record" ) )
+	{
+		++records;
+	}
+
+	// Path lookups: a compiled XMLQuery against the equivalent hand written code.
+	XMLQuery select( "/catalog/record[@type='book']/title" );
+	runner->Run( corpus, "query_select", bytes, records, [&]( Meter* meter )
+	{
+		XMLConstElementList found;
+		meter->Start();
+		select.Select( &reference, &found );
+		meter->Stop();
+		sink += found.size();
+	} );
+
+	runner->Run( corpus, "handle_select", bytes, records, [&]( Meter* meter )
+	{
+		XMLConstElementList found;
+		meter->Start();
+		for( const XMLElement* record = XMLHandle( &reference ).FirstChildElement( "catalog" ).FirstChildElement( "record" ).ToElement();
+			 record;
+			 record = record->NextSiblingElement( "record" ) )
+		{
+			const char* type = record->Attribute( "type" );
+			const XMLElement* title = record->FirstChildElement( "title" );
+			if ( type && strcmp( type, "book" ) == 0 && title )
+				found.push_back( title );
+		}
+		meter->Stop();
+		sink += found.size();
+	} );
+
+	// One lookup into the middle of the catalog, done 'lookups' times.
+	const int lookups = 100;
+	const int middle = (int)( records / 2 ) + 1;
+	char expression[64];
+	snprintf( expression, sizeof( expression ), "/catalog/record[%d]/title", middle );
+	XMLQuery indexed( expression );
+	runner->Run( corpus, "query_index", bytes, lookups, [&]( Meter* meter )
+	{
+		meter->Start();
+		for( int i=0; i<lookups; ++i )
+			sink += indexed.SelectFirst( &reference ) != 0;
+		meter->Stop();
+	} );
+
+	runner->Run( corpus, "handle_index", bytes, lookups, [&]( Meter* meter )
+	{
+		meter->Start();
+		for( int i=0; i<lookups; ++i )
+			sink += XMLHandle( &reference ).FirstChildElement( "catalog" ).ChildElement( "record", middle-1 ).FirstChildElement( "title" ).ToElement() != 0;
+		meter->Stop();
+	} );
+
+	// Typed attribute reads: four per record.
+	runner->Run( corpus, "attribute_query", bytes, records * 4, [&]( Meter* meter )
+	{
+		meter->Start();
+		for( const XMLElement* record = reference.RootElement()->FirstChildElement( "record" );
+			 record;
+			 record = record->NextSiblingElement( "record" ) )
+		{
+			int id = 0;
+			double price = 0;
+			unsigned qty = 0;
+			bool stock = false;
+			record->QueryIntAttribute( "id", &id );
+			record->QueryDoubleAttribute( "price", &price );
+			record->QueryUnsignedAttribute( "qty", &qty );
+			record->QueryBoolAttribute( "stock", &stock );
+			sink += id + (size_t) price + qty + stock;
+		}
+		meter->Stop();
+	} );
+
+	// Building a document of numeric attributes and printing it.
+	runner->Run( corpus, "generate_numeric", GenerateNumeric( records ), records, [&]( Meter* meter )
+	{
+		meter->Start();
+		sink += GenerateNumeric( records );
+		meter->Stop();
+	} );
+
+	runner->Run( corpus, "stream_print", printed, nodes, [&]( Meter* meter )
+	{
+		size_t written = 0;
+		XMLStreamPrinter printer( CountBytes, &written );
+		meter->Start();
+		reference.Accept( &printer );
+		printer.Flush();
+		meter->Stop();
+		sink += written;
+	} );
+
+	runner->Run( corpus, "parallel_print", printed, nodes, [&]( Meter* meter )
+	{
+		XMLParallelPrinter printer( options.threads );
+		meter->Start();
+		printer.Print( reference );
+		meter->Stop();
+		sink += printer.Size();
+	} );
+
+	// Binary images, against parsing the text.
+	std::string binaryPath = options.dir + "/xmlbench-records.xmlb";
+	runner->Run( corpus, "save_binary", bytes, nodes, [&]( Meter* meter )
+	{
+		meter->Start();
+		bool ok = reference.SaveBinary( binaryPath.c_str() );
+		meter->Stop();
+		if ( !ok )
+			Fail( corpus, "save_binary", binaryPath.c_str() );
+	} );
+
+	if ( !reference.SaveBinary( binaryPath.c_str() ) )
+		Fail( corpus, "save_binary", binaryPath.c_str() );
+
+	runner->Run( corpus, "load_binary", bytes, nodes, [&]( Meter* meter )
+	{
+		XMLDocument doc;
+		meter->Start();
+		bool ok = doc.LoadBinary( binaryPath.c_str() );
+		meter->Stop();
+		if ( !ok )
+			Fail( corpus, "load_binary", binaryPath.c_str() );
+	} );
+
+	runner->Run( corpus, "frozen_load_binary", bytes, nodes, [&]( Meter* meter )
+	{
+		XMLFrozenDocument frozen;
+		meter->Start();
+		bool ok = frozen.LoadBinary( binaryPath.c_str() );
+		meter->Stop();
+		if ( !ok )
+			Fail( corpus, "frozen_load_binary", binaryPath.c_str() );
+	} );
+
+	runner->Run( corpus, "frozen_freeze", bytes, nodes, [&]( Meter* meter )
+	{
+		XMLFrozenDocument frozen;
+		meter->Start();
+		frozen.Freeze( reference );
+		meter->Stop();
+	} );
+
+	// Frozen traversal, against "navigate" on the DOM.
+	if ( runner->Wants( corpus, "frozen_" ) )
+	{
+		XMLFrozenDocument frozen( reference );
+		runner->Run( corpus, "frozen_navigate", bytes, nodes, [&]( Meter* meter )
+		{
+			meter->Start();
+			sink += Walk( frozen.Document() );
+			meter->Stop();
+		} );
+
+		runner->Run( corpus, "frozen_scan", bytes, nodes, [&]( Meter* meter )
+		{
+			meter->Start();
+			size_t sum = 0;
+			for( uint32_t i=0; i<frozen.NodeCount(); ++i )
+			{
+				XMLFrozenNode node = frozen.Node( i );
+				sum += node.ValueLength();
+				for( XMLFrozenAttribute attrib = node.FirstAttribute(); !attrib.IsNull(); attrib = attrib.Next() )
+					sum += attrib.ValueLength();
+			}
+			meter->Stop();
+			sink += sum;
+		} );
+	}
+	remove( binaryPath.c_str() );
+
+	// One attribute value in the middle changed: re-parsing the edit, and
+	// diffing and patching the two versions.
+	const size_t editOffset = text.find( "qty=\"", text.size() / 2 ) + 5;
+	runner->Run( corpus, "reparse_edit", bytes, nodes, [&]( Meter* meter )
+	{
+		std::string source = text;
+		XMLDocument doc;
+		doc.Parse( source.c_str() );
+		meter->Start();
+		bool ok = doc.ReparseEdit( &source, editOffset, 1, "7", 1 );
+		meter->Stop();
+		if ( !ok )
+			Fail( corpus, "reparse_edit", doc.ErrorDesc() );
+	} );
+
+	if ( runner->Wants( corpus, "diff_" ) )
+	{
+		std::string editedText = text;
+		editedText[ editOffset ] = editedText[ editOffset ] == '7' ? '8' : '7';
+		XMLDocument edited;
+		edited.Parse( editedText.c_str() );
+		Check( corpus, "parse", edited );
+
+		XMLDiff diff;
+		runner->Run( corpus, "diff_compute", bytes, nodes, [&]( Meter* meter )
+		{
+			meter->Start();
+			bool ok = diff.Compute( reference, edited );
+			meter->Stop();
+			if ( !ok )
+				Fail( corpus, "diff_compute", 0 );
+		} );
+
+		runner->Run( corpus, "diff_apply", bytes, nodes, [&]( Meter* meter )
+		{
+			XMLDocument patched;
+			patched = reference;
+			meter->Start();
+			bool ok = diff.Apply( &patched );
+			meter->Stop();
+			if ( !ok )
+				Fail( corpus, "diff_apply", 0 );
+		} );
+	}
+
+	// A file already in the document cache, loaded 'lookups' times.
+	if ( runner->Wants( corpus, "cache_load" ) )
+	{
+		std::string cachePath = options.dir + "/xmlbench-records-cached.xml";
+		if ( !WriteFile( cachePath, text ) )
+			Fail( corpus, "writing", cachePath.c_str() );
+		XMLDocumentCache cache;
+		if ( cache.Load( cachePath.c_str() ).Error() )
+			Fail( corpus, "cache_load", cachePath.c_str() );
+		runner->Run( corpus, "cache_load", bytes, lookups, [&]( Meter* meter )
+		{
+			meter->Start();
+			for( int i=0; i<lookups; ++i )
+				sink += cache.Load( cachePath.c_str() ).UseCount();
+			meter->Stop();
+		} );
+		remove( cachePath.c_str() );
+	}
+
+	// An editable copy with one change near the end: copy on write, against a deep copy.
+	if ( runner->Wants( corpus, "copy_edit" ) )
+	{
+		XMLSnapshot snapshot = XMLSnapshot::Copy( reference );
+		runner->Run( corpus, "snapshot_copy_edit", bytes, nodes, [&]( Meter* meter )
+		{
+			meter->Start();
+			XMLDocument* edit = snapshot.Clone();
+			edit->RootElement()->LastChild( "record" )->ToElement()->SetAttribute( "qty", 0 );
+			meter->Stop();
+			delete edit;
+		} );
+
+		runner->Run( corpus, "deep_copy_edit", bytes, nodes, [&]( Meter* meter )
+		{
+			XMLDocument edit;
+			meter->Start();
+			edit = reference;
+			edit.RootElement()->LastChild( "record" )->ToElement()->SetAttribute( "qty", 0 );
+			meter->Stop();
+		} );
+	}
+}
+
+
+// ---------------------------------------------------------------------------
+
+static void Usage()
+{
+	fprintf( stderr,
+			 "usage: xmlbench [--scale X] [--repeat N] [--threads N] [--filter TEXT]\n"
+			 "                [--dir DIR] [--csv] [--write-corpus DIR]\n" );
+	exit( 2 );
+}
+
+
+int main( int argc, char** argv )
+{
+	Options options;
+	for( int i=1; i<argc; ++i )
+	{
+		const char* arg = argv[i];
+		const char* value = i+1 < argc ? argv[i+1] : 0;
+		if ( strcmp( arg, "--csv" ) == 0 )
+		{
+			options.csv = true;
+			continue;
+		}
+		if ( !value )
+			Usage();
+		++i;
+		if ( strcmp( arg, "--scale" ) == 0 )
+			options.scale = atof( value );
+		else if ( strcmp( arg, "--repeat" ) == 0 )
+			options.repeat = atoi( value );
+		else if ( strcmp( arg, "--threads" ) == 0 )
+			options.threads = (unsigned) atoi( value );
+		else if ( strcmp( arg, "--filter" ) == 0 )
+			options.filter = value;
+		else if ( strcmp( arg, "--dir" ) == 0 )
+			options.dir = value;
+		else if ( strcmp( arg, "--write-corpus" ) == 0 )
+			options.corpusDir = value;
+		else
+			Usage();
+	}
+	if ( options.scale <= 0 || options.repeat <= 0 )
+		Usage();
+
+	const size_t size = (size_t)( options.scale * 1024 * 1024 );
+	const size_t hugeSize = size * 16;
+
+	struct Corpus
+	{
+		const char*	name;
+		std::string	(*generate)( size_t );
+		size_t		bytes;
+	};
+	const Corpus corpora[] =
+	{
+		{ "deep",		XMLCorpus::Deep,		size },
+		{ "wide",		XMLCorpus::Wide,		size },
+		{ "text",		XMLCorpus::Text,		size },
+		{ "cdata",		XMLCorpus::CData,		size },
+		{ "entities",	XMLCorpus::Entities,	size },
+		{ "records",	XMLCorpus::Records,		size },
+		{ "huge",		XMLCorpus::Records,		hugeSize },
+	};
+	const int corpusCount = sizeof( corpora ) / sizeof( corpora[0] );
+
+	std::vector<std::string> messages;
+	XMLCorpus::Messages( size, &messages );
+
+	if ( !options.corpusDir.empty() )
+	{
+		for( int i=0; i<corpusCount; ++i )
+		{
+			std::string path = options.corpusDir + "/" + corpora[i].name + ".xml";
+			if ( !WriteFile( path, corpora[i].generate( corpora[i].bytes ) ) )
+				Fail( corpora[i].name, "writing", path.c_str() );
+		}
+		std::string all;
+		for( size_t i=0; i<messages.size(); ++i )
+			all += messages[i];
+		std::string path = options.corpusDir + "/messages.xml";
+		if ( !WriteFile( path, all ) )
+			Fail( "messages", "writing", path.c_str() );
+		return 0;
+	}
+
+	Runner runner( options );
+	for( int i=0; i<corpusCount; ++i )
+	{
+		// A filter naming a corpus ("records/", "cdata/parse") skips generating the others.
+		std::string name = corpora[i].name;
+		size_t slash = options.filter.find( '/' );
+		if (    slash != std::string::npos
+			 && ( slash > name.size() || name.compare( name.size() - slash, slash, options.filter, 0, slash ) != 0 ) )
+		{
+			continue;
+		}
+
+		std::string text = corpora[i].generate( corpora[i].bytes );
+		RunDocument( &runner, options, corpora[i].name, text );
+		if ( strcmp( corpora[i].name, "records" ) == 0 )
+			RunRecords( &runner, options, text );
+	}
+	RunMessages( &runner, messages );
+	return 0;
+}
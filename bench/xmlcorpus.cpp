@@ -0,0 +1,318 @@
+#include "xmlcorpus.h"
+
+#include <stdio.h>
+
+namespace
+{
+
+// A 64 bit linear congruential generator (Knuth's MMIX constants). Only the
+// high bits are used, so the sequence is the same everywhere.
+class Random
+{
+public:
+	explicit Random( unsigned seed ) : state( seed ) {}
+
+	unsigned Next()
+	{
+		state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+		return (unsigned)( state >> 33 );
+	}
+
+	/// A number in [lo, hi].
+	int Range( int lo, int hi )		{ return lo + (int)( Next() % (unsigned)( hi - lo + 1 ) ); }
+	/// True one time in 'n'.
+	bool OneIn( int n )				{ return Next() % (unsigned) n == 0; }
+
+private:
+	unsigned long long state;
+};
+
+
+const char* const WORDS[] =
+{
+	"lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit",
+	"sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore", "et",
+	"dolore", "magna", "aliqua", "enim", "ad", "minim", "veniam", "quis",
+	"nostrud", "exercitation", "ullamco", "laboris", "nisi", "aliquip", "ex", "ea",
+	"commodo", "consequat", "duis", "aute", "irure", "in", "reprehenderit", "voluptate",
+	"velit", "esse", "cillum", "fugiat", "nulla", "pariatur", "excepteur", "sint",
+	"occaecat", "cupidatat", "non", "proident", "sunt", "culpa", "qui", "officia",
+	"deserunt", "mollit", "anim", "id", "est", "laborum", "xml", "parser"
+};
+const int WORD_COUNT = sizeof( WORDS ) / sizeof( WORDS[0] );
+
+const char* const TYPES[] = { "book", "music", "film", "game" };
+
+
+void AppendWords( Random* random, int count, std::string* out )
+{
+	for( int i=0; i<count; ++i )
+	{
+		if ( i )
+			*out += ' ';
+		*out += WORDS[ random->Next() % WORD_COUNT ];
+	}
+}
+
+
+void AppendInt( int value, std::string* out )
+{
+	char buf[16];
+	snprintf( buf, sizeof( buf ), "%d", value );
+	*out += buf;
+}
+
+
+void AppendDecimal( int hundredths, std::string* out )
+{
+	char buf[24];
+	snprintf( buf, sizeof( buf ), "%d.%02d", hundredths / 100, hundredths % 100 );
+	*out += buf;
+}
+
+
+void AppendIndent( int depth, std::string* out )
+{
+	out->append( depth * 4, ' ' );
+}
+
+
+const char DECLARATION[] = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+
+}	// namespace
+
+
+std::string XMLCorpus::Deep( size_t bytes )
+{
+	Random random( 1 );
+	std::string out( DECLARATION );
+	out += "<deep>\n";
+	while ( out.size() < bytes )
+	{
+		int depth = random.Range( 64, 512 );
+		for( int i=0; i<depth; ++i )
+		{
+			out += "<n d=\"";
+			AppendInt( i, &out );
+			out += "\">";
+		}
+		AppendWords( &random, 2, &out );
+		for( int i=0; i<depth; ++i )
+			out += "</n>";
+		out += '\n';
+	}
+	out += "</deep>\n";
+	return out;
+}
+
+
+std::string XMLCorpus::Wide( size_t bytes )
+{
+	Random random( 2 );
+	std::string out( DECLARATION );
+	out += "<table>\n";
+	for( int row=0; out.size() < bytes; ++row )
+	{
+		out += "<row";
+		int count = random.Range( 16, 64 );
+		for( int i=0; i<count; ++i )
+		{
+			out += " a";
+			AppendInt( i, &out );
+			out += "=\"";
+			switch ( i % 4 )
+			{
+				case 0:		AppendInt( (int) random.Next() - 0x40000000, &out );	break;
+				case 1:		AppendDecimal( random.Range( 0, 10000000 ), &out );		break;
+				case 2:		out += random.OneIn( 2 ) ? "true" : "false";				break;
+				default:	AppendWords( &random, 1, &out );							break;
+			}
+			out += '"';
+		}
+		out += "/>\n";
+	}
+	out += "</table>\n";
+	return out;
+}
+
+
+std::string XMLCorpus::Text( size_t bytes )
+{
+	Random random( 3 );
+	std::string out( DECLARATION );
+	out += "<book>\n";
+	while ( out.size() < bytes )
+	{
+		out += "<section>\n<title>";
+		AppendWords( &random, random.Range( 2, 8 ), &out );
+		out += "</title>\n";
+		int paragraphs = random.Range( 2, 10 );
+		for( int i=0; i<paragraphs; ++i )
+		{
+			out += "<p>";
+			AppendWords( &random, random.Range( 50, 400 ), &out );
+			out += "</p>\n";
+		}
+		out += "</section>\n";
+	}
+	out += "</book>\n";
+	return out;
+}
+
+
+std::string XMLCorpus::CData( size_t bytes )
+{
+	Random random( 4 );
+	std::string out( DECLARATION );
+	out += "<scripts>\n";
+	for( int n=0; out.size() < bytes; ++n )
+	{
+		out += "<script name=\"s";
+		AppendInt( n, &out );
+		out += "\"><![CDATA[\n";
+		int lines = random.Range( 5, 100 );
+		for( int i=0; i<lines; ++i )
+		{
+			out += "if ( a < b && c > d ) { print( \"<";
+			AppendWords( &random, 1, &out );
+			out += ">\" & '";
+			AppendWords( &random, random.Range( 1, 6 ), &out );
+			out += "' ); }\n";
+		}
+		out += "]]></script>\n";
+	}
+	out += "</scripts>\n";
+	return out;
+}
+
+
+std::string XMLCorpus::Entities( size_t bytes )
+{
+	static const char* const REFERENCES[] =
+	{
+		"&amp;", "&lt;", "&gt;", "&quot;", "&apos;", "&#169;", "&#x20AC;", "&#233;", "&#x4E2D;"
+	};
+	const int referenceCount = sizeof( REFERENCES ) / sizeof( REFERENCES[0] );
+
+	Random random( 5 );
+	std::string out( DECLARATION );
+	out += "<entries>\n";
+	while ( out.size() < bytes )
+	{
+		out += "<e title=\"";
+		AppendWords( &random, 1, &out );
+		out += REFERENCES[ random.Next() % referenceCount ];
+		AppendWords( &random, 1, &out );
+		out += "\">";
+		int words = random.Range( 5, 40 );
+		for( int i=0; i<words; ++i )
+		{
+			AppendWords( &random, 1, &out );
+			out += random.OneIn( 2 ) ? REFERENCES[ random.Next() % referenceCount ] : " ";
+		}
+		out += "</e>\n";
+	}
+	out += "</entries>\n";
+	return out;
+}
+
+
+// One record of the catalog, at the given depth.
+static void AppendRecord( Random* random, int id, int depth, std::string* out )
+{
+	AppendIndent( depth, out );
+	*out += "<record id=\"";
+	AppendInt( id, out );
+	*out += "\" type=\"";
+	*out += TYPES[ random->Next() % 4 ];
+	*out += "\" price=\"";
+	AppendDecimal( random->Range( 99, 99999 ), out );
+	*out += "\" qty=\"";
+	AppendInt( random->Range( 0, 500 ), out );
+	*out += "\" stock=\"";
+	*out += random->OneIn( 4 ) ? "false" : "true";
+	*out += "\">\n";
+
+	AppendIndent( depth+1, out );
+	*out += "<title>";
+	AppendWords( random, random->Range( 1, 6 ), out );
+	*out += "</title>\n";
+
+	AppendIndent( depth+1, out );
+	*out += "<author>";
+	AppendWords( random, 2, out );
+	*out += "</author>\n";
+
+	AppendIndent( depth+1, out );
+	*out += "<tags>\n";
+	int tags = random->Range( 0, 5 );
+	for( int i=0; i<tags; ++i )
+	{
+		AppendIndent( depth+2, out );
+		*out += "<tag>";
+		AppendWords( random, 1, out );
+		*out += "</tag>\n";
+	}
+	AppendIndent( depth+1, out );
+	*out += "</tags>\n";
+
+	AppendIndent( depth+1, out );
+	*out += "<description>";
+	AppendWords( random, random->Range( 5, 60 ), out );
+	*out += "</description>\n";
+
+	AppendIndent( depth, out );
+	*out += "</record>\n";
+}
+
+
+std::string XMLCorpus::Records( size_t bytes )
+{
+	Random random( 6 );
+	std::string out( DECLARATION );
+	out += "<catalog>\n";
+	for( int id=1; out.size() < bytes; ++id )
+	{
+		if ( id % 1000 == 1 )
+		{
+			AppendIndent( 1, &out );
+			out += "<!-- records ";
+			AppendInt( id, &out );
+			out += " and on -->\n";
+		}
+		AppendRecord( &random, id, 1, &out );
+	}
+	out += "</catalog>\n";
+	return out;
+}
+
+
+void XMLCorpus::Messages( size_t bytes, std::vector<std::string>* messages )
+{
+	Random random( 7 );
+	messages->clear();
+	size_t total = 0;
+	for( int id=1; total < bytes; ++id )
+	{
+		std::string out( DECLARATION );
+		out += "<request id=\"";
+		AppendInt( id, &out );
+		out += "\" method=\"";
+		AppendWords( &random, 1, &out );
+		out += "\">\n";
+		int params = random.Range( 1, 6 );
+		for( int i=0; i<params; ++i )
+		{
+			out += "    <param name=\"";
+			AppendWords( &random, 1, &out );
+			out += "\" type=\"int\">";
+			AppendInt( random.Range( 0, 1000000 ), &out );
+			out += "</param>\n";
+		}
+		out += "    <body>";
+		AppendWords( &random, random.Range( 3, 30 ), &out );
+		out += "</body>\n</request>\n";
+		total += out.size();
+		messages->push_back( out );
+	}
+}
@@ -0,0 +1,33 @@
+
+#ifndef __XMLCORPUS_H__
+#define __XMLCORPUS_H__
+
+#include <string>
+#include <vector>
+
+/**	Deterministic xml corpora for xmlbench. Every generator draws from its
+	own fixed-seed random sequence, so a given size always produces the
+	same bytes, on every platform, and results can be compared run to run.
+
+	The sizes are targets: generation stops at the first whole element
+	past 'bytes'.
+*/
+namespace XMLCorpus
+{
+	/// Chains of nested elements, several hundred levels deep.
+	std::string Deep( size_t bytes );
+	/// Empty elements carrying 16 to 64 attributes each, of mixed types.
+	std::string Wide( size_t bytes );
+	/// Sections of long paragraphs: few nodes, a lot of text.
+	std::string Text( size_t bytes );
+	/// Large CDATA sections full of markup characters.
+	std::string CData( size_t bytes );
+	/// Text and attribute values dense with entity and character references.
+	std::string Entities( size_t bytes );
+	/// A pretty-printed catalog of records, as written by most applications.
+	std::string Records( size_t bytes );
+	/// Small request messages, each a complete document of a few hundred bytes.
+	void Messages( size_t bytes, std::vector<std::string>* messages );
+}
+
+#endif
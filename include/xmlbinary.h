@@ -0,0 +1,198 @@
+
+#ifndef __XMLBINARY_H__
+#define __XMLBINARY_H__
+
+#include "xmlparser.h"
+
+#ifdef USE_STL
+
+#include <stdint.h>
+#include <string>
+
+/**	XMLBinaryImage is a flat, read-only image of a whole XMLDocument,
+	as written by XMLDocument::SaveBinary(). The image can be mapped
+	straight from a file and read in place: there is nothing to tokenize
+	and nothing to allocate per node.
+
+	The image holds three tables:
+	- The node table. Nodes are numbered in depth-first (document) order,
+	  node 0 being the document, and every property is a column: an array
+	  with one 32 bit entry per node. A node's children follow it directly,
+	  and its subtree ends at SubtreeEnd().
+	- The attribute table, again in columns. The attributes of node i are
+	  [ FirstAttribute(i), AttributeEnd(i) ). Declarations store their
+	  version, encoding and standalone strings here, in that order.
+	- The string table. Every name and value is a null terminated string,
+	  prefixed by its length. Element and attribute names are stored once.
+
+	Everything the DOM holds is kept: node types, values, the CDATA flag,
+	declarations, comments, unknowns, attributes, the row and column of
+	every node and attribute, the document's tab size and byte order mark.
+	User data is not.
+
+	@verbatim
+	XMLBinaryImage image;
+	if ( image.Open( "reference.xmlb" ) )
+	{
+		for( uint32_t i = image.FirstChild( 0 ); i != XMLBinaryImage::NONE; i = image.NextSibling( i ) )
+			printf( "%s\n", image.Value( i ) );
+	}
+	@endverbatim
+
+	The image uses the byte order of the machine that wrote it, and Open()
+	refuses an image from a machine of the other byte order. The whole image
+	is checked when it is opened, so a damaged file is refused rather than
+	read out of bounds.
+
+	Only available in STL mode.
+*/
+class XMLBinaryImage
+{
+public:
+	/// The format version written, and the only one read.
+	enum { VERSION = 1 };
+	/// The index returned when there is no such node or attribute.
+	static const uint32_t NONE = 0xffffffffU;
+
+	XMLBinaryImage();
+	~XMLBinaryImage();
+
+	/** Map an image file into memory (or read it, where mapping isn't
+		available). Returns true if the file is a valid image.
+	*/
+	bool Open( const char* filename );
+	/** Use an image already in memory. The data is not copied, and must
+		stay valid, and 4 byte aligned, until the image is closed.
+		Returns true if the data is a valid image.
+	*/
+	bool Attach( const void* data, size_t size );
+	/// Build the image of a document in memory. Returns true if successful.
+	bool Build( const XMLDocument& document );
+	/// Release the image.
+	void Close();
+
+	/// True if an image is open.
+	bool IsOpen() const						{ return data != 0; }
+	/// The raw image, as written by SaveBinary().
+	const char* Data() const				{ return data; }
+	/// The size of the raw image in bytes.
+	size_t Size() const						{ return size; }
+
+	/// The tab size of the document the image was made from.
+	int TabSize() const						{ return header->tabSize; }
+	/// True if the document was read with a UTF-8 byte order mark.
+	bool UsesMicrosoftBOM() const			{ return ( header->flags & FLAG_BOM ) != 0; }
+
+	/// The number of nodes, including the document (node 0).
+	uint32_t NodeCount() const				{ return header->nodeCount; }
+	/// The number of attributes.
+	uint32_t AttributeCount() const			{ return header->attributeCount; }
+
+	/// The XMLNode::NodeType of a node.
+	int Type( uint32_t node ) const			{ return types[node] & TYPE_MASK; }
+	/// True if a text node is CDATA.
+	bool CDATA( uint32_t node ) const		{ return ( types[node] & CDATA_FLAG ) != 0; }
+	/// The value of a node. See XMLNode::Value().
+	const char* Value( uint32_t node ) const			{ return String( values[node] ); }
+	/// The length of Value().
+	size_t ValueLength( uint32_t node ) const			{ return StringLength( values[node] ); }
+
+	uint32_t Parent( uint32_t node ) const				{ return parents[node]; }
+	/// One past the last node of the subtree of 'node'.
+	uint32_t SubtreeEnd( uint32_t node ) const			{ return ends[node]; }
+	uint32_t FirstChild( uint32_t node ) const			{ return ends[node] > node+1 ? node+1 : NONE; }
+	uint32_t LastChild( uint32_t node ) const			{ return ends[node] > node+1 ? prevs[node+1] : NONE; }
+	uint32_t NextSibling( uint32_t node ) const			{ return node && ends[node] < ends[parents[node]] ? ends[node] : NONE; }
+	uint32_t PreviousSibling( uint32_t node ) const		{ return node && node != parents[node]+1 ? prevs[node] : NONE; }
+
+	/// The row of a node, 0 based; -1 if unknown. See XMLBase::Row().
+	int Row( uint32_t node ) const						{ return rows[node]; }
+	/// The column of a node, 0 based; -1 if unknown.
+	int Column( uint32_t node ) const					{ return cols[node]; }
+
+	/// The first attribute of a node. Valid even if the node has none.
+	uint32_t FirstAttribute( uint32_t node ) const		{ return attributeStarts[node]; }
+	/// One past the last attribute of a node.
+	uint32_t AttributeEnd( uint32_t node ) const		{ return attributeStarts[node+1]; }
+
+	const char* AttributeName( uint32_t attribute ) const			{ return String( attributeNames[attribute] ); }
+	size_t AttributeNameLength( uint32_t attribute ) const			{ return StringLength( attributeNames[attribute] ); }
+	const char* AttributeValue( uint32_t attribute ) const			{ return String( attributeValues[attribute] ); }
+	size_t AttributeValueLength( uint32_t attribute ) const			{ return StringLength( attributeValues[attribute] ); }
+	int AttributeRow( uint32_t attribute ) const					{ return attributeRows[attribute]; }
+	int AttributeColumn( uint32_t attribute ) const					{ return attributeCols[attribute]; }
+
+private:
+	enum
+	{
+		TYPE_MASK			= 0x0f,
+		CDATA_FLAG			= 0x80,
+		FLAG_BOM			= 0x01,
+		IMAGE_BYTE_ORDER	= 0x01020304
+	};
+
+	// The image starts with this header. Offsets are from the start of the
+	// image, and every section is 4 byte aligned.
+	struct Header
+	{
+		char		magic[4];		// "XMLB"
+		uint32_t	byteOrder;		// IMAGE_BYTE_ORDER, as written
+		uint32_t	version;
+		uint32_t	flags;
+		int32_t		tabSize;
+		uint32_t	nodeCount;
+		uint32_t	attributeCount;
+		uint32_t	stringSize;
+		uint32_t	typeOffset;				// uint8_t[ nodeCount ]
+		uint32_t	parentOffset;			// uint32_t[ nodeCount ]
+		uint32_t	endOffset;				// uint32_t[ nodeCount ]
+		uint32_t	prevOffset;				// uint32_t[ nodeCount ], the first child holds the last
+		uint32_t	valueOffset;			// uint32_t[ nodeCount ], string references
+		uint32_t	rowOffset;				// int32_t[ nodeCount ]
+		uint32_t	colOffset;				// int32_t[ nodeCount ]
+		uint32_t	attributeStartOffset;	// uint32_t[ nodeCount+1 ]
+		uint32_t	attributeNameOffset;	// uint32_t[ attributeCount ], string references
+		uint32_t	attributeValueOffset;	// uint32_t[ attributeCount ], string references
+		uint32_t	attributeRowOffset;		// int32_t[ attributeCount ]
+		uint32_t	attributeColOffset;		// int32_t[ attributeCount ]
+		uint32_t	stringOffset;			// char[ stringSize ]
+		uint32_t	size;					// the whole image
+	};
+
+	class Writer;
+
+	XMLBinaryImage( const XMLBinaryImage& );		// not allowed
+	void operator=( const XMLBinaryImage& );		// not allowed
+
+	bool Load();
+	bool Validate() const;
+	bool ValidString( uint32_t ref ) const;
+
+	const char* String( uint32_t ref ) const		{ return strings + ref; }
+	size_t StringLength( uint32_t ref ) const		{ uint32_t length; memcpy( &length, strings + ref - 4, 4 ); return length; }
+
+	const char*		data;
+	size_t			size;
+	std::string		buffer;			// owned data, if any
+	void*			mapping;		// mapped data, if any
+	size_t			mappingSize;
+
+	const Header*	header;
+	const uint8_t*	types;
+	const uint32_t*	parents;
+	const uint32_t*	ends;
+	const uint32_t*	prevs;
+	const uint32_t*	values;
+	const int32_t*	rows;
+	const int32_t*	cols;
+	const uint32_t*	attributeStarts;
+	const uint32_t*	attributeNames;
+	const uint32_t*	attributeValues;
+	const int32_t*	attributeRows;
+	const int32_t*	attributeCols;
+	const char*		strings;
+};
+
+#endif	// USE_STL
+
+#endif
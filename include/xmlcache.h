@@ -0,0 +1,126 @@
+
+#ifndef __XMLCACHE_H__
+#define __XMLCACHE_H__
+
+#include "xmlparser.h"
+
+#ifdef XML_THREADS
+
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "xmlsnapshot.h"
+
+/**	A cache of parsed files, shared by everything in the process that loads
+	them. Load() returns the file as a XMLSnapshot, the same document for
+	every caller, parsed once for all of them:
+
+	@verbatim
+	XMLSnapshot config = XMLDocumentCache::Shared().Load( "config.xml" );
+	if ( config.Error() )
+		printf( "%s\n", config->ErrorDesc() );
+	@endverbatim
+
+	A file is identified by its name, as given, and by what the system says
+	of it: device, inode, size and modification time. Each Load() asks again,
+	and a file that changed since it was parsed is parsed anew; snapshots of
+	the old document keep it alive, unchanged. A change that keeps the size
+	and lands within the resolution of the file system's clock is not seen.
+	The same file under two names is cached twice.
+
+	Threads asking for the same file at once share one load: the first
+	parses it, and the others wait for it rather than parse it too.
+
+	The documents are kept within MaxBytes() of memory, as counted by
+	XMLDocument::MemoryUsage(); those asked for least recently go first.
+	A snapshot still held by a caller outlives its eviction, but is no
+	longer counted. A document larger than MaxBytes() is returned but not
+	kept.
+
+	Files that fail to load or parse are not cached: the snapshot returned
+	has the error of XMLDocument::LoadFile(), and the next Load() tries
+	again.
+
+	All the methods may be called from any thread. Only available in STL
+	mode, with a C++11 compiler.
+*/
+class XMLDocumentCache
+{
+public:
+	/// What the cache did so far; see GetStats().
+	struct Stats
+	{
+		Stats() : hits( 0 ), misses( 0 ), joins( 0 ), evictions( 0 ), errors( 0 ), documents( 0 ), bytes( 0 ) {}
+
+		size_t hits;		///< Load()s answered from the cache.
+		size_t misses;		///< Load()s that parsed the file, because it wasn't cached or had changed.
+		size_t joins;		///< Load()s that waited for another thread's parse of the same file.
+		size_t evictions;	///< Documents dropped to stay within MaxBytes().
+		size_t errors;		///< Loads that failed; each is also a miss.
+		size_t documents;	///< The documents cached now.
+		size_t bytes;		///< Their memory now.
+	};
+
+	/// The default for MaxBytes(): 64 MB.
+	static const size_t DEFAULT_MAX_BYTES = 64 * 1024 * 1024;
+
+	/// Create an empty cache that keeps up to 'maxBytes' of documents.
+	XMLDocumentCache( size_t maxBytes = DEFAULT_MAX_BYTES );
+	~XMLDocumentCache();
+
+	/// The cache of the process, for code that shares its files.
+	static XMLDocumentCache& Shared();
+
+	/** The parsed document of 'filename', from the cache if it holds the
+		file as it is now, else loaded with XMLDocument::LoadFile(). Check
+		XMLSnapshot::Error() for the result. 'encoding' is used only when
+		the file is parsed.
+	*/
+	XMLSnapshot Load( const char* filename, XMLEncoding encoding = DEFAULT_ENCODING );
+
+	/// Drop 'filename' from the cache, if there.
+	void Remove( const char* filename );
+	/// Drop every document. Loads under way finish, but aren't kept.
+	void Clear();
+
+	/// Change the memory the cache may use, evicting documents if needed.
+	void SetMaxBytes( size_t maxBytes );
+	size_t MaxBytes() const;
+
+	/// The counts so far, and the documents held now.
+	Stats GetStats() const;
+	/// Set the counts back to 0. The documents stay.
+	void ResetStats();
+
+private:
+	struct Identity;
+	struct Entry;
+	typedef std::shared_ptr< Entry > EntryPtr;
+	typedef std::map< std::string, EntryPtr > EntryMap;
+	typedef std::list< EntryPtr > EntryList;
+
+	XMLDocumentCache( const XMLDocumentCache& );		// not implemented.
+	void operator=( const XMLDocumentCache& );		// not implemented.
+
+	// Ask the system about 'filename'. Returns false if it can't be read.
+	static bool GetIdentity( const char* filename, Identity* identity );
+	// Forget 'entry'; with 'evicted', count it as an eviction.
+	void Drop( const EntryPtr& entry, bool evicted );
+	// Evict the least recently used documents until within maxBytes.
+	void Trim();
+
+	mutable std::mutex			mutex;
+	std::condition_variable		loaded;		// Signalled when any load ends.
+	EntryMap					entries;	// By file name: the cached documents, and the loads under way.
+	EntryList					recent;		// The cached documents, most recently used first.
+	size_t						maxBytes;
+	Stats						stats;
+};
+
+#endif	// XML_THREADS
+
+#endif
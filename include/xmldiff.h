@@ -0,0 +1,154 @@
+
+#ifndef __XMLDIFF_H__
+#define __XMLDIFF_H__
+
+#include "xmlparser.h"
+
+#ifdef USE_STL
+
+#include <string>
+#include <vector>
+
+/**	XMLDiff is an edit script between two documents: the edits that turn
+	one document (the source) into the other (the target). Compute() builds
+	the script from the two trees, and Apply() plays it on a copy of the
+	source, typically on another host: only the script needs to be sent.
+
+	@verbatim
+	XMLDiff diff;
+	diff.Compute( oldConfig, newConfig );
+
+	XMLDocument script;
+	diff.ToDocument( &script );		// save or send it
+	...
+	XMLDiff received;
+	if ( received.FromDocument( script ) && received.Apply( &config ) ) ...
+	@endverbatim
+
+	Subtrees are compared by their XMLNode::Fingerprint(), which the nodes
+	keep: identical subtrees are skipped without being walked, and only the
+	regions that differ are descended into. The cost is linear in the size
+	of the documents, plus a log factor for the children that changed; a
+	document fingerprinted before costs only what changed since. Elements
+	with the same name at the same place are matched and diffed in depth;
+	other changes become inserts, deletes and replaces of whole subtrees.
+	The script is minimal for the common changes (an attribute, a text, a
+	few children), but not in general: a child moved to another place is
+	deleted and inserted.
+
+	Edits address their node by a path of child indices from the document,
+	in the document as it is when the edit is played: each edit assumes the
+	ones before it were applied. Two different subtrees with the same 128
+	bit fingerprint would be taken as equal. The script also keeps 64 bit
+	hashes of both documents, so that Apply() can check it is playing the
+	script on the right source and that it got the target.
+
+	Only available in STL mode.
+*/
+class XMLDiff
+{
+public:
+	/// The kinds of edit.
+	enum Operation
+	{
+		INSERT_NODE,		///< Insert 'node' before the child at 'path' (or at the end).
+		DELETE_NODE,		///< Delete the node at 'path'.
+		REPLACE_NODE,		///< Replace the node at 'path' with 'node'.
+		SET_ATTRIBUTE,		///< Set attribute 'name' of the element at 'path' to 'value'.
+		REMOVE_ATTRIBUTE,	///< Remove attribute 'name' of the element at 'path'.
+		SET_TEXT			///< Set the text at 'path' to 'value'.
+	};
+
+	/// One edit of the script.
+	struct Edit
+	{
+		Edit() : operation( INSERT_NODE ), node( 0 ) {}
+
+		Operation operation;
+		std::vector< size_t > path;	///< The child indices, from the document, of the node edited.
+		std::string name;			///< The attribute name, for the attribute edits.
+		std::string value;			///< The new value, for SET_ATTRIBUTE and SET_TEXT.
+		const XMLNode* node;		///< The node inserted, owned by the XMLDiff, for INSERT_NODE and REPLACE_NODE.
+	};
+
+	/// Create an empty script, which changes nothing.
+	XMLDiff();
+
+	/** Compute the script that turns 'from' into 'to', replacing the current
+		one. Neither document is changed. Returns false, with an empty
+		script, if either document has an error.
+	*/
+	bool Compute( const XMLDocument& from, const XMLDocument& to );
+
+	/** Play the script on 'document'. With 'verify', the document must
+		hash to SourceHash() first, and to TargetHash() after.
+		Returns false if the document isn't the source, if an edit doesn't
+		fit the document, or if the result isn't the target. The document
+		may then be partly patched: apply to a copy if that matters.
+	*/
+	bool Apply( XMLDocument* document, bool verify = true ) const;
+
+	/// The number of edits.
+	size_t EditCount() const					{ return edits.size(); }
+	/// The edit at 'index', in the order they are played.
+	const Edit& GetEdit( size_t index ) const	{ return edits[index]; }
+	/// Returns true if the script changes nothing.
+	bool Empty() const							{ return edits.empty(); }
+
+	/// The hash of the source document.
+	unsigned long long SourceHash() const		{ return sourceHash; }
+	/// The hash of the target document.
+	unsigned long long TargetHash() const		{ return targetHash; }
+	/// The subtrees Compute() skipped, because they were the same in both documents.
+	size_t SkippedSubtrees() const				{ return skippedSubtrees; }
+
+	/// Reset to the empty script.
+	void Clear();
+
+	/** Write the script as XML to 'out', replacing its content:
+		@verbatim
+		<xmldiff source="3f0c..." target="9a61...">
+			<set path="0/2" name="port" value="8080"/>
+			<text path="0/4/0" value="new text"/>
+			<insert path="0/5"><server name="b"/></insert>
+			<insert path="0/6" text="a text node"/>
+			<replace path="0/7"><!-- a comment --></replace>
+			<remove path="0/8" name="debug"/>
+			<delete path="0/9"/>
+		</xmldiff>
+		@endverbatim
+		Inserted texts are written as attributes, whose value keeps any
+		whitespace. The texts inside an inserted subtree are read back as
+		the documents are: when whitespace is kept (see
+		XMLBase::SetCondenseWhiteSpace()), print the script with
+		XMLPrinter::SetStreamPrinting(), so that no indentation is added.
+	*/
+	void ToDocument( XMLDocument* out ) const;
+
+	/** Read a script written by ToDocument(), replacing the current one.
+		Returns false, with an empty script, if it isn't a valid script.
+	*/
+	bool FromDocument( const XMLDocument& in );
+
+	/// The hash of a document, as Compute() and Apply() compute it: half its XMLNode::Fingerprint().
+	static unsigned long long Hash( const XMLDocument& document );
+
+private:
+	class Differ;
+	class Patcher;
+
+	XMLDiff( const XMLDiff& );				// not implemented.
+	void operator=( const XMLDiff& );		// not implemented.
+
+	// Add an edit of the node at 'path', keeping a copy of 'node' if given.
+	Edit* AddEdit( Operation operation, const std::vector< size_t >& path, const XMLNode* node = 0 );
+
+	std::vector< Edit > edits;
+	XMLDocument nodes;				// The nodes of the INSERT_NODE and REPLACE_NODE edits.
+	unsigned long long sourceHash;
+	unsigned long long targetHash;
+	size_t skippedSubtrees;
+};
+
+#endif	// USE_STL
+#endif
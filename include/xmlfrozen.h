@@ -0,0 +1,245 @@
+
+#ifndef __XMLFROZEN_H__
+#define __XMLFROZEN_H__
+
+#include "xmlbinary.h"
+
+#ifdef USE_STL
+
+class XMLFrozenDocument;
+
+/** A light handle to an attribute of a XMLFrozenDocument: an image and an
+	index, cheap to copy. A null handle (IsNull()) stands for "no attribute".
+*/
+class XMLFrozenAttribute
+{
+public:
+	XMLFrozenAttribute() : image( 0 ), index( XMLBinaryImage::NONE ), end( XMLBinaryImage::NONE ) {}
+
+	/// True if the handle refers to no attribute.
+	bool IsNull() const					{ return index == XMLBinaryImage::NONE; }
+
+	const char* Name() const			{ return image->AttributeName( index ); }		///< Return the name of this attribute.
+	const char* Value() const			{ return image->AttributeValue( index ); }		///< Return the value of this attribute.
+	size_t ValueLength() const			{ return image->AttributeValueLength( index ); }	///< Return the length of Value().
+	int Row() const						{ return image->AttributeRow( index ) + 1; }	///< See XMLBase::Row()
+	int Column() const					{ return image->AttributeColumn( index ) + 1; }	///< See XMLBase::Row()
+
+	/// See XMLAttribute::QueryIntValue()
+	int QueryIntValue( int* value ) const			{ return XMLBase::ConvertToInt( Value(), value ); }
+	/// See XMLAttribute::QueryDoubleValue()
+	int QueryDoubleValue( double* value ) const		{ return XMLBase::ConvertToDouble( Value(), value ); }
+
+	/// The next attribute of the same element, or a null handle.
+	XMLFrozenAttribute Next() const		{ return index+1 < end ? XMLFrozenAttribute( image, index+1, end ) : XMLFrozenAttribute(); }
+
+	bool operator==( const XMLFrozenAttribute& rhs ) const	{ return index == rhs.index && ( image == rhs.image || IsNull() ); }
+	bool operator!=( const XMLFrozenAttribute& rhs ) const	{ return !( *this == rhs ); }
+
+private:
+	friend class XMLFrozenNode;
+
+	XMLFrozenAttribute( const XMLBinaryImage* _image, uint32_t _index, uint32_t _end )
+		: image( _image ), index( _index ), end( _end ) {}
+
+	const XMLBinaryImage*	image;
+	uint32_t				index;
+	uint32_t				end;
+};
+
+
+/** A light handle to a node of a XMLFrozenDocument: an image and an index,
+	cheap to copy and compare. It offers the read side of the XMLNode and
+	XMLElement API, returning handles where those return pointers. A null
+	handle (IsNull()) stands for the null pointer, and navigating from a
+	null handle gives a null handle, much like XMLHandle.
+
+	@verbatim
+	for( XMLFrozenNode item = doc.RootElement().FirstChildElement( "item" );
+		 !item.IsNull();
+		 item = item.NextSiblingElement( "item" ) )
+	{
+		int id = 0;
+		item.QueryIntAttribute( "id", &id );
+	}
+	@endverbatim
+*/
+class XMLFrozenNode
+{
+public:
+	XMLFrozenNode() : image( 0 ), index( XMLBinaryImage::NONE ) {}
+
+	/// True if the handle refers to no node.
+	bool IsNull() const							{ return index == XMLBinaryImage::NONE; }
+	/// The position of the node in document order; the document is 0.
+	uint32_t Index() const						{ return index; }
+
+	/// The XMLNode::NodeType of the node.
+	int Type() const							{ return image->Type( index ); }
+	/// See XMLNode::Value()
+	const char* Value() const					{ return image->Value( index ); }
+	/// Return the length of Value().
+	size_t ValueLength() const					{ return image->ValueLength( index ); }
+	/// See XMLBase::Row()
+	int Row() const								{ return image->Row( index ) + 1; }
+	/// See XMLBase::Row()
+	int Column() const							{ return image->Column( index ) + 1; }
+	/// True for a CDATA text node. See XMLText::CDATA()
+	bool CDATA() const							{ return image->CDATA( index ); }
+
+	bool IsDocument() const						{ return Is( XMLNode::TINYXML_DOCUMENT ); }
+	bool IsElement() const						{ return Is( XMLNode::TINYXML_ELEMENT ); }
+	bool IsComment() const						{ return Is( XMLNode::TINYXML_COMMENT ); }
+	bool IsUnknown() const						{ return Is( XMLNode::TINYXML_UNKNOWN ); }
+	bool IsText() const							{ return Is( XMLNode::TINYXML_TEXT ); }
+	bool IsDeclaration() const					{ return Is( XMLNode::TINYXML_DECLARATION ); }
+
+	XMLFrozenNode Parent() const				{ return IsNull() ? XMLFrozenNode() : XMLFrozenNode( image, image->Parent( index ) ); }
+	XMLFrozenNode FirstChild() const			{ return IsNull() ? XMLFrozenNode() : XMLFrozenNode( image, image->FirstChild( index ) ); }
+	XMLFrozenNode LastChild() const				{ return IsNull() ? XMLFrozenNode() : XMLFrozenNode( image, image->LastChild( index ) ); }
+	XMLFrozenNode NextSibling() const			{ return IsNull() ? XMLFrozenNode() : XMLFrozenNode( image, image->NextSibling( index ) ); }
+	XMLFrozenNode PreviousSibling() const		{ return IsNull() ? XMLFrozenNode() : XMLFrozenNode( image, image->PreviousSibling( index ) ); }
+
+	XMLFrozenNode FirstChild( const char* value ) const;		///< The first child with the given value.
+	XMLFrozenNode LastChild( const char* value ) const;			///< The last child with the given value.
+	XMLFrozenNode NextSibling( const char* value ) const;		///< The next sibling with the given value.
+	XMLFrozenNode PreviousSibling( const char* value ) const;	///< The previous sibling with the given value.
+
+	XMLFrozenNode FirstChildElement() const;					///< See XMLNode::FirstChildElement()
+	XMLFrozenNode FirstChildElement( const char* value ) const;	///< See XMLNode::FirstChildElement()
+	XMLFrozenNode NextSiblingElement() const;					///< See XMLNode::NextSiblingElement()
+	XMLFrozenNode NextSiblingElement( const char* value ) const;	///< See XMLNode::NextSiblingElement()
+
+	/// True if the node has no children.
+	bool NoChildren() const						{ return IsNull() || image->FirstChild( index ) == XMLBinaryImage::NONE; }
+
+	/// The first attribute of an element, or a null handle.
+	XMLFrozenAttribute FirstAttribute() const;
+	/// Return the value of the named attribute, or null. See XMLElement::Attribute()
+	const char* Attribute( const char* name ) const;
+	/// See XMLElement::QueryIntAttribute()
+	int QueryIntAttribute( const char* name, int* value ) const;
+	/// See XMLElement::QueryUnsignedAttribute()
+	int QueryUnsignedAttribute( const char* name, unsigned* value ) const;
+	/// See XMLElement::QueryDoubleAttribute()
+	int QueryDoubleAttribute( const char* name, double* value ) const;
+	/// See XMLElement::QueryBoolAttribute()
+	int QueryBoolAttribute( const char* name, bool* value ) const;
+	/// See XMLElement::GetText()
+	const char* GetText() const;
+
+	const char* Version() const;		///< See XMLDeclaration::Version(). Null for other nodes.
+	const char* Encoding() const;		///< See XMLDeclaration::Encoding(). Null for other nodes.
+	const char* Standalone() const;		///< See XMLDeclaration::Standalone(). Null for other nodes.
+
+	bool operator==( const XMLFrozenNode& rhs ) const	{ return index == rhs.index && ( image == rhs.image || IsNull() ); }
+	bool operator!=( const XMLFrozenNode& rhs ) const	{ return !( *this == rhs ); }
+
+private:
+	friend class XMLFrozenDocument;
+
+	XMLFrozenNode( const XMLBinaryImage* _image, uint32_t _index ) : image( _image ), index( _index ) {}
+
+	bool Is( int type ) const					{ return !IsNull() && image->Type( index ) == type; }
+	bool ValueIs( uint32_t node, const char* value ) const	{ return strcmp( image->Value( node ), value ) == 0; }
+	const char* DeclarationString( uint32_t which ) const;
+
+	const XMLBinaryImage*	image;
+	uint32_t				index;
+};
+
+
+/** A frozen document is a read-only form of a XMLDocument, stored flat:
+	every node property is an array indexed by the node's position in
+	document order (see XMLBinaryImage), and names and values live in one
+	string table. Nodes are not objects; they are visited through
+	XMLFrozenNode handles.
+
+	Compared to the XMLDocument it is made from, a frozen document needs
+	several times less memory and a handful of allocations in all, and
+	walking it is a linear pass over a few arrays. It can also be saved
+	and mapped straight back from a file with no parsing at all.
+
+	@verbatim
+	XMLFrozenDocument frozen;
+	frozen.LoadFile( "reference.xml" );		// or frozen.Freeze( doc ), or frozen.LoadBinary( "reference.xmlb" )
+	XMLFrozenNode root = frozen.RootElement();
+	@endverbatim
+
+	Every node can be reached in document order by index, which is the
+	fastest way to scan the whole document:
+	@verbatim
+	for( uint32_t i=0; i<frozen.NodeCount(); ++i )
+		if ( frozen.Node( i ).IsElement() ) ...
+	@endverbatim
+
+	A frozen document is never modified, so any number of threads may read
+	it at once. Handles stay valid until the document is destroyed or
+	loaded again.
+
+	Only available in STL mode.
+*/
+class XMLFrozenDocument
+{
+public:
+	XMLFrozenDocument();
+	/// Freeze the given document. Check Error() for the result.
+	XMLFrozenDocument( const XMLDocument& document );
+
+	/// Make this a frozen copy of 'document'. Returns true if successful.
+	bool Freeze( const XMLDocument& document );
+	/** Parse xml text into a frozen document. Returns true if successful;
+		on failure the error is reported as for XMLDocument::Parse().
+	*/
+	bool Parse( const char* xml, XMLEncoding encoding = DEFAULT_ENCODING );
+	/// Load and freeze an xml file. Returns true if successful.
+	bool LoadFile( const char* filename, XMLEncoding encoding = DEFAULT_ENCODING );
+	/// Map an image written by SaveBinary() or XMLDocument::SaveBinary(). Returns true if successful.
+	bool LoadBinary( const char* filename );
+	/// Save the document's image. Returns true if successful.
+	bool SaveBinary( const char* filename ) const;
+	/// Rebuild a normal, editable XMLDocument from the frozen one.
+	bool Thaw( XMLDocument* document ) const	{ return document->LoadBinary( image ); }
+
+	/// See XMLDocument::Error()
+	bool Error() const					{ return error; }
+	/// See XMLDocument::ErrorDesc()
+	const char* ErrorDesc() const		{ return errorDesc.c_str(); }
+	/// See XMLDocument::ErrorId()
+	int ErrorId() const					{ return errorId; }
+	/// See XMLDocument::ErrorRow()
+	int ErrorRow() const				{ return errorRow; }
+	/// See XMLDocument::ErrorRow()
+	int ErrorCol() const				{ return errorCol; }
+
+	/// The document node, or a null handle if nothing is loaded.
+	XMLFrozenNode Document() const		{ return image.IsOpen() ? XMLFrozenNode( &image, 0 ) : XMLFrozenNode(); }
+	/// See XMLDocument::RootElement()
+	XMLFrozenNode RootElement() const	{ return Document().FirstChildElement(); }
+
+	/// The number of nodes, including the document node.
+	uint32_t NodeCount() const			{ return image.IsOpen() ? image.NodeCount() : 0; }
+	/// The node at the given position in document order.
+	XMLFrozenNode Node( uint32_t i ) const	{ return XMLFrozenNode( &image, i ); }
+
+	/// The storage behind the document.
+	const XMLBinaryImage& Image() const	{ return image; }
+
+private:
+	XMLFrozenDocument( const XMLFrozenDocument& );		// not allowed
+	void operator=( const XMLFrozenDocument& );		// not allowed
+
+	void SetError( const XMLDocument& document );
+	void SetError( int id );
+
+	XMLBinaryImage	image;
+	bool			error;
+	int				errorId;
+	std::string		errorDesc;
+	int				errorRow;
+	int				errorCol;
+};
+
+#endif	// USE_STL
+
+#endif
@@ -0,0 +1,106 @@
+
+#ifndef __XMLMEMORY_H__
+#define __XMLMEMORY_H__
+
+#include "xmlparser.h"
+
+#ifdef USE_STL
+
+#include <map>
+#include <string>
+
+/**	XMLMemoryUsage is a report of the memory a XMLDocument holds, as
+	returned by XMLDocument::MemoryUsage(). It is computed by walking the
+	tree, from the sizes the library actually allocates: the size of each
+	node and attribute object, the heap buffer of each string (names,
+	values, text; short strings kept inside the std::string count nothing),
+	and the header the library adds to every block it allocates (see
+	XMLAllocator::Overhead()). What the allocator itself spends on top of
+	that is not known here; count it with a XMLCountingAllocator.
+
+	The bytes are split by node: elements by their name, and the other
+	nodes under "#text", "#comment", "#unknown" and "#declaration". An
+	element's entry holds the element, its attributes and
+	their strings, but not its children, so the entries add up to Tree().
+
+	@verbatim
+	XMLMemoryUsage usage = doc.MemoryUsage();
+	printf( "%lu bytes\n", (unsigned long) usage.TotalBytes() );
+	printf( "%s", usage.ToString( 10 ).c_str() );
+	@endverbatim
+
+	Children that a snapshot clone still shares (see XMLSnapshot::Clone())
+	belong to the snapshot, and are not counted; see SharedNodes(). The
+	XMLDocument object itself, which usually lives on the stack, is not
+	counted either: only what it owns.
+
+	Only available in STL mode.
+*/
+class XMLMemoryUsage
+{
+public:
+	/// The memory of a group of nodes.
+	struct Bytes
+	{
+		Bytes() : nodes( 0 ), attributes( 0 ), nodeBytes( 0 ), attributeBytes( 0 ), stringBytes( 0 ), overheadBytes( 0 ) {}
+
+		size_t nodes;			///< The number of nodes.
+		size_t attributes;		///< The number of attributes they have.
+		size_t nodeBytes;		///< The node objects.
+		size_t attributeBytes;	///< The attribute objects.
+		size_t stringBytes;		///< The heap buffers of their strings.
+		size_t overheadBytes;	///< The block headers of the node and attribute objects.
+
+		/// All of the bytes.
+		size_t Total() const	{ return nodeBytes + attributeBytes + stringBytes + overheadBytes; }
+		/// Add the counts of 'other'.
+		void Add( const Bytes& other );
+	};
+
+	/// The bytes of each element name, and of the other node types.
+	typedef std::map< std::string, Bytes > NameMap;
+
+	XMLMemoryUsage()						{ Clear(); }
+
+	/// Reset to an empty report.
+	void Clear();
+
+	/// The memory of the tree: the sum of ByName().
+	const Bytes& Tree() const				{ return tree; }
+	/// The memory of the tree by element name (and node type).
+	const NameMap& ByName() const			{ return byName; }
+	/** The memory the document keeps besides the tree: the nodes and
+		attributes kept for reuse (see XMLDocument::SetReuseMemory()),
+		LoadFile()'s buffer, and the document's own strings.
+	*/
+	size_t ReservedBytes() const			{ return reservedBytes; }
+	/// All the memory of the document: Tree() and ReservedBytes().
+	size_t TotalBytes() const				{ return tree.Total() + reservedBytes; }
+	/// The number of nodes whose children are still shared with a snapshot, and not counted.
+	size_t SharedNodes() const				{ return sharedNodes; }
+
+	/** The report as text, one "key=value" per line, with the given prefix
+		on each key. The names follow the totals, the largest first, up to
+		'maxNames' of them (all of them if 0).
+	*/
+	std::string ToString( size_t maxNames = 0, const char* prefix = "" ) const;
+
+	/// The heap bytes of a string: 0 while it is short enough to be kept in the object.
+	static size_t StringBytes( const std::string& str );
+
+private:
+	friend class XMLDocument;
+
+	// Walk the tree and the memory kept by 'document'.
+	void Collect( const XMLDocument& document );
+	// Add the memory of 'node' alone (with its attributes) to 'bytes'.
+	static void AddNode( const XMLNode* node, Bytes* bytes );
+
+	Bytes tree;
+	NameMap byName;
+	size_t reservedBytes;
+	size_t sharedNodes;
+};
+
+#endif	// USE_STL
+#endif
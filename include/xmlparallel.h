@@ -0,0 +1,86 @@
+
+#ifndef __XMLPARALLEL_H__
+#define __XMLPARALLEL_H__
+
+#include "xmlparser.h"
+
+#ifdef XML_THREADS
+
+#include <string>
+#include <vector>
+
+/** Prints a DOM tree on several threads. The output is byte for byte what
+	XMLPrinter produces with the same options.
+
+	The tree is cut into runs of sibling subtrees of roughly equal size.
+	Each run is printed by a worker with its own XMLPrinter, starting at
+	the run's indentation depth, into its own buffer. The tags of the
+	elements that were cut open are printed by the calling thread. The
+	buffers are then joined, or written out with writev(), in document
+	order.
+
+	@verbatim
+	XMLParallelPrinter printer;
+	printer.SetIndent( "\t" );
+	printer.Print( doc );
+	printer.Write( fd );		// or printer.Str()
+	@endverbatim
+
+	Small trees are simply printed on the calling thread. The tree must not
+	be modified while Print() runs.
+
+	Only available in STL mode, with a C++11 compiler.
+*/
+class XMLParallelPrinter
+{
+public:
+	/// 'threads' is the number of workers; 0 uses the number of hardware threads.
+	XMLParallelPrinter( unsigned threads = 0 );
+
+	/// See XMLPrinter::SetIndent()
+	void SetIndent( const char* _indent )			{ indent = _indent ? _indent : ""; }
+	/// See XMLPrinter::SetLineBreak()
+	void SetLineBreak( const char* _lineBreak )		{ lineBreak = _lineBreak ? _lineBreak : ""; }
+	/// See XMLPrinter::SetStreamPrinting()
+	void SetStreamPrinting()						{ indent = ""; lineBreak = ""; }
+
+	/** Print 'node' (usually a XMLDocument) and everything below it, replacing
+		any previous output.
+	*/
+	void Print( const XMLNode& node );
+
+	/// The total length of the output.
+	size_t Size() const;
+	/// Return the output joined into a single string.
+	std::string Str() const;
+
+	/// Write the output to a FILE*. Returns true if successful.
+	bool Write( FILE* fp ) const;
+	/// Write the output to a file descriptor, using writev() where available. Returns true if successful.
+	bool Write( int fd ) const;
+
+private:
+	struct Segment
+	{
+		const XMLNode*	first;		// first node of a run of siblings; null for pre-printed text
+		size_t			count;		// number of siblings in the run
+		int				depth;		// XMLPrinter depth to start at
+		std::string		text;		// the output
+	};
+
+	class SegmentPrinter;
+
+	void Plan( const XMLNode* parent, int depth, size_t grain, int splitsLeft );
+	void AddText( const std::string& str );
+	void AddRun( const XMLNode* first, size_t count, int depth );
+	void PrintSegment( Segment* segment ) const;
+
+	unsigned				threads;
+	std::string				indent;
+	std::string				lineBreak;
+	std::vector<Segment>	segments;
+};
+
+#endif
+
+#endif
@@ -19,16 +19,37 @@
 #       define DEBUG
 #endif
 
+// Move construction and assignment need a C++11 compiler.
+#if __cplusplus >= 201103L || ( defined( _MSC_VER ) && _MSC_VER >= 1700 )
+#       define XML_CXX11
+#endif
+
 #ifdef USE_STL
 	#include <string>
  	#include <iostream>
 	#include <sstream>
 	#define STRING		std::string
 #else
-	#include "xmlparser.h"
+	#include "xmlstring.h"
 	#define STRING		XMLString
 #endif
 
+// The thread based parts of the library (XMLParallelPrinter, XMLSnapshot)
+// need the STL and a C++11 compiler.
+#if defined( USE_STL ) && defined( XML_CXX11 )
+#       define XML_THREADS
+#endif
+
+#if defined( USE_STL ) && defined( XML_CXX11 )
+	#include <utility>
+#endif
+#ifdef XML_THREADS
+	#include <atomic>
+	#include <functional>
+	#include <future>
+	#include <memory>
+#endif
+
 // Deprecated library function hell. Compilers want to use the
 // new safe versions. This probably doesn't fully address the problem,
 // but it gets closer. There are too many compilers for me to fully
@@ -64,6 +85,13 @@ class XMLAttribute;
 class XMLText;
 class XMLDeclaration;
 class XMLParsingData;
+#ifdef USE_STL
+class XMLBinaryImage;
+class XMLMemoryUsage;
+#endif
+#ifdef XML_THREADS
+class XMLSnapshot;
+#endif
 
 const int MAJOR_VERSION = 2;
 const int MINOR_VERSION = 6;
@@ -82,6 +110,324 @@ struct XMLCursor
 };
 
 
+/**	A 128 bit hash of the content of a subtree: see XMLNode::Fingerprint().
+	Two subtrees with the same content have the same fingerprint; two that
+	differ have different ones, but for a chance of about 2^-64 per pair
+	compared. It is meant to find duplicates and changes, not to resist
+	text crafted to collide. Either half alone is a good 64 bit hash.
+*/
+struct XMLFingerprint
+{
+	XMLFingerprint() : low( 0 ), high( 0 ) {}
+
+	unsigned long long low;
+	unsigned long long high;
+
+	bool operator==( const XMLFingerprint& rhs ) const	{ return low == rhs.low && high == rhs.high; }
+	bool operator!=( const XMLFingerprint& rhs ) const	{ return !( *this == rhs ); }
+	/// An arbitrary order, to sort fingerprints or use them as map keys.
+	bool operator<( const XMLFingerprint& rhs ) const	{ return high < rhs.high || ( high == rhs.high && low < rhs.low ); }
+};
+
+
+/**	The interface for memory that the library allocates: nodes, attributes,
+	and the buffers of a XMLDocument (and, without the STL, the text of its
+	strings). Derive from it to route that memory to a pool, an arena, or an
+	accounting layer, and set it on a document with XMLDocument::SetAllocator().
+
+	Each block remembers the allocator it came from, and is given back to
+	it when freed, however long it lives and wherever it ends up. An
+	allocator must therefore outlive every block it has handed out.
+*/
+class XMLAllocator
+{
+public:
+	virtual ~XMLAllocator()					{}
+
+	/** Return a block of at least 'size' bytes, aligned to 8 bytes at least
+		(operator new's alignment is fine). Must not return null: if there is
+		no memory, throw (std::bad_alloc) or abort.
+	*/
+	virtual void* Allocate( size_t size ) = 0;
+	/// Give back a block from Allocate(). 'size' is the size that was asked for.
+	virtual void Free( void* block, size_t size ) = 0;
+
+	/** The bytes the library adds to every block, to remember its
+		allocator: 8, with or without an allocator set. The library's
+		objects are then 8 byte aligned, which is all they need.
+	*/
+	static size_t Overhead();
+
+	/*	[internal use] The allocator for allocations made now on this
+		thread; null for the default, operator new.
+	*/
+	static XMLAllocator* Current();
+};
+
+
+/**	A XMLAllocator that counts the memory going through it, and passes it
+	on to another allocator (by default, operator new). Use it to account
+	for the memory of a document or a group of documents, or in tests.
+
+	@verbatim
+	XMLCountingAllocator counter;
+	XMLDocument doc;
+	doc.SetAllocator( &counter );
+	doc.LoadFile( "big.xml" );
+	printf( "%lu bytes in %lu blocks\n", counter.LiveBytes(), counter.LiveBlocks() );
+	@endverbatim
+
+	With C++11 and the STL the counts are atomic, so documents on several
+	threads can share one counter.
+*/
+class XMLCountingAllocator : public XMLAllocator
+{
+public:
+	/// Count, and allocate from 'parent', or operator new if null.
+	XMLCountingAllocator( XMLAllocator* _parent = 0 );
+
+	virtual void* Allocate( size_t size );
+	virtual void Free( void* block, size_t size );
+
+	/// The number of blocks allocated so far.
+	size_t Allocations() const				{ return allocations; }
+	/// The number of blocks freed so far.
+	size_t Frees() const					{ return frees; }
+	/// The number of blocks in use.
+	size_t LiveBlocks() const				{ return allocations - frees; }
+	/// The bytes allocated so far, in all.
+	size_t BytesAllocated() const			{ return bytesAllocated; }
+	/// The bytes in use.
+	size_t LiveBytes() const				{ return liveBytes; }
+	/// The most bytes in use at any one time.
+	size_t PeakBytes() const				{ return peakBytes; }
+
+private:
+	XMLCountingAllocator( const XMLCountingAllocator& );	// not allowed.
+	void operator=( const XMLCountingAllocator& );			// not allowed.
+
+	#ifdef XML_THREADS
+	typedef std::atomic<size_t> Counter;
+	#else
+	typedef size_t Counter;
+	#endif
+
+	XMLAllocator*	parent;
+	Counter			allocations;
+	Counter			frees;
+	Counter			bytesAllocated;
+	Counter			liveBytes;
+	Counter			peakBytes;
+};
+
+
+/*	[internal use] Sets the allocator for the allocations made on this
+	thread, for a scope. XMLDocument sets its own around the work it does.
+*/
+class XMLAllocatorScope
+{
+public:
+	XMLAllocatorScope( XMLAllocator* allocator );
+	~XMLAllocatorScope();
+private:
+	XMLAllocator* previous;
+};
+
+
+/*	[internal use] Allocate a block from the current allocator (see
+	XMLAllocator::Current()), remembering it; and give a block back to the
+	allocator it came from. 'size' must be the same for both.
+*/
+void* XMLAllocateBlock( size_t size );
+void XMLFreeBlock( void* block, size_t size );
+
+
+#ifdef XML_THREADS
+/**	Runs the work the library does in the background, such as
+	XMLDocument::LoadFileAsync(). Derive from it to run that work on the
+	threads of an application's own pool or event loop; Default() is the
+	library's own.
+*/
+class XMLExecutor
+{
+public:
+	virtual ~XMLExecutor() {}
+
+	/** Run 'task' once, on some thread, some time after the call. A task
+		may block on I/O, but doesn't wait for other tasks.
+	*/
+	virtual void Execute( std::function< void() > task ) = 0;
+
+	/** The library's executor: a pool of threads, one per hardware thread,
+		started when first used and stopped at exit.
+	*/
+	static XMLExecutor* Default();
+};
+#endif
+
+
+/**	Trace points in the parser and the printers, for tying latency to the
+	shape of the input. They are compiled only into a library built with
+	XML_TRACE defined; without it they cost nothing at all, and Install()
+	does nothing (see Enabled()). With it, each point costs a load and a
+	test while no hooks are installed.
+
+	Fill in the hooks of interest (a null hook is skipped) and install
+	them for the whole process. A hook may forward to USDT probes, perf,
+	or a tracing library; it runs on the thread that parses or prints, in
+	the middle of the work, so it should be quick, and must not change
+	the document.
+
+	@verbatim
+	static void OnText( void* context, const XMLText* text, size_t length )
+	{
+		...
+	}
+
+	static XMLTraceHooks hooks;
+	hooks.text = OnText;
+	hooks.textThreshold = 64 * 1024;
+	XMLTraceHooks::Install( &hooks );
+	@endverbatim
+
+	The installed hooks must stay valid while a parse or print may use them.
+*/
+struct XMLTraceHooks
+{
+	XMLTraceHooks();
+
+	/// A document starts parsing the null terminated 'xml'.
+	void (*documentBegin)( void* context, const XMLDocument* document, const char* xml );
+	/// A document is parsed, or failed to; 'bytes' of the text were consumed.
+	void (*documentEnd)( void* context, const XMLDocument* document, size_t bytes );
+	/// An element starts; its name is read, its attributes and children are not.
+	void (*elementBegin)( void* context, const XMLElement* element );
+	/// An element is complete, with its closing tag.
+	void (*elementEnd)( void* context, const XMLElement* element );
+	/// A text or CDATA node of at least 'textThreshold' chars is read.
+	void (*text)( void* context, const XMLText* text, size_t length );
+	/// XMLDocument::SetError() raises error 'errorId'.
+	void (*error)( void* context, const XMLDocument* document, int errorId );
+	/// A printer hands 'bytes' of output to its file, descriptor or callback.
+	void (*flush)( void* context, size_t bytes );
+
+	/// Passed to every hook.
+	void* context;
+	/// The shortest text that the 'text' hook sees. 1024 by default.
+	size_t textThreshold;
+
+	/// True if the library was built with XML_TRACE, and has the trace points.
+	static bool Enabled();
+	/// Install 'hooks' for every thread; null removes them.
+	static void Install( const XMLTraceHooks* hooks );
+	/// The hooks installed, or null.
+	static const XMLTraceHooks* Installed();
+};
+
+
+#ifdef XML_TRACE
+// [internal use] The hooks installed; see XMLTraceHooks::Install().
+#ifdef XML_THREADS
+extern std::atomic< const XMLTraceHooks* > xmlTraceHooks;
+inline const XMLTraceHooks* XMLTraceCurrent()	{ return xmlTraceHooks.load( std::memory_order_acquire ); }
+#else
+extern const XMLTraceHooks* xmlTraceHooks;
+inline const XMLTraceHooks* XMLTraceCurrent()	{ return xmlTraceHooks; }
+#endif
+
+// The trace points. XML_TRACE_CALL( hook, args ) calls a hook if it is
+// installed; 'args' are in parentheses, and start with _trace->context.
+#	define XML_TRACE_CALL( hook, args )				do { const XMLTraceHooks* _trace = XMLTraceCurrent(); if ( _trace && _trace->hook ) _trace->hook args; } while ( 0 )
+#	define XML_TRACE_DOCUMENT_BEGIN( document, xml )	XML_TRACE_CALL( documentBegin, ( _trace->context, document, xml ) )
+#	define XML_TRACE_DOCUMENT_END( document, bytes )	XML_TRACE_CALL( documentEnd, ( _trace->context, document, bytes ) )
+#	define XML_TRACE_ELEMENT_BEGIN( element )			XML_TRACE_CALL( elementBegin, ( _trace->context, element ) )
+#	define XML_TRACE_ELEMENT_END( element )				XML_TRACE_CALL( elementEnd, ( _trace->context, element ) )
+#	define XML_TRACE_TEXT( node, length )				do { const XMLTraceHooks* _trace = XMLTraceCurrent(); if ( _trace && _trace->text && (length) >= _trace->textThreshold ) _trace->text( _trace->context, node, length ); } while ( 0 )
+#	define XML_TRACE_ERROR( document, errorId )			XML_TRACE_CALL( error, ( _trace->context, document, errorId ) )
+#	define XML_TRACE_FLUSH( bytes )						XML_TRACE_CALL( flush, ( _trace->context, bytes ) )
+#else
+#	define XML_TRACE_DOCUMENT_BEGIN( document, xml )	do {} while ( 0 )
+#	define XML_TRACE_DOCUMENT_END( document, bytes )	do {} while ( 0 )
+#	define XML_TRACE_ELEMENT_BEGIN( element )			do {} while ( 0 )
+#	define XML_TRACE_ELEMENT_END( element )				do {} while ( 0 )
+#	define XML_TRACE_TEXT( node, length )				do {} while ( 0 )
+#	define XML_TRACE_ERROR( document, errorId )			do {} while ( 0 )
+#	define XML_TRACE_FLUSH( bytes )						do {} while ( 0 )
+#endif
+
+
+/*	[internal use]
+	Buffered output for Print() and SaveFile(). Output is gathered in a
+	buffer and handed to fwrite in big blocks, rather than issuing an
+	fprintf per tag, attribute and indent. The buffer starts small, on the
+	stack, and is replaced by a large one only if the output outgrows it,
+	so printing a single node doesn't allocate.
+*/
+class XMLFileWriter
+{
+public:
+	XMLFileWriter( FILE* _file );
+	~XMLFileWriter()						{ Flush(); if ( buffer != inlineBuffer ) delete [] buffer; }
+
+	void Write( const char* data, size_t size )
+	{
+		if ( size > capacity - used )
+		{
+			Grow();
+			if ( size > capacity - used )
+			{
+				Flush();
+				if ( size > capacity )
+				{
+					Put( data, size );
+					return;
+				}
+			}
+		}
+		memcpy( buffer + used, data, size );
+		used += size;
+	}
+	void Write( const char* str )			{ Write( str, strlen( str ) ); }
+	void Write( const STRING& str )			{ Write( str.data(), str.length() ); }
+	void Write( char c )
+	{
+		if ( used == capacity )
+		{
+			Grow();
+			if ( used == capacity )
+				Flush();
+		}
+		buffer[used++] = c;
+	}
+	/// Write 'str' with entities, as XMLBase::EncodeString() does.
+	void WriteEncoded( const STRING& str );
+	/// Write the indentation used by Print() for the given depth.
+	void Indent( int depth );
+
+	void Flush();
+	/// True if a write to the file came up short (a full disk, a closed pipe...).
+	bool Failed() const						{ return failed; }
+	FILE* File() const						{ return file; }
+
+private:
+	XMLFileWriter( const XMLFileWriter& );		// not allowed.
+	void operator=( const XMLFileWriter& );	// not allowed.
+
+	// Move to the large buffer, once.
+	void Grow();
+	void Put( const char* data, size_t size );
+
+	enum { INLINE_SIZE = 512, BUFFER_SIZE = 64 * 1024 };
+
+	FILE*	file;
+	char*	buffer;
+	size_t	capacity;
+	size_t	used;
+	bool	failed;
+	char	inlineBuffer[ INLINE_SIZE ];
+};
+
+
 /**
 	Implements the interface to the "Visitor pattern" (see the Accept() method.)
 	If you call the Accept() method, it requires being passed a XMLVisitor
@@ -172,11 +518,16 @@ class XMLBase
 	friend class XMLNode;
 	friend class XMLElement;
 	friend class XMLDocument;
+	friend class XMLFileWriter;
 
 public:
 	XMLBase()	:	userData(0)		{}
 	virtual ~XMLBase()			{}
 
+	/// Nodes and attributes come from the current XMLAllocator, and go back to the one they came from.
+	static void* operator new( size_t size )				{ return XMLAllocateBlock( size ); }
+	static void operator delete( void* p, size_t size )		{ XMLFreeBlock( p, size ); }
+
 	/**	All TinyXml classes can print themselves to a filestream
 		or the string class (XMLString in non-STL mode, std::string
 		in STL mode.) Either or both cfile and str can be null.
@@ -188,6 +539,13 @@ public:
 	*/
 	virtual void Print( FILE* cfile, int depth ) const = 0;
 
+	/*	[internal use] The work behind Print( FILE*, int ): buffered, with no
+		fprintf. The library's classes all implement it; for a class that
+		doesn't, what is buffered is written out and Print( FILE*, int ) is
+		called.
+	*/
+	virtual void Print( XMLFileWriter& out, int depth ) const	{ out.Flush(); Print( out.File(), depth ); }
+
 	/**	The world does not agree on whether white space should be kept or
 		not. In order to make everyone happy, these global, static functions
 		are provided to set whether or not TinyXml will condense all white space
@@ -234,9 +592,43 @@ public:
 
 	/** Expands entities in a string. Note this should not contian the tag's '<', '>', etc, 
 		or they will be transformed into entities!
+		The encoded text is appended to 'out'.
 	*/
 	static void EncodeString( const STRING& str, STRING* out );
 
+	/** Returns the offset of the first char in 'str' that EncodeString() would
+		replace -- one of & < > " ' or a control char below 0x20 -- or 'length'
+		if there is none. Scans 16 bytes at a time where SSE2 or NEON is available.
+	*/
+	static size_t FindEncodable( const char* str, size_t length );
+
+	/** Convert the text of an attribute (or any string) to a number. These
+		read like sscanf "%d", "%u" and "%lf": leading white space is skipped,
+		and anything after the number is ignored. Unlike sscanf and atoi they
+		do not depend on the C locale, and never allocate (but for a double
+		of over 127 characters, when the locale's decimal point isn't '.').
+		Returns SUCCESS, or
+		WRONG_TYPE (and leaves 'value' untouched) if there is no number or it
+		overflows the type.
+	*/
+	static int ConvertToInt( const char* str, int* value );
+	static int ConvertToUnsigned( const char* str, unsigned* value );	///< See ConvertToInt()
+	static int ConvertToDouble( const char* str, double* value );		///< See ConvertToInt()
+	/** Convert a string to a bool. '1', 'true', or 'yes' are considered true, while
+		'0', 'false' and 'no' are considered false (ignoring case). See ConvertToInt().
+	*/
+	static int ConvertToBool( const char* str, bool* value );
+
+	/** Write a number as text into 'buffer', which must have room for at least
+		NUMBER_BUFFER_SIZE chars. The text is not null terminated; the number of
+		chars written is returned. Doubles are written with the fewest digits
+		that read back as the same value (so 0.1 is "0.1", and 1/3 keeps all
+		its precision), with printf %g style exponents for very large or very
+		small values.
+	*/
+	static size_t FormatInt( int value, char* buffer );
+	static size_t FormatDouble( double value, char* buffer );	///< See FormatInt()
+
 	enum
 	{
 		NO_ERROR = 0,
@@ -255,12 +647,22 @@ public:
 		ERROR_EMBEDDED_NULL,
 		ERROR_PARSING_CDATA,
 		ERROR_DOCUMENT_TOP_ONLY,
+		ERROR_BINARY_IMAGE,
+		ERROR_OUT_OF_MEMORY,
 
 		ERROR_STRING_COUNT
 	};
 
+	enum
+	{
+		NUMBER_BUFFER_SIZE = 32
+	};
+
 protected:
 
+	// The work behind EncodeString(), for any output with a Write( const char*, size_t ).
+	template< class OUT > static void EncodeString( const char* str, size_t length, OUT& out );
+
 	static const char* SkipWhiteSpace( const char*, XMLEncoding encoding );
 
 	inline static bool IsWhiteSpace( char c )		
@@ -400,6 +802,13 @@ class XMLNode : public XMLBase
 {
 	friend class XMLDocument;
 	friend class XMLElement;
+	friend class XMLAttribute;
+	#ifdef USE_STL
+	friend class XMLMemoryUsage;
+	#endif
+	#ifdef XML_THREADS
+	friend class XMLSnapshot;
+	#endif
 
 public:
 	#ifdef USE_STL	
@@ -481,34 +890,40 @@ public:
 		Text:		the text string
 		@endverbatim
 	*/
-	void SetValue(const char * _value) { value = _value;}
+	void SetValue(const char * _value) { value = _value; ContentChanged(); }
 
     #ifdef USE_STL
 	/// STL std::string form.
-	void SetValue( const std::string& _value )	{ value = _value; }
+	void SetValue( const std::string& _value )	{ value = _value; ContentChanged(); }
+	#ifdef XML_CXX11
+	/// Move form: the value is taken from '_value', not copied.
+	void SetValue( std::string&& _value )		{ value = std::move( _value ); ContentChanged(); }
+	#endif
 	#endif
 
 	/// Delete all the children of this node. Does not affect 'this'.
-	void Clear();
+	virtual void Clear();
 
 	/// One step up the DOM.
 	XMLNode* Parent()							{ return parent; }
 	const XMLNode* Parent() const				{ return parent; }
 
-	const XMLNode* FirstChild()	const		{ return firstChild; }	///< The first child of this node. Will be null if there are no children.
-	XMLNode* FirstChild()						{ return firstChild; }
+	const XMLNode* FirstChild()	const		{ return ChildSource()->firstChild; }	///< The first child of this node. Will be null if there are no children.
+	XMLNode* FirstChild()						{ Unshare(); return firstChild; }
 	const XMLNode* FirstChild( const char * value ) const;			///< The first child of this node with the matching 'value'. Will be null if none found.
 	/// The first child of this node with the matching 'value'. Will be null if none found.
 	XMLNode* FirstChild( const char * _value ) {
 		// Call through to the const version - safe since nothing is changed. Exiting syntax: cast this to a const (always safe)
 		// call the method, cast the return back to non-const.
+		Unshare();
 		return const_cast< XMLNode* > ((const_cast< const XMLNode* >(this))->FirstChild( _value ));
 	}
-	const XMLNode* LastChild() const	{ return lastChild; }		/// The last child of this node. Will be null if there are no children.
-	XMLNode* LastChild()	{ return lastChild; }
+	const XMLNode* LastChild() const	{ return ChildSource()->lastChild; }		/// The last child of this node. Will be null if there are no children.
+	XMLNode* LastChild()	{ Unshare(); return lastChild; }
 	
 	const XMLNode* LastChild( const char * value ) const;			/// The last child of this node matching 'value'. Will be null if there are no children.
 	XMLNode* LastChild( const char * _value ) {
+		Unshare();
 		return const_cast< XMLNode* > ((const_cast< const XMLNode* >(this))->LastChild( _value ));
 	}
 
@@ -537,12 +952,14 @@ public:
 	*/
 	const XMLNode* IterateChildren( const XMLNode* previous ) const;
 	XMLNode* IterateChildren( const XMLNode* previous ) {
+		Unshare();
 		return const_cast< XMLNode* >( (const_cast< const XMLNode* >(this))->IterateChildren( previous ) );
 	}
 
 	/// This flavor of IterateChildren searches for children with a particular 'value'
 	const XMLNode* IterateChildren( const char * value, const XMLNode* previous ) const;
 	XMLNode* IterateChildren( const char * _value, const XMLNode* previous ) {
+		Unshare();
 		return const_cast< XMLNode* >( (const_cast< const XMLNode* >(this))->IterateChildren( _value, previous ) );
 	}
 
@@ -556,6 +973,16 @@ public:
 	*/
 	XMLNode* InsertEndChild( const XMLNode& addThis );
 
+	#ifdef XML_CXX11
+	/** Move forms of InsertEndChild(): the new child takes the contents of
+		'addThis' (attributes and children included) instead of copying them,
+		and 'addThis' is left empty. A whole tree built on the stack can be
+		handed to its parent this way without a copy.
+	*/
+	XMLNode* InsertEndChild( XMLElement&& addThis );
+	XMLNode* InsertEndChild( XMLText&& addThis );
+	#endif
+
 
 	/** Add a new node related to this. Adds a child past the LastChild.
 
@@ -586,6 +1013,18 @@ public:
 	/// Delete a child of this node.
 	bool RemoveChild( XMLNode* removeThis );
 
+	/// The SourceOffset() of a node that wasn't read by the parser.
+	static const size_t NO_SOURCE = (size_t) -1;
+	/** Where the parser read this node: the offset of its first byte in the
+		text given to XMLDocument::Parse() (for LoadFile(), the file with its
+		line breaks normalized). NO_SOURCE for a node that was made or
+		copied rather than parsed, or one the text ended in the middle of.
+		See XMLDocument::ReparseEdit().
+	*/
+	size_t SourceOffset() const						{ return sourceOffset; }
+	/// The length of the text the node was read from, end tag included; 0 if it wasn't parsed.
+	size_t SourceLength() const						{ return sourceLength; }
+
 	/// Navigate to a sibling node.
 	const XMLNode* PreviousSibling() const			{ return prev; }
 	XMLNode* PreviousSibling()						{ return prev; }
@@ -639,12 +1078,14 @@ public:
 	/// Convenience function to get through elements.
 	const XMLElement* FirstChildElement()	const;
 	XMLElement* FirstChildElement() {
+		Unshare();
 		return const_cast< XMLElement* >( (const_cast< const XMLNode* >(this))->FirstChildElement() );
 	}
 
 	/// Convenience function to get through elements.
 	const XMLElement* FirstChildElement( const char * _value ) const;
 	XMLElement* FirstChildElement( const char * _value ) {
+		Unshare();
 		return const_cast< XMLElement* >( (const_cast< const XMLNode* >(this))->FirstChildElement( _value ) );
 	}
 
@@ -668,7 +1109,7 @@ public:
 	}
 
 	/// Returns true if this node has no children.
-	bool NoChildren() const						{ return !firstChild; }
+	bool NoChildren() const						{ return !ChildSource()->firstChild; }
 
 	virtual const XMLDocument*    ToDocument()    const { return 0; } ///< Cast to a more defined type. Will return null if not of the requested type.
 	virtual const XMLElement*     ToElement()     const { return 0; } ///< Cast to a more defined type. Will return null if not of the requested type.
@@ -713,12 +1154,85 @@ public:
 	*/
 	virtual bool Accept( XMLVisitor* visitor ) const = 0;
 
+	/** The fingerprint of the subtree under this node: a hash of its type,
+		value, attributes (in any order), CDATA flag or declaration fields,
+		and of the same for its children, in order. It is what the subtree
+		says, not where it is: the parent, siblings, source position and
+		user data are left out, and so is the value of a document (its file
+		name). See XMLFingerprint.
+
+		Fingerprints are kept in the nodes once computed, and every change
+		made through the API (SetValue(), SetAttribute(), LinkEndChild(),
+		RemoveChild(), and so on) forgets those of the node changed and of
+		its ancestors. Asking again for an unchanged subtree is therefore
+		O(1), however large, and after a change only the nodes on the way
+		to it are hashed again, each over its direct children. Comparing
+		two large subtrees costs their size once, then nothing until one
+		of them changes.
+
+		Several threads may call it at once on a document that none of
+		them changes. That includes a clone of a XMLSnapshot, whose shared
+		nodes are hashed in the snapshot (see XMLSnapshot::Clone()).
+	*/
+	XMLFingerprint Fingerprint() const;
+
+	/// Returns true if both subtrees have the same content: the same Fingerprint().
+	bool SameContent( const XMLNode& other ) const	{ return Fingerprint() == other.Fingerprint(); }
+
+	#ifdef XML_THREADS
+	/** Copy every node below this one that is still shared with a
+		XMLSnapshot (see XMLSnapshot::Clone()), so that none are left:
+		the const functions then read this document's own nodes, whose
+		parents are in it, and the snapshot is no longer kept alive.
+	*/
+	void UnshareAll();
+	#endif
+
 protected:
 	XMLNode( NodeType _type );
 
 	// Copy to the allocated object. Shared functionality between Clone, Copy constructor,
 	// and the assignment operator.
 	void CopyTo( XMLNode* target ) const;
+	// Give 'target', which has no children, a copy of the children of this node.
+	void CopyChildrenTo( XMLNode* target ) const;
+	// The allocator for new nodes in this one: its document's, or the current one.
+	XMLAllocator* NodeAllocator() const;
+
+	#ifdef XML_CXX11
+	// Take the value, user data, location and children of 'source', which is
+	// left without them. Shared by the move constructors and assignments.
+	void MoveFrom( XMLNode& source );
+	#endif
+
+	#ifdef XML_THREADS
+	// Children that are not copied yet: they are still those of 'source', a
+	// node of the immutable document held by 'owner'. See XMLSnapshot::Clone().
+	struct SharedChildren
+	{
+		const XMLNode*						source;
+		std::shared_ptr<const XMLDocument>	owner;
+	};
+
+	bool IsShared() const			{ return shared != 0; }
+	// The node whose children are read: the snapshot's while they are
+	// shared. Const functions read them there, and never copy.
+	const XMLNode* ChildSource() const	{ return shared ? shared->source : this; }
+	// Copy the shared children before they can be changed, or handed out
+	// as non-const. Only the children are copied; their own children stay
+	// shared one level down.
+	void Unshare()					{ if ( shared ) CopySharedChildren(); }
+	void CopySharedChildren();
+	// Make 'target' share the children of this node, which lives in 'owner'.
+	void ShareChildrenWith( XMLNode* target, const std::shared_ptr<const XMLDocument>& owner ) const;
+	// Clone(), but with the children shared instead of copied. Only elements
+	// (and the document) share; other nodes have no children to speak of.
+	virtual XMLNode* CloneShared( const std::shared_ptr<const XMLDocument>& ) const	{ return Clone(); }
+	#else
+	bool IsShared() const			{ return false; }
+	const XMLNode* ChildSource() const	{ return this; }
+	void Unshare()					{}
+	#endif
 
 	#ifdef USE_STL
 	    // The real work of the input operator.
@@ -726,7 +1240,26 @@ protected:
 	#endif
 
 	// Figure out what is at *p, and parse it. Returns null if it is not an xml node.
-	XMLNode* Identify( const char* start, XMLEncoding encoding );
+	// The node is taken from those 'document' keeps for reuse, if it isn't null.
+	XMLNode* Identify( const char* start, XMLEncoding encoding, XMLDocument* document );
+
+	// Called by everything that changes the content of the node: the
+	// fingerprints of the node and its ancestors no longer hold. A node
+	// only has one if all its children do, so the walk up stops at the
+	// first node without one.
+	void ContentChanged()			{ if ( HasFingerprint() ) ForgetFingerprints(); }
+	void ForgetFingerprints();
+	#ifdef XML_THREADS
+	bool HasFingerprint() const		{ return fingerprintHigh.load( std::memory_order_acquire ) != 0; }
+	#else
+	bool HasFingerprint() const		{ return fingerprintHigh != 0; }
+	#endif
+	XMLFingerprint LoadFingerprint() const;
+	void StoreFingerprint( const XMLFingerprint& fingerprint ) const;
+	// Take the fingerprint of 'source', a node with the same content, if it has one.
+	void CopyFingerprint( const XMLNode& source );
+	// Compute the fingerprint of this node, whose children all have theirs.
+	void ComputeFingerprint() const;
 
 	XMLNode*		parent;
 	NodeType		type;
@@ -739,6 +1272,26 @@ protected:
 	XMLNode*		prev;
 	XMLNode*		next;
 
+	// The text the node was parsed from (see SourceOffset()).
+	size_t			sourceOffset;
+	size_t			sourceLength;
+	void SetSource( size_t offset, size_t length )	{ sourceOffset = offset; sourceLength = length; }
+
+	#ifdef XML_THREADS
+	SharedChildren*	shared;
+	#endif
+
+	// The cached Fingerprint(), if 'fingerprintHigh' isn't 0 (a computed
+	// high half of 0 is kept as 1). Atomic when threads may compute it at
+	// once; each stores the same value.
+	#ifdef XML_THREADS
+	mutable std::atomic< unsigned long long >	fingerprintLow;
+	mutable std::atomic< unsigned long long >	fingerprintHigh;
+	#else
+	mutable unsigned long long	fingerprintLow;
+	mutable unsigned long long	fingerprintHigh;
+	#endif
+
 private:
 	XMLNode( const XMLNode& );				// not implemented.
 	void operator=( const XMLNode& base );	// not allowed.
@@ -755,12 +1308,17 @@ private:
 class XMLAttribute : public XMLBase
 {
 	friend class XMLAttributeSet;
+	friend class XMLDocument;
+	#ifdef USE_STL
+	friend class XMLMemoryUsage;
+	#endif
 
 public:
 	/// Construct an empty attribute.
 	XMLAttribute() : XMLBase()
 	{
 		document = 0;
+		owner = 0;
 		prev = next = 0;
 	}
 
@@ -771,6 +1329,18 @@ public:
 		name = _name;
 		value = _value;
 		document = 0;
+		owner = 0;
+		prev = next = 0;
+	}
+	#endif
+
+	#if defined( USE_STL ) && defined( XML_CXX11 )
+	/// Move form of the std::string constructor: the strings are taken, not copied.
+	XMLAttribute( std::string&& _name, std::string&& _value )
+		: name( std::move( _name ) ), value( std::move( _value ) )
+	{
+		document = 0;
+		owner = 0;
 		prev = next = 0;
 	}
 	#endif
@@ -781,6 +1351,7 @@ public:
 		name = _name;
 		value = _value;
 		document = 0;
+		owner = 0;
 		prev = next = 0;
 	}
 
@@ -794,6 +1365,8 @@ public:
 
 	// Get the tinyxml string representation
 	const STRING& NameTStr() const { return name; }
+	// Get the tinyxml string representation of the value.
+	const STRING& ValueTStr() const { return value; }
 
 	/** QueryIntValue examines the value string. It is an alternative to the
 		IntValue() method with richer error checking.
@@ -808,17 +1381,23 @@ public:
 	/// QueryDoubleValue examines the value string. See QueryIntValue().
 	int QueryDoubleValue( double* _value ) const;
 
-	void SetName( const char* _name )	{ name = _name; }				///< Set the name of this attribute.
-	void SetValue( const char* _value )	{ value = _value; }				///< Set the value.
+	void SetName( const char* _name )	{ name = _name; ContentChanged(); }		///< Set the name of this attribute.
+	void SetValue( const char* _value )	{ value = _value; ContentChanged(); }	///< Set the value.
 
 	void SetIntValue( int _value );										///< Set the value from an integer.
 	void SetDoubleValue( double _value );								///< Set the value from a double.
 
     #ifdef USE_STL
 	/// STL std::string form.
-	void SetName( const std::string& _name )	{ name = _name; }	
+	void SetName( const std::string& _name )	{ name = _name; ContentChanged(); }
 	/// STL std::string form.	
-	void SetValue( const std::string& _value )	{ value = _value; }
+	void SetValue( const std::string& _value )	{ value = _value; ContentChanged(); }
+	#ifdef XML_CXX11
+	/// Move form: the name is taken from '_name', not copied.
+	void SetName( std::string&& _name )			{ name = std::move( _name ); ContentChanged(); }
+	/// Move form: the value is taken from '_value', not copied.
+	void SetValue( std::string&& _value )		{ value = std::move( _value ); ContentChanged(); }
+	#endif
 	#endif
 
 	/// Get the next sibling attribute in the DOM. Returns null at end.
@@ -847,6 +1426,7 @@ public:
 		Print( cfile, depth, 0 );
 	}
 	void Print( FILE* cfile, int depth, STRING* str ) const;
+	virtual void Print( XMLFileWriter& out, int depth ) const;
 
 	// [internal use]
 	// Set the document pointer so the attribute can report errors.
@@ -856,7 +1436,11 @@ private:
 	XMLAttribute( const XMLAttribute& );				// not implemented.
 	void operator=( const XMLAttribute& base );	// not allowed.
 
+	// The element's fingerprint no longer holds once an attribute changes.
+	void ContentChanged()		{ if ( owner ) owner->ContentChanged(); }
+
 	XMLDocument*	document;	// A pointer back to a document, for error reporting.
+	XMLNode*		owner;		// The element whose set holds the attribute, if any.
 	STRING name;
 	STRING value;
 	XMLAttribute*	prev;
@@ -898,6 +1482,13 @@ public:
 	XMLAttribute* FindOrCreate( const std::string& _name );
 #	endif
 
+#	ifdef XML_CXX11
+	// Take all the attributes of 'other', which is left empty. This set must be empty.
+	void MoveFrom( XMLAttributeSet& other );
+#	endif
+
+	// The element the set belongs to, told when its attributes change.
+	void SetOwner( XMLNode* owner )		{ sentinel.owner = owner; }
 
 private:
 	//*ME:	Because of hidden/disabled copy-construktor in XMLAttribute (sentinel-element),
@@ -915,6 +1506,8 @@ private:
 */
 class XMLElement : public XMLNode
 {
+	friend class XMLDocument;
+
 public:
 	/// Construct an element.
 	XMLElement (const char * in_value);
@@ -928,6 +1521,16 @@ public:
 
 	XMLElement& operator=( const XMLElement& base );
 
+	#ifdef XML_CXX11
+	/** Move constructor: takes the name, attributes and children of 'other'
+		without copying them. 'other' is left empty, but stays where it was
+		in its document.
+	*/
+	XMLElement( XMLElement&& other );
+	/// Move assignment; see the move constructor.
+	XMLElement& operator=( XMLElement&& other );
+	#endif
+
 	virtual ~XMLElement();
 
 	/** Given an attribute name, Attribute() returns the value
@@ -995,6 +1598,9 @@ public:
 		
 		NOTE: This method doesn't work correctly for 'string' types that contain spaces.
 
+		int, unsigned, double, float and bool are converted directly (see
+		XMLBase::ConvertToInt()); other types go through a std::stringstream.
+
 		@return SUCCESS, WRONG_TYPE, or NO_ATTRIBUTE
 	*/
 	template< typename T > int QueryValueAttribute( const std::string& name, T* outValue ) const
@@ -1002,12 +1608,7 @@ public:
 		const XMLAttribute* node = attributeSet.Find( name );
 		if ( !node )
 			return NO_ATTRIBUTE;
-
-		std::stringstream sstream( node->ValueStr() );
-		sstream >> *outValue;
-		if ( !sstream.fail() )
-			return SUCCESS;
-		return WRONG_TYPE;
+		return ConvertValue( node->ValueStr(), outValue );
 	}
 
 	int QueryValueAttribute( const std::string& name, std::string* outValue ) const
@@ -1034,6 +1635,10 @@ public:
 
 	/// STL std::string form.
 	void SetAttribute( const std::string& name, const std::string& _value );
+	#ifdef XML_CXX11
+	/// Move form: the value is taken from '_value', not copied.
+	void SetAttribute( const std::string& name, std::string&& _value );
+	#endif
 	///< STL std::string form.
 	void SetAttribute( const std::string& name, int _value );
 	///< STL std::string form.
@@ -1099,7 +1704,8 @@ public:
 	/// Creates a new Element and returns it - the returned element is a copy.
 	virtual XMLNode* Clone() const;
 	// Print the Element to a FILE stream.
-	virtual void Print( FILE* cfile, int depth ) const;
+	virtual void Print( FILE* cfile, int depth ) const	{ XMLFileWriter out( cfile ); Print( out, depth ); }
+	virtual void Print( XMLFileWriter& out, int depth ) const;
 
 	/*	Attribtue parsing starts: next char past '<'
 						 returns: next char past '>'
@@ -1116,8 +1722,38 @@ public:
 protected:
 
 	void CopyTo( XMLElement* target ) const;
+	void CopyAttributesTo( XMLElement* target ) const;
 	void ClearThis();	// like clear, but initializes 'this' object as well
 
+	#ifdef XML_THREADS
+	virtual XMLNode* CloneShared( const std::shared_ptr<const XMLDocument>& owner ) const;
+	#endif
+
+	#ifdef USE_STL
+	// Conversions behind QueryValueAttribute(). The overloads are picked over
+	// the template, so the common types never construct a stream.
+	static int ConvertValue( const std::string& str, int* outValue )		{ return ConvertToInt( str.c_str(), outValue ); }
+	static int ConvertValue( const std::string& str, unsigned* outValue )	{ return ConvertToUnsigned( str.c_str(), outValue ); }
+	static int ConvertValue( const std::string& str, double* outValue )		{ return ConvertToDouble( str.c_str(), outValue ); }
+	static int ConvertValue( const std::string& str, bool* outValue )		{ return ConvertToBool( str.c_str(), outValue ); }
+	static int ConvertValue( const std::string& str, float* outValue )
+	{
+		double d;
+		int result = ConvertToDouble( str.c_str(), &d );
+		if ( result == SUCCESS )
+			*outValue = (float)d;
+		return result;
+	}
+	template< typename T > static int ConvertValue( const std::string& str, T* outValue )
+	{
+		std::stringstream sstream( str );
+		sstream >> *outValue;
+		if ( !sstream.fail() )
+			return SUCCESS;
+		return WRONG_TYPE;
+	}
+	#endif
+
 	// Used to be public [internal use]
 	#ifdef USE_STL
 	virtual void StreamIn( std::istream * in, STRING * tag );
@@ -1127,6 +1763,12 @@ protected:
 		This should terminate with the current end tag.
 	*/
 	const char* ReadValue( const char* in, XMLParsingData* prevData, XMLEncoding encoding );
+	/*	[internal use]
+		The start tag and the end tag, read by Parse() around the value.
+		'empty' is set for a start tag that also ends the element.
+	*/
+	const char* ParseStartTag( const char* p, XMLParsingData* data, XMLEncoding encoding, bool* empty );
+	const char* ParseEndTag( const char* p, XMLParsingData* data, XMLEncoding encoding );
 
 private:
 	XMLAttributeSet attributeSet;
@@ -1152,7 +1794,8 @@ public:
 	/// Returns a copy of this Comment.
 	virtual XMLNode* Clone() const;
 	// Write this Comment to a FILE stream.
-	virtual void Print( FILE* cfile, int depth ) const;
+	virtual void Print( FILE* cfile, int depth ) const	{ XMLFileWriter out( cfile ); Print( out, depth ); }
+	virtual void Print( XMLFileWriter& out, int depth ) const;
 
 	/*	Attribtue parsing starts: at the ! of the !--
 						 returns: next char past '>'
@@ -1188,6 +1831,7 @@ private:
 class XMLText : public XMLNode
 {
 	friend class XMLElement;
+	friend class XMLDocument;
 public:
 	/** Constructor for text element. By default, it is treated as 
 		normal, encoded text. If you want it be output as a CDATA text
@@ -1212,13 +1856,21 @@ public:
 	XMLText( const XMLText& copy ) : XMLNode( XMLNode::TINYXML_TEXT )	{ copy.CopyTo( this ); }
 	XMLText& operator=( const XMLText& base )							 	{ base.CopyTo( this ); return *this; }
 
+	#ifdef XML_CXX11
+	/// Move constructor: takes the text of 'other', which is left empty.
+	XMLText( XMLText&& other ) : XMLNode( XMLNode::TINYXML_TEXT )		{ MoveFrom( other ); cdata = other.cdata; }
+	/// Move assignment; see the move constructor.
+	XMLText& operator=( XMLText&& other )								{ if ( &other != this ) { MoveFrom( other ); cdata = other.cdata; } return *this; }
+	#endif
+
 	// Write this text object to a FILE stream.
-	virtual void Print( FILE* cfile, int depth ) const;
+	virtual void Print( FILE* cfile, int depth ) const	{ XMLFileWriter out( cfile ); Print( out, depth ); }
+	virtual void Print( XMLFileWriter& out, int depth ) const;
 
 	/// Queries whether this represents text using a CDATA section.
 	bool CDATA() const				{ return cdata; }
 	/// Turns on or off a CDATA representation of text.
-	void SetCDATA( bool _cdata )	{ cdata = _cdata; }
+	void SetCDATA( bool _cdata )	{ cdata = _cdata; ContentChanged(); }
 
 	virtual const char* Parse( const char* p, XMLParsingData* data, XMLEncoding encoding );
 
@@ -1260,6 +1912,10 @@ private:
 */
 class XMLDeclaration : public XMLNode
 {
+	#ifdef USE_STL
+	friend class XMLMemoryUsage;
+	#endif
+
 public:
 	/// Construct an empty declaration.
 	XMLDeclaration()   : XMLNode( XMLNode::TINYXML_DECLARATION ) {}
@@ -1295,6 +1951,7 @@ public:
 	virtual void Print( FILE* cfile, int depth ) const {
 		Print( cfile, depth, 0 );
 	}
+	virtual void Print( XMLFileWriter& out, int depth ) const;
 
 	virtual const char* Parse( const char* p, XMLParsingData* data, XMLEncoding encoding );
 
@@ -1339,7 +1996,8 @@ public:
 	/// Creates a copy of this Unknown and returns it.
 	virtual XMLNode* Clone() const;
 	// Print this Unknown to a FILE stream.
-	virtual void Print( FILE* cfile, int depth ) const;
+	virtual void Print( FILE* cfile, int depth ) const	{ XMLFileWriter out( cfile ); Print( out, depth ); }
+	virtual void Print( XMLFileWriter& out, int depth ) const;
 
 	virtual const char* Parse( const char* p, XMLParsingData* data, XMLEncoding encoding );
 
@@ -1362,6 +2020,124 @@ private:
 };
 
 
+/** Statistics of the last load of a XMLDocument: what was parsed, and where
+	the time went. They are collected only by a library built with XML_STATS
+	defined, for documents that have XMLDocument::SetCollectStats() on;
+	without XML_STATS the collection isn't compiled at all, and every count
+	stays zero (see Enabled()).
+
+	@verbatim
+	XMLDocument doc;
+	doc.SetCollectStats( true );
+	doc.LoadFile( "big.xml" );
+	const XMLParseStats& stats = doc.Stats();
+	for( int i=0; i<XMLParseStats::KeyCount(); ++i )
+		metrics.Record( XMLParseStats::Key( i ), stats.Value( i ) );
+	@endverbatim
+
+	Allocations count the nodes, attributes and read buffers that the
+	document allocated rather than reused (see XMLDocument::SetReuseMemory());
+	the buffers of the strings inside them are not counted.
+*/
+class XMLParseStats
+{
+public:
+	XMLParseStats()							{ Clear(); }
+
+	/// True if the library was built with XML_STATS, and collects statistics.
+	static bool Enabled();
+
+	/// Set every count and time back to zero.
+	void Clear();
+
+	size_t	nodes[ XMLNode::TINYXML_TYPECOUNT ];	///< Nodes parsed, by XMLNode::NodeType.
+	size_t	attributes;			///< Attributes parsed.
+	size_t	bytes;				///< Bytes of xml text consumed by the parser.
+	size_t	entities;			///< Entity and character references decoded.
+	size_t	allocations;		///< Nodes, attributes and buffers allocated.
+	size_t	allocatedBytes;		///< The size of those allocations.
+	int		maxDepth;			///< The deepest element nesting; the root element is at depth 1.
+	double	readSeconds;		///< Time reading the file, in LoadFile(); in LoadFileAsync(), the time the parse waited for the reads.
+	double	normalizeSeconds;	///< Time normalizing line breaks (LoadFile() and LoadFileAsync() only).
+	double	parseSeconds;		///< Time parsing the text into nodes; for LoadFileAsync(), the two above are part of it.
+	double	teardownSeconds;	///< Time deleting nodes: the old contents in LoadFile(), and any Clear() since.
+
+	/// The number of nodes, of all types.
+	size_t NodeCount() const;
+
+	/// The number of key-value pairs the statistics export as.
+	static int KeyCount();
+	/// The key of pair 'i', such as "nodes.element" or "time.parse_s".
+	static const char* Key( int i );
+	/// The value of pair 'i'.
+	double Value( int i ) const;
+	/// Every pair, as "key=value" lines. Each key is preceded by 'prefix'.
+	STRING ToString( const char* prefix = "" ) const;
+
+	// [internal use] The element nesting while parsing.
+	int depth;
+};
+
+
+#ifdef XML_STATS
+/*	[internal use] The statistics being collected by the parse running on
+	this thread, or null. XMLDocument sets them while it loads or parses.
+*/
+XMLParseStats* XMLStatsCurrent();
+
+// [internal use] Sets the statistics being collected, for a scope.
+class XMLStatsScope
+{
+public:
+	XMLStatsScope( XMLParseStats* stats );
+	~XMLStatsScope();
+private:
+	XMLParseStats* previous;
+};
+
+// [internal use] Adds the time spent in its scope to a time of XMLParseStats, unless null.
+class XMLStatsTimer
+{
+public:
+	XMLStatsTimer( double* _seconds ) : seconds( _seconds ), start( _seconds ? Now() : 0 ) {}
+	~XMLStatsTimer()						{ if ( seconds ) *seconds += Now() - start; }
+	static double Now();
+private:
+	double* seconds;
+	double start;
+};
+
+// [internal use] Counts one more level of element nesting, for its scope.
+class XMLStatsDepth
+{
+public:
+	XMLStatsDepth() : stats( XMLStatsCurrent() )
+	{
+		if ( stats && ++stats->depth > stats->maxDepth )
+			stats->maxDepth = stats->depth;
+	}
+	~XMLStatsDepth()						{ if ( stats ) --stats->depth; }
+private:
+	XMLParseStats* stats;
+};
+
+// Probes for the parser. XML_STAT( field op ) updates a field of the
+// statistics being collected, if any; XML_STAT_TIMER() times the rest of
+// its scope into a field, and XML_STAT_DEPTH() counts a level of nesting.
+// XML_STAT_CLOCK( name ) reads the clock into 'name', for
+// XML_STAT( field += XMLStatsTimer::Now() - name ).
+#	define XML_STAT( expr )					do { if ( XMLParseStats* _stats = XMLStatsCurrent() ) _stats->expr; } while ( 0 )
+#	define XML_STAT_TIMER( name, field )	XMLStatsTimer name( XMLStatsCurrent() ? &XMLStatsCurrent()->field : 0 )
+#	define XML_STAT_DEPTH( name )			XMLStatsDepth name
+#	define XML_STAT_CLOCK( name )			double name = XMLStatsCurrent() ? XMLStatsTimer::Now() : 0
+#else
+#	define XML_STAT( expr )					do {} while ( 0 )
+#	define XML_STAT_TIMER( name, field )	do {} while ( 0 )
+#	define XML_STAT_DEPTH( name )			do {} while ( 0 )
+#	define XML_STAT_CLOCK( name )			do {} while ( 0 )
+#endif
+
+
 /** Always the top level node. A document binds together all the
 	XML pieces. It can be saved, loaded, and printed to the screen.
 	The 'value' of a document node is the xml file name.
@@ -1382,7 +2158,77 @@ public:
 	XMLDocument( const XMLDocument& copy );
 	XMLDocument& operator=( const XMLDocument& copy );
 
-	virtual ~XMLDocument() {}
+	#ifdef XML_CXX11
+	/** Move constructor: takes the whole tree, and the error state, of
+		'other', which is left as an empty document.
+	*/
+	XMLDocument( XMLDocument&& other );
+	/// Move assignment; see the move constructor.
+	XMLDocument& operator=( XMLDocument&& other );
+	#endif
+
+	virtual ~XMLDocument();
+
+	/** Delete all the children of the document. With SetReuseMemory() on,
+		they are kept for the next Parse() or LoadFile() instead.
+	*/
+	virtual void Clear();
+
+	/** Keep the document's memory for reuse, for code that parses one
+		message after another into the same document. With this on, Clear()
+		(and LoadFile(), which clears first) keeps the nodes and attributes
+		of the document, and the capacity of their strings; Parse() and
+		LoadFile() take their nodes from those kept, and LoadFile() keeps
+		its read buffer. Once the document has seen messages of the largest
+		size, parsing similar ones does no heap allocation at all.
+
+		@verbatim
+		XMLDocument doc;
+		doc.SetReuseMemory( true );
+		while ( ReadRequest( &request ) )
+		{
+			doc.Clear();
+			doc.Parse( request.c_str() );
+			...
+		}
+		@endverbatim
+
+		Only the document's own Clear() keeps nodes; nodes removed or
+		cleared one at a time are deleted as usual. Turning reuse off frees
+		what is kept. It is off by default.
+	*/
+	void SetReuseMemory( bool reuse );
+	/// True if the document keeps its memory for reuse. See SetReuseMemory().
+	bool ReusesMemory() const				{ return reuseMemory; }
+	/// Free the nodes, attributes and buffers kept for reuse. See SetReuseMemory().
+	void ReleaseMemory();
+
+	/** Collect XMLParseStats for each LoadFile() and Parse() from now on;
+		see Stats(). Each load starts them from zero. This has no effect
+		unless the library is built with XML_STATS (see XMLParseStats::Enabled()).
+		It is off by default.
+	*/
+	void SetCollectStats( bool collect )	{ collectStats = collect; }
+	/// True if statistics are collected. See SetCollectStats().
+	bool CollectsStats() const				{ return collectStats; }
+	/// The statistics of the last LoadFile() or Parse(). See SetCollectStats().
+	const XMLParseStats& Stats() const		{ return stats; }
+
+	/** Allocate the document's memory from 'allocator' from now on: the
+		nodes and attributes made by LoadFile(), Parse(), LoadBinary() and
+		CopyTo(), the ones inserted in it by copy, or made by SetAttribute(),
+		and the read buffer of LoadFile(). Without the STL, the text of their
+		strings comes from it too; with the STL, std::string allocates its own.
+		Null, the default, is operator new.
+
+		Every block goes back to the allocator it came from, even once it is
+		moved to another document, so the allocator must outlive them all.
+		Changing the allocator frees the memory kept for reuse (see
+		ReleaseMemory()).
+	*/
+	void SetAllocator( XMLAllocator* allocator );
+	/// The allocator of the document; null for operator new. See SetAllocator().
+	XMLAllocator* Allocator() const			{ return allocator; }
 
 	/** Load a file using the current document value.
 		Returns true if successful. Will delete any existing
@@ -1404,6 +2250,40 @@ public:
 	/// Save a file using the given FILE*. Returns true if successful.
 	bool SaveFile( FILE* ) const;
 
+	#ifdef XML_THREADS
+	/** LoadFile(), without waiting for it: the file is read and parsed by
+		a task on 'executor' (XMLExecutor::Default() if null), and the
+		returned future gets LoadFile()'s result. Until then the document
+		must not be used, nor deleted; errors are reported by the document
+		as for LoadFile(), and so is an exception thrown by the load:
+		std::bad_alloc as ERROR_OUT_OF_MEMORY, anything else as ERROR.
+
+		@verbatim
+		XMLDocument doc;
+		std::future< bool > loading = doc.LoadFileAsync( "big.xml" );
+		...		// other work
+		if ( !loading.get() )
+			printf( "%s\n", doc.ErrorDesc() );
+		@endverbatim
+
+		A file of more than one block (512 KB) is parsed while it is read:
+		a thread of the load's own reads it into two blocks in turn, and
+		the parse takes each block as soon as it is in, so that it waits
+		for the disk only when it gets ahead of it. A node is parsed once
+		its text is in, and an element a part at a time, so that a node is
+		parsed again only if its text looked whole and wasn't, as when it
+		has a '>' in an attribute value.
+		Only available in STL mode, with a C++11 compiler.
+	*/
+	std::future< bool > LoadFileAsync( const char* filename, XMLEncoding encoding = DEFAULT_ENCODING, XMLExecutor* executor = 0 );
+	/** LoadFileAsync(), calling 'done' with the document and the result of
+		LoadFile() when it is over, on the thread that loaded it. 'done'
+		must not throw.
+	*/
+	void LoadFileAsync( const char* filename, std::function< void( XMLDocument* document, bool loaded ) > done,
+						XMLEncoding encoding = DEFAULT_ENCODING, XMLExecutor* executor = 0 );
+	#endif
+
 	#ifdef USE_STL
 	bool LoadFile( const std::string& filename, XMLEncoding encoding = DEFAULT_ENCODING )			///< STL std::string version.
 	{
@@ -1415,12 +2295,62 @@ public:
 	}
 	#endif
 
+	#ifdef USE_STL
+	/** Save the document as a flat binary image (see XMLBinaryImage), which
+		LoadBinary() or XMLBinaryImage::Open() read back without parsing.
+		Returns true if successful. Only available in STL mode.
+	*/
+	bool SaveBinary( const char* filename ) const;
+	/// Save a binary image to the given FILE*, which should be opened in binary mode.
+	bool SaveBinary( FILE* ) const;
+	/** Load a binary image written by SaveBinary(). The document is rebuilt
+		from the image's tables, including the document name, tab size, and
+		the row and column of every node. Returns true if successful.
+	*/
+	bool LoadBinary( const char* filename );
+	/// Rebuild the document from an open XMLBinaryImage.
+	bool LoadBinary( const XMLBinaryImage& image );
+
+	/** Report the memory the document holds, by element name; see
+		XMLMemoryUsage. It walks the whole tree, and reads but never changes
+		it. Only available in STL mode.
+	*/
+	XMLMemoryUsage MemoryUsage() const;
+	#endif
+
 	/** Parse the given null terminated block of xml data. Passing in an encoding to this
 		method (either ENCODING_LEGACY or ENCODING_UTF8 will force TinyXml
 		to use that encoding, regardless of what TinyXml might otherwise try to detect.
 	*/
 	virtual const char* Parse( const char* p, XMLParsingData* data = 0, XMLEncoding encoding = DEFAULT_ENCODING );
 
+	/** Apply an edit to the text the document was parsed from, and parse
+		again only what it changes. 'source' must be that text, as given to
+		the last Parse() or ReparseEdit(), with the document unchanged since:
+		'removed' bytes at 'offset' are replaced with 'insertLength' bytes
+		of 'insert', in 'source' itself.
+
+		The smallest element that holds the edit, tags included, is parsed
+		again from the new text, and the new element replaces the old one;
+		if the edit doesn't leave it a well formed element of the same
+		extent, its parent is tried, and so on up to the whole document.
+		The source offsets, rows and columns of the nodes that follow move
+		with the edit. Pointers to the replaced element and its descendants
+		are no longer valid, so look the nodes up again afterwards.
+
+		Returns true if the document is well formed after the edit; if not,
+		see Error(). Returns false, and changes nothing, if the edit is not
+		within 'source'.
+
+		@verbatim
+		XMLDocument doc;
+		doc.Parse( text.c_str() );
+		...
+		doc.ReparseEdit( &text, offset, 3, "new", 3 );
+		@endverbatim
+	*/
+	bool ReparseEdit( STRING* source, size_t offset, size_t removed, const char* insert, size_t insertLength );
+
 	/** Get the root element -- the only top level element -- of the document.
 		In well formed XML, there should only be one. TinyXml is tolerant of
 		multiple elements at the document level.
@@ -1501,9 +2431,16 @@ public:
 	//char* PrintToMemory() const; 
 
 	/// Print this Document to a FILE stream.
-	virtual void Print( FILE* cfile, int depth = 0 ) const;
+	virtual void Print( FILE* cfile, int depth = 0 ) const	{ XMLFileWriter out( cfile ); Print( out, depth ); }
+	virtual void Print( XMLFileWriter& out, int depth ) const;
 	// [internal use]
 	void SetError( int err, const char* errorLocation, XMLParsingData* prevData, XMLEncoding encoding );
+	// [internal use] Make a node or attribute for the parser, reusing a kept one if there is one.
+	XMLNode* NewNode( NodeType type );
+	XMLAttribute* NewAttribute();
+	// [internal use] Delete a node (and its children) or attribute, or keep it for reuse.
+	void DeleteNode( XMLNode* node );
+	void DeleteAttribute( XMLAttribute* attribute );
 
 	virtual const XMLDocument*    ToDocument()    const { return this; } ///< Cast to a more defined type. Will return null not of the requested type.
 	virtual XMLDocument*          ToDocument()          { return this; } ///< Cast to a more defined type. Will return null not of the requested type.
@@ -1518,9 +2455,87 @@ protected :
 	#ifdef USE_STL
 	virtual void StreamIn( std::istream * in, STRING * tag );
 	#endif
+	#ifdef XML_THREADS
+	virtual XMLNode* CloneShared( const std::shared_ptr<const XMLDocument>& owner ) const;
+	#endif
 
 private:
+	#ifdef USE_STL
+	friend class XMLBinaryImage;
+	friend class XMLMemoryUsage;
+	#endif
+	#ifdef XML_THREADS
+	friend class XMLSnapshot;
+	#endif
+
 	void CopyTo( XMLDocument* target ) const;
+	// For ReparseEdit(): parse 'element' again from 'text', with 'data' at
+	// its start. Returns the new element, or null if the text there isn't
+	// an element of 'length' bytes.
+	XMLElement* ReparseElement( const XMLElement* element, const char* text, size_t length, XMLParsingData* data );
+	// For ReparseEdit(): move the nodes after 'node' in document order by
+	// 'shift' bytes, and adjust the rows and columns of those on the same
+	// line as the end of 'node'.
+	void ShiftFollowing( XMLNode* node, size_t shift, const XMLCursor& oldEnd, XMLParsingData* newEnd );
+	// Everything CopyTo() copies but the children.
+	void CopyStateTo( XMLDocument* target ) const;
+	#ifdef XML_CXX11
+	// MoveFrom() for the document: the tree and the error state.
+	void MoveDocumentFrom( XMLDocument& other );
+	#endif
+	// Set up the memory kept for reuse, as empty, with the default
+	// allocator and statistics off.
+	void InitMemory();
+
+	// LoadFile() reads and normalizes a file in blocks of this size: large
+	// reads, but small enough that a block is still cached when normalized.
+	static const size_t LOAD_BLOCK_SIZE = 512 * 1024;
+	// A buffer of 'size' bytes for a file: the one kept for reuse if the
+	// document reuses memory, else a new one; and give it back.
+	char* TakeReadBuffer( size_t size );
+	void GiveReadBuffer( char* buf, size_t size );
+	// Copy 'size' bytes from 'p' to 'q', which may be the same or before,
+	// with each CR and CR+LF made a LF; 'pendingCR' carries a CR at the end
+	// of one block over to the next. Returns the new end at 'q'.
+	static char* NormalizeNewLines( char* q, const char* p, size_t size, bool* pendingCR );
+
+	// Text that comes in while it is parsed: More() appends to it, in place
+	// and null terminated, at least as much as there is from 'from' on, or
+	// returns false once the whole text is in.
+	class Feed
+	{
+	public:
+		virtual bool More( const char* from ) = 0;
+	protected:
+		~Feed() {}
+	};
+	// Parse(), of a text that comes in from 'feed' if not null. Each node
+	// is parsed when its text is in, and an element a part at a time: its
+	// start tag, its children, and its end tag.
+	const char* ParseDocument( const char* p, XMLParsingData* prevData, XMLEncoding encoding, Feed* feed );
+	// Get more from 'feed' until the text at 'p' has 'n' bytes, or holds
+	// 'end'; or until the whole text is in.
+	static void FeedAhead( const char* p, size_t n, Feed* feed );
+	static void FeedUntil( const char* p, const char* end, Feed* feed );
+	// SkipWhiteSpace(), getting more of the text while it runs out.
+	static const char* SkipFed( const char* p, XMLEncoding encoding, Feed* feed );
+	// Parse the node at 'p', a '<', and add it to 'parent'; and the value
+	// of 'element', up to its end tag. Return the end, or null on an error.
+	const char* ParseFedNode( XMLNode* parent, const char* p, XMLParsingData* data, XMLEncoding encoding, Feed* feed );
+	const char* ParseFedElement( XMLNode* parent, XMLElement* element, const char* p, XMLParsingData* data, XMLEncoding encoding, Feed* feed );
+	const char* ParseFedValue( XMLElement* element, const char* p, XMLParsingData* data, XMLEncoding encoding, Feed* feed );
+	// Undo the parse of 'node', which stopped short of its end, back to 'start'.
+	void Unparse( XMLNode* node, XMLParsingData* data, const XMLParsingData& start );
+
+	#ifdef XML_THREADS
+	// LoadFile(), for LoadFileAsync(): the file is parsed while a thread
+	// reads it (see FileFeed in xmlasync.cpp).
+	class FileFeed;
+	bool LoadFileOverlapped( FILE* file, XMLEncoding encoding );
+	// The task of LoadFileAsync(): LoadFileOverlapped() of 'filename',
+	// with what it throws reported as an error of the document.
+	bool LoadFileTask( const char* filename, XMLEncoding encoding );
+	#endif
 
 	bool error;
 	int  errorId;
@@ -1528,6 +2543,26 @@ private:
 	int tabsize;
 	XMLCursor errorLocation;
 	bool useMicrosoftBOM;		// the UTF-8 BOM were found when read. Note this, and try to write.
+
+	// Memory kept for reuse (see SetReuseMemory()): free nodes by type, and
+	// free attributes, each linked through 'next'; and LoadFile()'s buffer.
+	bool reuseMemory;
+	XMLNode* freeNodes[ TINYXML_TYPECOUNT ];
+	XMLAttribute* freeAttributes;
+	char* readBuffer;
+	size_t readBufferSize;
+
+	// Where the memory comes from (see SetAllocator()).
+	XMLAllocator* allocator;
+
+	// The encoding of the last Parse(), for ReparseEdit(): as given to it,
+	// and as detected by it (ENCODING_UNKNOWN until a parse succeeds).
+	XMLEncoding givenEncoding;
+	XMLEncoding parseEncoding;
+
+	// Statistics of the last load (see SetCollectStats()).
+	bool collectStats;
+	XMLParseStats stats;
 };
 
 
@@ -1757,7 +2792,12 @@ public:
 	const std::string& Str()						{ return buffer; }
 	#endif
 
-private:
+protected:
+	/*	Called each time a Visit method has appended to the buffer. Printers
+		that send the output somewhere else can drain the buffer here.
+	*/
+	virtual void Printed()	{}
+
 	void DoIndent()	{
 		for( int i=0; i<depth; ++i )
 			buffer += indent;
@@ -1774,6 +2814,208 @@ private:
 };
 
 
+/// Callback used by XMLStreamPrinter. Returns the number of bytes written; anything less than 'size' is an error.
+typedef size_t (*XMLWriteCallback)( const char* data, size_t size, void* userData );
+
+/** A XMLPrinter that doesn't keep the document in memory. The output is
+	staged in a buffer of fixed size, which is written to a FILE*, a file
+	descriptor, or a callback whenever it fills up, so memory use stays
+	constant however large the document is. (A single text or attribute
+	value larger than the buffer is still held in full while it is printed.)
+
+	The formatting options -- SetIndent(), SetLineBreak(), SetStreamPrinting() --
+	work exactly as for XMLPrinter, and the output is byte for byte the same.
+
+	@verbatim
+	FILE* fp = fopen( "big.xml", "wb" );
+	XMLStreamPrinter printer( fp );
+	doc.Accept( &printer );
+	printer.Flush();
+	@endverbatim
+
+	Everything is flushed when a top level node is complete, and by the
+	destructor. CStr() and Size() only reflect the output not yet written.
+*/
+class XMLStreamPrinter : public XMLPrinter
+{
+public:
+	enum { DEFAULT_BUFFER_SIZE = 64 * 1024 };
+
+	/// Print to a FILE*. The file is not closed.
+	XMLStreamPrinter( FILE* file, size_t bufferSize = DEFAULT_BUFFER_SIZE );
+	/// Print to a file descriptor, with write(). The descriptor is not closed.
+	XMLStreamPrinter( int fd, size_t bufferSize = DEFAULT_BUFFER_SIZE );
+	/// Print through a callback.
+	XMLStreamPrinter( XMLWriteCallback callback, void* userData, size_t bufferSize = DEFAULT_BUFFER_SIZE );
+
+	virtual ~XMLStreamPrinter()						{ Flush(); }
+
+	/// Write out everything printed so far. Returns false if any write has failed.
+	bool Flush();
+
+	/// Returns true if a write has failed. Once set, no more output is written.
+	bool Error() const								{ return error; }
+	/// The number of bytes successfully written so far.
+	size_t BytesWritten() const						{ return bytesWritten; }
+
+protected:
+	virtual void Printed();
+
+private:
+	XMLStreamPrinter( const XMLStreamPrinter& );		// not allowed.
+	void operator=( const XMLStreamPrinter& );		// not allowed.
+
+	void Init( size_t bufferSize );
+	bool Write( const char* data, size_t size );
+
+	FILE*				file;
+	int					fd;
+	XMLWriteCallback	callback;
+	void*				userData;
+	size_t				bufferSize;
+	size_t				bytesWritten;
+	bool				error;
+};
+
+
+/** A visitor that writes the canonical form of a document (Canonical XML
+	1.0, http://www.w3.org/TR/xml-c14n), the form to hash or sign: two
+	documents that mean the same have the same canonical form, byte for
+	byte, however they were written. In it:
+
+	- there is no XML declaration and no DTD, and comments only with SetWithComments();
+	- elements are never written empty: <a/> becomes <a></a>;
+	- attributes are sorted, namespace declarations first, and superfluous
+	  namespace declarations are left out;
+	- attribute values are in double quotes, and characters are escaped the
+	  one way the standard gives; CDATA sections become escaped text;
+	- there is no whitespace but that of the text nodes, and a line break
+	  between the top level nodes.
+
+	The parser never keeps text that is only whitespace, and condenses the
+	rest unless told not to (see XMLBase::SetCondenseWhiteSpace()): the
+	canonical form is that of the document as parsed. It matches other
+	implementations for documents without indentation, or once they have
+	dropped the whitespace between elements too. The DTD isn't read, so
+	no default attribute is added.
+
+	The output isn't kept: it goes through a buffer of fixed size into a
+	callback, typically the update function of a hash, or to a FILE*.
+	Attributes are sorted in a scratch array that is kept from one element
+	to the next, so printing allocates nothing once that array and the
+	buffer are large enough.
+
+	@verbatim
+	static size_t Update( const char* data, size_t size, void* context )
+	{
+		SHA256_Update( (SHA256_CTX*) context, data, size );
+		return size;
+	}
+
+	SHA256_CTX sha;
+	SHA256_Init( &sha );
+	XMLCanonicalPrinter printer( Update, &sha );
+	doc.Accept( &printer );
+	printer.Flush();
+	SHA256_Final( digest, &sha );
+	@endverbatim
+
+	Printing an element rather than the document gives the canonical form
+	of that subtree, with the namespace declarations in scope of it written
+	on its top element, as the standard has it for a document subset.
+*/
+class XMLCanonicalPrinter : public XMLVisitor
+{
+public:
+	enum { DEFAULT_BUFFER_SIZE = 16 * 1024 };
+
+	/// Print through a callback.
+	XMLCanonicalPrinter( XMLWriteCallback callback, void* userData, size_t bufferSize = DEFAULT_BUFFER_SIZE );
+	/// Print to a FILE*. The file is not closed.
+	XMLCanonicalPrinter( FILE* file, size_t bufferSize = DEFAULT_BUFFER_SIZE );
+	virtual ~XMLCanonicalPrinter();
+
+	/// Keep the comments, for the "with comments" canonical form. They are left out by default.
+	void SetWithComments( bool _withComments )		{ withComments = _withComments; }
+	/// Returns true if comments are kept.
+	bool WithComments() const						{ return withComments; }
+
+	/// Write out everything printed so far. Returns false if any write has failed.
+	bool Flush();
+	/// Returns true if a write has failed. Once set, no more output is written.
+	bool Error() const								{ return error; }
+	/// The number of bytes successfully written so far.
+	size_t BytesWritten() const						{ return bytesWritten; }
+
+	virtual bool VisitEnter( const XMLDocument& doc );
+	virtual bool VisitExit( const XMLDocument& doc );
+
+	virtual bool VisitEnter( const XMLElement& element, const XMLAttribute* firstAttribute );
+	virtual bool VisitExit( const XMLElement& element );
+
+	virtual bool Visit( const XMLDeclaration& declaration );
+	virtual bool Visit( const XMLText& text );
+	virtual bool Visit( const XMLComment& comment );
+	virtual bool Visit( const XMLUnknown& unknown );
+
+private:
+	XMLCanonicalPrinter( const XMLCanonicalPrinter& );		// not allowed.
+	void operator=( const XMLCanonicalPrinter& );			// not allowed.
+
+	struct Binding;
+	struct Entry;
+
+	void Init( size_t bufferSize );
+
+	void Write( const char* data, size_t size )
+	{
+		if ( size > bufferSize - used )
+		{
+			WriteLarge( data, size );
+			return;
+		}
+		memcpy( buffer + used, data, size );
+		used += size;
+	}
+	void Write( const char* str )					{ Write( str, strlen( str ) ); }
+	void Write( const STRING& str )					{ Write( str.data(), str.length() ); }
+	void WriteLarge( const char* data, size_t size );
+	// Write 'str' with the escapes of a text, or with those of an attribute value.
+	void WriteEscaped( const STRING& str, bool attribute );
+	bool Drain( const char* data, size_t size );
+
+	// A comment or processing instruction out of the root element is on a line of its own.
+	void BeginTopLevel();
+	void EndTopLevel();
+
+	// The namespace declaration of 'prefix' in scope, from the elements above 'depth'.
+	const Binding* Lookup( const char* prefix, size_t length, int below ) const;
+	void Bind( const XMLAttribute* attribute, int at );
+	Entry* AddEntry();
+	// The order of the attributes: namespace declarations by prefix, then the others by namespace and local name.
+	static bool Before( const Entry& a, const Entry& b );
+
+	XMLWriteCallback	callback;
+	void*				userData;
+	FILE*				file;
+	char*				buffer;
+	size_t				bufferSize;
+	size_t				used;
+	size_t				bytesWritten;
+	bool				error;
+	bool				withComments;
+	bool				afterRoot;		// The root element was printed.
+	int					depth;			// The depth of the element printed, 0 out of the root.
+
+	Binding*			bindings;		// The namespace declarations in scope, the innermost last.
+	size_t				bindingCount;
+	size_t				bindingCapacity;
+	Entry*				entries;		// The scratch array the attributes are sorted in.
+	size_t				entryCount;
+	size_t				entryCapacity;
+};
+
+
 #ifdef _MSC_VER
 #pragma warning( pop )
 #endif
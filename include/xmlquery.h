@@ -0,0 +1,132 @@
+
+#ifndef __XMLQUERY_H__
+#define __XMLQUERY_H__
+
+#include "xmlparser.h"
+
+#ifdef USE_STL
+
+#include <vector>
+
+/// A list of elements, in document order, as returned by XMLQuery::Select().
+typedef std::vector< XMLElement* >			XMLElementList;
+/// The const flavor of XMLElementList.
+typedef std::vector< const XMLElement* >	XMLConstElementList;
+
+
+/**	XMLQuery is a compiled path expression: a small subset of XPath that
+	covers most of what is written by hand with XMLHandle chains. The
+	expression is parsed once by Compile() into a list of steps, and the
+	compiled query can then be run any number of times, against any node.
+
+	The supported syntax is:
+	@verbatim
+	/a          absolute path, starting at the document of the context node
+	a/b         child step
+	a//b        descendant step (any depth below 'a')
+	*           any element name
+	b[2]        the 2nd matching 'b' under each parent (1 based)
+	b[@id]      'b' elements with an 'id' attribute
+	b[@id='7']  'b' elements whose 'id' attribute is "7" (single or double quotes)
+	@endverbatim
+
+	Predicates may be chained, and apply in order: b[@type='x'][1] is the
+	first 'b' with type "x", while b[1][@type='x'] is the first 'b' if it
+	happens to have type "x". Only elements are ever matched.
+
+	Take the XMLHandle example:
+	@verbatim
+	XMLElement* child2 = docHandle.FirstChild( "Document" ).FirstChild( "Element" ).Child( "Child", 1 ).ToElement();
+	@endverbatim
+
+	With a query it becomes:
+	@verbatim
+	XMLQuery query( "/Document/Element/Child[2]" );
+	XMLElement* child2 = query.SelectFirst( &document );
+	@endverbatim
+
+	Queries hold no reference to any document, so the same compiled query
+	can be shared and run concurrently against different (or unchanging)
+	documents.
+
+	Only available in STL mode.
+*/
+class XMLQuery
+{
+public:
+	/// Create an empty query. Call Compile() before selecting.
+	XMLQuery();
+	/// Create a query and compile the expression. Check Error() for the result.
+	XMLQuery( const char* expression );
+	/// Create a query and compile the expression. Check Error() for the result.
+	XMLQuery( const std::string& expression );
+
+	/** Compile an expression, replacing any previously compiled one.
+		Returns true if successful. On failure the query matches nothing,
+		and ErrorDesc() / ErrorOffset() describe the problem.
+	*/
+	bool Compile( const char* expression );
+	/// STL std::string form.
+	bool Compile( const std::string& expression )	{ return Compile( expression.c_str() ); }
+
+	/// Returns true if the last Compile() failed.
+	bool Error() const					{ return error; }
+	/// A textual (english) description of the compile error, if any.
+	const char* ErrorDesc() const		{ return errorDesc.c_str(); }
+	/// The character offset into the expression where the compile error was found.
+	int ErrorOffset() const				{ return errorOffset; }
+	/// The expression this query was compiled from.
+	const char* Expression() const		{ return expression.c_str(); }
+
+	/** Run the query against 'context' and append every matching element
+		to 'result', in document order and without duplicates. Returns the
+		number of elements appended.
+	*/
+	size_t Select( XMLNode* context, XMLElementList* result ) const;
+	/// Const form of Select().
+	size_t Select( const XMLNode* context, XMLConstElementList* result ) const;
+
+	/** Return the first matching element in document order, or null if there
+		is none. Stops walking the tree as soon as the element is found.
+	*/
+	XMLElement* SelectFirst( XMLNode* context ) const;
+	const XMLElement* SelectFirst( const XMLNode* context ) const;
+
+	/// Return the number of elements the query matches from 'context'.
+	size_t Count( const XMLNode* context ) const;
+
+private:
+	struct Predicate
+	{
+		int			position;	// 1 based; 0 for an attribute test
+		bool		hasValue;	// false: the attribute only needs to exist
+		std::string	name;
+		std::string	value;
+	};
+
+	struct Step
+	{
+		bool					descendant;	// '//' rather than '/' before this step
+		bool					anyName;	// '*'
+		std::string				name;
+		std::vector<Predicate>	predicates;
+	};
+
+	class Evaluator;
+	friend class Evaluator;
+
+	void SetError( const char* desc, const char* at );
+	// 'own' if the context was given non-const; see Evaluator::FirstChild().
+	size_t Run( const XMLNode* context, std::vector<const XMLElement*>* result, size_t limit, bool own ) const;
+
+	bool					error;
+	std::string				errorDesc;
+	int						errorOffset;
+	std::string				expression;
+	bool					absolute;
+	std::vector<Step>		steps;
+};
+
+#endif	// USE_STL
+
+#endif
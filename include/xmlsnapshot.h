@@ -0,0 +1,140 @@
+
+#ifndef __XMLSNAPSHOT_H__
+#define __XMLSNAPSHOT_H__
+
+#include "xmlparser.h"
+
+#ifdef XML_THREADS
+
+#include <memory>
+
+#include "xmlquery.h"
+
+/**	A XMLSnapshot is an immutable, shared XMLDocument. The document is owned
+	by the snapshot and is only ever reachable through const pointers, so
+	once made it never changes. Copying a snapshot copies a reference, not
+	the document: it costs one atomic increment, and is the way to hand the
+	document to another thread. The document is deleted with the last
+	snapshot that refers to it.
+
+	Every const member function of the DOM only reads, so any number of
+	threads can use the same snapshot at once, without locking:
+	navigation (FirstChild(), NextSiblingElement(), ...), attribute queries
+	(Attribute(), QueryIntAttribute(), ...), visitors (Accept() with a
+	visitor per thread, such as a XMLPrinter), printing, and path lookups
+	with XMLQuery, whose compiled queries can be shared too.
+
+	@verbatim
+	XMLSnapshot config = XMLSnapshot::LoadFile( "config.xml" );
+	if ( config.Error() ) ...
+
+	// In each reader thread, with its own copy of 'config':
+	const XMLElement* server = config.SelectFirst( "/config/server[@name='main']" );
+	int port = 0;
+	if ( server )
+		server->QueryIntAttribute( "port", &port );
+	@endverbatim
+
+	To change the configuration, clone the document out, edit the clone, and
+	publish a new snapshot of it; readers of the old snapshot are not affected.
+
+	@verbatim
+	XMLDocument* edit = config.Clone();
+	edit->RootElement()->FirstChildElement( "server" )->SetAttribute( "port", 8080 );
+	config = XMLSnapshot::Adopt( edit );
+	@endverbatim
+
+	A clone shares its nodes with the snapshot, and copies them as they are
+	reached for editing (see Clone()), so only the parts of the document
+	that are edited cost anything. Const functions never copy, so a clone
+	that no thread changes can be read by several at once, like any other
+	document.
+
+	Only available in STL mode, with a C++11 compiler.
+*/
+class XMLSnapshot
+{
+public:
+	/// An empty snapshot, holding no document.
+	XMLSnapshot() {}
+
+	/// Make a snapshot of a copy of 'document'. The document itself is not kept.
+	static XMLSnapshot Copy( const XMLDocument& document );
+	/** Make a snapshot of 'document' without copying it. The snapshot takes
+		ownership: 'document' must have been created with new, and must not be
+		changed or deleted by the caller afterwards. Nodes that 'document'
+		still shares with another snapshot are copied now (see XMLNode::UnshareAll()).
+	*/
+	static XMLSnapshot Adopt( XMLDocument* document );
+	/// Parse xml text into a new snapshot. Check Error() for the result.
+	static XMLSnapshot Parse( const char* xml, XMLEncoding encoding = DEFAULT_ENCODING );
+	/// Load a file into a new snapshot. Check Error() for the result.
+	static XMLSnapshot LoadFile( const char* filename, XMLEncoding encoding = DEFAULT_ENCODING );
+
+	/// True if the snapshot holds no document.
+	bool IsNull() const									{ return !document; }
+	/// True if the document failed to parse or load (or there is none).
+	bool Error() const									{ return !document || document->Error(); }
+
+	/// The document. Null for an empty snapshot.
+	const XMLDocument* Document() const					{ return document.get(); }
+	const XMLDocument* operator->() const				{ return document.get(); }
+	const XMLDocument& operator*() const				{ return *document; }
+	/// See XMLDocument::RootElement(). Null for an empty snapshot.
+	const XMLElement* RootElement() const				{ return document ? document->RootElement() : 0; }
+
+	/// Visit the whole document; see XMLNode::Accept(). Returns false for an empty snapshot.
+	bool Accept( XMLVisitor* visitor ) const			{ return document ? document->Accept( visitor ) : false; }
+
+	/// Run a compiled query against the document; see XMLQuery::Select().
+	size_t Select( const XMLQuery& query, XMLConstElementList* result ) const;
+	/// Run a compiled query against the document; see XMLQuery::SelectFirst().
+	const XMLElement* SelectFirst( const XMLQuery& query ) const;
+	/// Compile and run a query. Returns null if the expression is invalid or nothing matches.
+	const XMLElement* SelectFirst( const char* expression ) const;
+
+	/** Make an editable copy of the document, in constant time. The copy
+		behaves as a deep copy, but its nodes are made only when they can
+		be changed: reaching the children of a node through a non-const
+		function (FirstChild(), FirstChildElement(), XMLQuery::Select(),
+		LinkEndChild(), ...) copies those children (not their own
+		children), so editing one value deep in a large document copies
+		just the nodes along the way there. The nodes not yet copied are
+		shared with the snapshot, and keep its document alive. Cloning a
+		clone is also constant time.
+
+		Const functions never copy: they read the shared nodes where they
+		are, in the snapshot. Those have the clone's content, but going up
+		from one (Parent(), GetDocument(), an absolute XMLQuery) leads into
+		the snapshot's document, and a pointer to one is only good while
+		the clone still shares it. Reach the nodes to change through
+		non-const functions, or call XMLNode::UnshareAll() first. The
+		snapshot itself is never changed by its clones.
+
+		The returned document must be deleted by the caller. Returns null
+		for an empty snapshot.
+	*/
+	XMLDocument* Clone() const;
+	/// Like Clone(), into an existing document, replacing its contents.
+	void CloneTo( XMLDocument* target ) const;
+	/** Clone a node of the document the same way; see Clone(). 'node'
+		must belong to this snapshot. The copy has no parent, and must be
+		linked into a document or deleted by the caller.
+	*/
+	XMLNode* CloneNode( const XMLNode* node ) const;
+
+	/// The number of snapshots that share this document.
+	long UseCount() const								{ return document.use_count(); }
+
+	bool operator==( const XMLSnapshot& rhs ) const		{ return document == rhs.document; }
+	bool operator!=( const XMLSnapshot& rhs ) const		{ return document != rhs.document; }
+
+private:
+	explicit XMLSnapshot( XMLDocument* _document ) : document( _document ) {}
+
+	std::shared_ptr<const XMLDocument> document;
+};
+
+#endif	// XML_THREADS
+
+#endif
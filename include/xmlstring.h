@@ -20,6 +20,15 @@
 	#define EXPLICIT
 #endif
 
+// Move construction and assignment need a C++11 compiler (as in xmlparser.h).
+#if !defined( XML_CXX11 ) && ( __cplusplus >= 201103L || ( defined( _MSC_VER ) && _MSC_VER >= 1700 ) )
+	#define XML_CXX11
+#endif
+
+// The buffers of long strings come from the current XMLAllocator (see xmlparser.h).
+void* XMLAllocateBlock( size_t size );
+void XMLFreeBlock( void* block, size_t size );
+
 
 /*
    XMLString is an emulation of a subset of the std::string template.
@@ -27,6 +36,8 @@
    Only the member functions relevant to the TinyXML project have been implemented.
    The buffer allocation is made by a simplistic power of 2 like mechanism : if we increase
    a string and there's no more room, we allocate a buffer twice as big as we need.
+   Strings of up to SMALL_CAPACITY chars (most names and values) are kept in a buffer
+   inside the XMLString itself, and don't allocate at all.
 */
 class XMLString
 {
@@ -37,10 +48,14 @@ class XMLString
 	// Error value for find primitive
 	static const size_type npos; // = -1;
 
+	// The longest string that is kept without a heap allocation
+	enum { SMALL_CAPACITY = 15 };
+
 
 	// XMLString empty constructor
-	XMLString () : rep_(&nullrep_)
+	XMLString () : rep_(0)
 	{
+		init(0, 0);
 	}
 
 	// XMLString copy constructor
@@ -50,6 +65,14 @@ class XMLString
 		memcpy(start(), copy.data(), length());
 	}
 
+	#ifdef XML_CXX11
+	// XMLString move constructor: takes the buffer of 'other', which is left empty
+	XMLString ( XMLString && other) : rep_(0)
+	{
+		steal(other);
+	}
+	#endif
+
 	// XMLString constructor, based on a string
 	EXPLICIT XMLString ( const char * copy) : rep_(0)
 	{
@@ -80,6 +103,19 @@ class XMLString
 		return assign(copy.start(), copy.length());
 	}
 
+	#ifdef XML_CXX11
+	// Move assignment: takes the buffer of 'other', which is left empty
+	XMLString& operator = (XMLString && other)
+	{
+		if (&other != this)
+		{
+			quit();
+			steal(other);
+		}
+		return *this;
+	}
+	#endif
+
 
 	// += operator. Maps to append
 	XMLString& operator += (const char * suffix)
@@ -166,16 +202,20 @@ class XMLString
 	*/
 	void reserve (size_type cap);
 
+	/*	Change the length of the string. New chars (if any) are left
+		uninitialized; callers are expected to write them.
+	*/
+	void resize (size_type sz)
+	{
+		reserve(sz);
+		set_size(sz);
+	}
+
 	XMLString& assign (const char* str, size_type len);
 
 	XMLString& append (const char* str, size_type len);
 
-	void swap (XMLString& other)
-	{
-		Rep* r = rep_;
-		rep_ = other.rep_;
-		other.rep_ = r;
-	}
+	void swap (XMLString& other);
 
   private:
 
@@ -190,40 +230,60 @@ class XMLString
 		char str[1];
 	};
 
+	// The inline buffer: a Rep with room for SMALL_CAPACITY chars
+	struct SmallRep
+	{
+		size_type size, capacity;
+		char str[ SMALL_CAPACITY + 1 ];
+	};
+
+	Rep* small() const { return reinterpret_cast<Rep*>( const_cast<SmallRep*>( &small_ ) ); }
+	bool is_small() const { return rep_ == small(); }
+
+	// Take the contents of 'other', leaving it empty. Our own buffer must be released already.
+	void steal(XMLString& other)
+	{
+		if (other.is_small())
+		{
+			small_ = other.small_;
+			rep_ = small();
+		}
+		else
+		{
+			rep_ = other.rep_;
+		}
+		other.init(0, 0);
+	}
+
 	void init(size_type sz, size_type cap)
 	{
-		if (cap)
+		if (cap > SMALL_CAPACITY)
 		{
-			// Lee: the original form:
-			//	rep_ = static_cast<Rep*>(operator new(sizeof(Rep) + cap));
-			// doesn't work in some cases of new being overloaded. Switching
-			// to the normal allocation, although use an 'int' for systems
-			// that are overly picky about structure alignment.
-			const size_type bytesNeeded = sizeof(Rep) + cap;
-			const size_type intsNeeded = ( bytesNeeded + sizeof(int) - 1 ) / sizeof( int ); 
-			rep_ = reinterpret_cast<Rep*>( new int[ intsNeeded ] );
+			// The buffer comes from the current XMLAllocator, like the nodes
+			// holding the string, and is aligned as operator new's.
+			rep_ = static_cast<Rep*>( XMLAllocateBlock( sizeof(Rep) + cap ) );
 
 			rep_->str[ rep_->size = sz ] = '\0';
 			rep_->capacity = cap;
 		}
 		else
 		{
-			rep_ = &nullrep_;
+			rep_ = small();
+			rep_->str[ rep_->size = sz ] = '\0';
+			rep_->capacity = SMALL_CAPACITY;
 		}
 	}
 
 	void quit()
 	{
-		if (rep_ != &nullrep_)
+		if (!is_small())
 		{
-			// The rep_ is really an array of ints. (see the allocator, above).
-			// Cast it back before delete, so the compiler won't incorrectly call destructors.
-			delete [] ( reinterpret_cast<int*>( rep_ ) );
+			XMLFreeBlock( rep_, sizeof(Rep) + rep_->capacity );
 		}
 	}
 
 	Rep * rep_;
-	static Rep nullrep_;
+	SmallRep small_;
 
 } ;
 
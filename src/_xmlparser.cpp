@@ -4,16 +4,6 @@
 
 #include "xmlparser.h"
 
-//#define DEBUG_PARSER
-#if defined( DEBUG_PARSER )
-#	if defined( DEBUG ) && defined( _MSC_VER )
-#		include <windows.h>
-#		define LOG OutputDebugString
-#	else
-#		define LOG printf
-#	endif
-#endif
-
 // Note tha "PutString" hardcodes the same list. This
 // is less flexible than it appears. Changing the entries
 // or order will break putstring.	
@@ -152,13 +142,17 @@ class XMLParsingData
 	void Stamp( const char* now, XMLEncoding encoding );
 
 	const XMLCursor& Cursor() const	{ return cursor; }
+	// The start of the whole text, that source offsets count from.
+	const char* Base() const			{ return base; }
 
   private:
-	// Only used by the document!
-	XMLParsingData( const char* start, int _tabsize, int row, int col )
+	// Only used by the document! 'base' is the start of the whole text,
+	// when parsing begins further on at 'start'.
+	XMLParsingData( const char* start, int _tabsize, int row, int col, const char* _base = 0 )
 	{
 		assert( start );
 		stamp = start;
+		base = _base ? _base : start;
 		tabsize = _tabsize;
 		cursor.row = row;
 		cursor.col = col;
@@ -166,6 +160,7 @@ class XMLParsingData
 
 	XMLCursor		cursor;
 	const char*		stamp;
+	const char*		base;
 	int				tabsize;
 };
 
@@ -485,6 +480,7 @@ const char* XMLBase::GetEntity( const char* p, char* value, int* length, XMLEnco
 			*value = (char)ucs;
 			*length = 1;
 		}
+		XML_STAT( entities++ );
 		return p + delta + 1;
 	}
 
@@ -496,6 +492,7 @@ const char* XMLBase::GetEntity( const char* p, char* value, int* length, XMLEnco
 			assert( strlen( entity[i].str ) == entity[i].strLength );
 			*value = entity[i].chr;
 			*length = 1;
+			XML_STAT( entities++ );
 			return ( p + entity[i].strLength );
 		}
 	}
@@ -649,7 +646,7 @@ void XMLDocument::StreamIn( std::istream * in, STRING * tag )
 			// We now have something we presume to be a node of 
 			// some sort. Identify it, and call the node to
 			// continue streaming.
-			XMLNode* node = Identify( tag->c_str() + tagIndex, DEFAULT_ENCODING );
+			XMLNode* node = Identify( tag->c_str() + tagIndex, DEFAULT_ENCODING, 0 );
 
 			if ( node )
 			{
@@ -679,15 +676,39 @@ void XMLDocument::StreamIn( std::istream * in, STRING * tag )
 #endif
 
 const char* XMLDocument::Parse( const char* p, XMLParsingData* prevData, XMLEncoding encoding )
+{
+	return ParseDocument( p, prevData, encoding, 0 );
+}
+
+
+const char* XMLDocument::ParseDocument( const char* p, XMLParsingData* prevData, XMLEncoding encoding, Feed* feed )
 {
 	ClearError();
 
+	#ifdef XML_STATS
+	// Statistics start over, unless this is the parse of a LoadFile() that collects them.
+	XMLParseStats* collect = collectStats ? &stats : 0;
+	if ( collect && XMLStatsCurrent() != collect )
+		collect->Clear();
+	XMLStatsScope statsScope( collect );
+	#endif
+	XML_STAT_TIMER( parseTimer, parseSeconds );
+	XMLAllocatorScope allocatorScope( allocator );
+	XML_TRACE_DOCUMENT_BEGIN( this, p );
+	const char* start = p;
+	size_t parsed = 0;		// the bytes up to the end of the last top level node
+	SetSource( NO_SOURCE, 0 );
+	givenEncoding = encoding;
+	if ( feed && p )
+		FeedAhead( p, 3, feed );
+
 	// Parse away, at the document level. Since a document
 	// contains nothing but other tags, most of what happens
 	// here is skipping white space.
 	if ( !p || !*p )
 	{
 		SetError( ERROR_DOCUMENT_EMPTY, 0, 0, ENCODING_UNKNOWN );
+		XML_TRACE_DOCUMENT_END( this, 0 );
 		return 0;
 	}
 
@@ -721,25 +742,42 @@ const char* XMLDocument::Parse( const char* p, XMLParsingData* prevData, XMLEnco
 		}
 	}
 
-    p = SkipWhiteSpace( p, encoding );
+    p = feed ? SkipFed( p, encoding, feed ) : SkipWhiteSpace( p, encoding );
 	if ( !p )
 	{
 		SetError( ERROR_DOCUMENT_EMPTY, 0, 0, ENCODING_UNKNOWN );
+		XML_TRACE_DOCUMENT_END( this, 0 );
 		return 0;
 	}
 
 	while ( p && *p )
 	{
-		XMLNode* node = Identify( p, encoding );
-		if ( node )
+		XMLNode* node = 0;
+		if ( feed )
 		{
+			if ( *p == '<' )
+			{
+				p = ParseFedNode( this, p, &data, encoding, feed );
+				node = LastChild();
+			}
+		}
+		else if ( ( node = Identify( p, encoding, this ) ) != 0 )
+		{
+			const char* begin = p;
 			p = node->Parse( p, &data, encoding );
+			if ( p )
+				node->SetSource( begin - data.Base(), p - begin );
 			LinkEndChild( node );
 		}
-		else
+		if ( !node )
 		{
 			break;
 		}
+		if ( p )
+		{
+			parsed = p - start;
+			XML_STAT( bytes = parsed );
+		}
 
 		// Did we get encoding info?
 		if (    encoding == ENCODING_UNKNOWN
@@ -759,19 +797,406 @@ const char* XMLDocument::Parse( const char* p, XMLParsingData* prevData, XMLEnco
 				encoding = ENCODING_LEGACY;
 		}
 
-		p = SkipWhiteSpace( p, encoding );
+		p = feed ? SkipFed( p, encoding, feed ) : SkipWhiteSpace( p, encoding );
 	}
 
 	// Was this empty?
-	if ( !firstChild ) {
+	if ( NoChildren() ) {
 		SetError( ERROR_DOCUMENT_EMPTY, 0, 0, encoding );
+		XML_TRACE_DOCUMENT_END( this, 0 );
 		return 0;
 	}
 
 	// All is well.
+	XML_TRACE_DOCUMENT_END( this, parsed );
+	SetSource( 0, parsed );
+	parseEncoding = encoding;
+	return p;
+}
+
+void XMLDocument::FeedAhead( const char* p, size_t n, Feed* feed )
+{
+	for ( ;; )
+	{
+		size_t have = 0;
+		while ( have < n && p[have] )
+			++have;
+		if ( have == n || !feed->More( p ) )
+			return;
+	}
+}
+
+
+void XMLDocument::FeedUntil( const char* p, const char* end, Feed* feed )
+{
+	while ( !strstr( p, end ) && feed->More( p ) )
+		;
+}
+
+
+const char* XMLDocument::SkipFed( const char* p, XMLEncoding encoding, Feed* feed )
+{
+	// SkipWhiteSpace() gives null at the end of the text: at the end so
+	// far, it is tried again with more.
+	for ( ;; )
+	{
+		const char* q = SkipWhiteSpace( p, encoding );
+		if ( ( q && *q ) || !p || !feed->More( p ) )
+			return q;
+		if ( q )
+			p = q;
+	}
+}
+
+
+// The fed parse waits to parse a node until the text has what ends it: a
+// '>', for most nodes. A '>' may also come before the end, as in an
+// attribute value, so a parse that fails, or that stops where the text so
+// far does, is undone and tried again with more. As More() at least
+// doubles the text from the node on, the retries of a node parse no more
+// than its own length again.
+const char* XMLDocument::ParseFedNode( XMLNode* parent, const char* p, XMLParsingData* data, XMLEncoding encoding, Feed* feed )
+{
+	// Enough to tell what the node is: "<![CDATA[" is the longest.
+	FeedAhead( p, 9, feed );
+	XMLNode* node = parent->Identify( p, encoding, this );
+	if ( !node )
+		return 0;
+	if ( XMLElement* element = node->ToElement() )
+		return ParseFedElement( parent, element, p, data, encoding, feed );
+
+	const char* end = ">";
+	if ( node->ToComment() )
+		end = "-->";
+	else if ( node->ToText() )
+		end = "]]>";
+	for ( ;; )
+	{
+		FeedUntil( p, end, feed );
+		XMLParsingData start = *data;
+		const char* q = node->Parse( p, data, encoding );
+		if ( ( q && q[-1] == '>' ) || !feed->More( p ) )
+		{
+			if ( q )
+				node->SetSource( p - data->Base(), q - p );
+			parent->LinkEndChild( node );
+			return q;
+		}
+		Unparse( node, data, start );
+		node = parent->Identify( p, encoding, this );
+	}
+}
+
+
+const char* XMLDocument::ParseFedElement( XMLNode* parent, XMLElement* element, const char* p, XMLParsingData* data, XMLEncoding encoding, Feed* feed )
+{
+	XML_STAT_DEPTH( statsDepth );
+	const char* begin = p;
+	bool empty = false;
+	for ( ;; )
+	{
+		FeedUntil( begin, ">", feed );
+		XMLParsingData start = *data;
+		p = element->ParseStartTag( begin, data, encoding, &empty );
+		if ( p || !feed->More( begin ) )
+			break;
+		Unparse( element, data, start );
+		element = parent->Identify( begin, encoding, this )->ToElement();
+	}
+	parent->LinkEndChild( element );
+
+	if ( p && !empty )
+	{
+		p = ParseFedValue( element, p, data, encoding, feed );
+		const char* tag = p;
+		for ( ;; )
+		{
+			if ( tag )
+				FeedUntil( tag, ">", feed );
+			XMLParsingData start = *data;
+			p = element->ParseEndTag( tag, data, encoding );
+			if ( !tag || p || !feed->More( tag ) )
+				break;
+			ClearError();
+			*data = start;
+		}
+	}
+	if ( p )
+		element->SetSource( begin - data->Base(), p - begin );
 	return p;
 }
 
+
+// ReadValue(), with the children parsed as they come in.
+const char* XMLDocument::ParseFedValue( XMLElement* element, const char* p, XMLParsingData* data, XMLEncoding encoding, Feed* feed )
+{
+	const char* pWithWhiteSpace = p;
+	p = SkipFed( p, encoding, feed );
+
+	while ( p && *p )
+	{
+		if ( *p != '<' )
+		{
+			// Text ends where the next node starts.
+			const char* begin = IsWhiteSpaceCondensed() ? p : pWithWhiteSpace;
+			XMLText* textNode = 0;
+			for ( ;; )
+			{
+				FeedUntil( p, "<", feed );
+				XMLParsingData start = *data;
+				textNode = NewNode( TINYXML_TEXT )->ToText();
+				p = textNode->Parse( begin, data, encoding );
+				if ( ( p && *p ) || !feed->More( begin ) )
+					break;
+				ClearError();
+				*data = start;
+				DeleteNode( textNode );
+				p = begin;
+			}
+			if ( p )
+				textNode->SetSource( begin - data->Base(), p - begin );
+
+			if ( !textNode->Blank() )
+			{
+				element->LinkEndChild( textNode );
+				XML_STAT( nodes[ TINYXML_TEXT ]++ );
+			}
+			else
+				DeleteNode( textNode );
+		}
+		else
+		{
+			// An end tag, or a node?
+			FeedAhead( p, 2, feed );
+			if ( StringEqual( p, "</", false, encoding ) )
+				return p;
+			p = ParseFedNode( element, p, data, encoding, feed );
+		}
+		pWithWhiteSpace = p;
+		p = SkipFed( p, encoding, feed );
+	}
+
+	if ( !p )
+	{
+		SetError( ERROR_READING_ELEMENT_VALUE, 0, 0, encoding );
+	}
+	return p;
+}
+
+
+void XMLDocument::Unparse( XMLNode* node, XMLParsingData* data, const XMLParsingData& start )
+{
+	#ifdef XML_STATS
+	XML_STAT( nodes[ node->Type() ]-- );
+	if ( const XMLElement* element = node->ToElement() )
+	{
+		for ( const XMLAttribute* attribute = element->FirstAttribute(); attribute; attribute = attribute->Next() )
+			XML_STAT( attributes-- );
+	}
+	#endif
+	ClearError();
+	*data = start;
+	DeleteNode( node );
+}
+
+
+bool XMLDocument::ReparseEdit( STRING* source, size_t offset, size_t removed, const char* insert, size_t insertLength )
+{
+	const size_t length = source->length();
+	if ( offset > length || removed > length - offset )
+		return false;
+	const size_t editEnd = offset + removed;
+	const char* oldText = source->c_str();
+
+	// The deepest element that holds the edit, but not in its first or last
+	// byte (the '<' and '>' that bound it). Siblings come in text order. A
+	// last top level node that never ended has no span to shift: the whole
+	// text is parsed again then.
+	XMLElement* target = 0;
+	if ( !Error() && sourceOffset == 0 && lastChild && lastChild->sourceOffset != NO_SOURCE )
+	{
+		XMLNode* node = firstChild;
+		while ( node )
+		{
+			if ( node->sourceOffset != NO_SOURCE && node->sourceOffset >= editEnd )
+				break;
+			if (    node->ToElement()
+				 && node->sourceOffset != NO_SOURCE
+				 && node->sourceOffset < offset
+				 && editEnd < node->sourceOffset + node->sourceLength )
+			{
+				target = node->ToElement();
+				node = node->firstChild;
+			}
+			else
+			{
+				node = node->next;
+			}
+		}
+	}
+	// If the tree and the text don't agree, it is all parsed again.
+	if (    target
+		 && (    target->sourceOffset + target->sourceLength > length
+			  || oldText[ target->sourceOffset ] != '<'
+			  || oldText[ target->sourceOffset + target->sourceLength - 1 ] != '>' ) )
+	{
+		target = 0;
+	}
+
+	// The row and column where the text after the edit resumed, before it.
+	XMLCursor resume;
+	if ( target )
+	{
+		XMLParsingData old( oldText + target->sourceOffset, TabSize(), target->location.row, target->location.col );
+		old.Stamp( oldText + editEnd, parseEncoding );
+		resume = old.Cursor();
+	}
+
+	STRING edited;
+	edited.reserve( length - removed + insertLength );
+	edited.append( oldText, offset );
+	edited.append( insert, insertLength );
+	edited.append( oldText + editEnd, length - editEnd );
+	source->swap( edited );
+	const char* text = source->c_str();
+
+	// What the edit adds to the offsets after it; unsigned, so it wraps
+	// around to subtract when the edit removes more than it inserts.
+	const size_t shift = insertLength - removed;
+
+	XMLAllocatorScope allocatorScope( allocator );
+	for ( XMLElement* element = target; element; )
+	{
+		const size_t newLength = element->sourceLength + shift;
+		XMLParsingData data( text + element->sourceOffset, TabSize(), element->location.row, element->location.col, text );
+		XMLElement* replacement = ReparseElement( element, text, newLength, &data );
+		if ( !replacement )
+		{
+			// The edit reaches beyond this element: try its parent.
+			ClearError();
+			element = element->parent->ToElement();
+			continue;
+		}
+
+		// Where the old element ended, and where the new one does.
+		const char* end = text + element->sourceOffset + newLength;
+		XMLParsingData old( text + offset + insertLength, TabSize(), resume.row, resume.col );
+		old.Stamp( end, parseEncoding );
+		data.Stamp( end, parseEncoding );
+
+		XMLNode* parentNode = element->parent;
+		parentNode->ContentChanged();
+		replacement->prev = element->prev;
+		replacement->next = element->next;
+		if ( element->prev )
+			element->prev->next = replacement;
+		else
+			parentNode->firstChild = replacement;
+		if ( element->next )
+			element->next->prev = replacement;
+		else
+			parentNode->lastChild = replacement;
+		element->parent = 0;
+		element->prev = 0;
+		element->next = 0;
+		DeleteNode( element );
+
+		for ( XMLNode* node = parentNode; node; node = node->parent )
+			node->sourceLength += shift;
+		ShiftFollowing( replacement, shift, old.Cursor(), &data );
+		return true;
+	}
+
+	// Nothing smaller than the document holds the edit. The edit may have
+	// changed the BOM or the declaration, so the encoding is found again,
+	// unless the last Parse() was given one.
+	Clear();
+	if ( givenEncoding == ENCODING_UNKNOWN )
+		useMicrosoftBOM = false;
+	Parse( text, 0, givenEncoding );
+	return !Error();
+}
+
+
+XMLElement* XMLDocument::ReparseElement( const XMLElement* element, const char* text, size_t length, XMLParsingData* data )
+{
+	// The edit may leave the text something other than an element, as
+	// Identify() tells them apart: "< a>" is not one, though Parse() reads it.
+	const char* begin = text + element->sourceOffset;
+	if ( *begin != '<' || !( IsAlpha( (unsigned char) begin[1], parseEncoding ) || begin[1] == '_' ) )
+		return 0;
+
+	XMLElement* replacement = NewNode( TINYXML_ELEMENT )->ToElement();
+	replacement->parent = element->parent;
+	const char* end = replacement->Parse( begin, data, parseEncoding );
+	if ( !end || Error() || (size_t)( end - begin ) != length )
+	{
+		replacement->parent = 0;
+		DeleteNode( replacement );
+		return 0;
+	}
+	replacement->SetSource( element->sourceOffset, length );
+	return replacement;
+}
+
+
+void XMLDocument::ShiftFollowing( XMLNode* node, size_t shift, const XMLCursor& oldEnd, XMLParsingData* newEnd )
+{
+	const bool lines = TabSize() > 0 && oldEnd.row >= 0;
+	const int rows = newEnd->Cursor().row - oldEnd.row;
+	const char* text = newEnd->Base();
+
+	// Every node after 'node', in document order.
+	bool below = false;
+	for (;;)
+	{
+		if ( below && node->firstChild )
+		{
+			node = node->firstChild;
+		}
+		else
+		{
+			while ( node != this && !node->next )
+				node = node->parent;
+			if ( node == this )
+				break;
+			node = node->next;
+		}
+		below = true;
+
+		if ( node->sourceOffset != NO_SOURCE )
+			node->sourceOffset += shift;
+		if ( !lines || node->location.row < oldEnd.row )
+			continue;
+
+		// Only what shares the line where the old element ended moves
+		// along it; the lines below just move up or down.
+		int cols = 0;
+		if ( node->location.row == oldEnd.row && node->sourceOffset != NO_SOURCE )
+		{
+			// Nodes come in text order, so the stamp only moves forward.
+			newEnd->Stamp( text + node->sourceOffset, parseEncoding );
+			cols = newEnd->Cursor().col - node->location.col;
+			node->location = newEnd->Cursor();
+		}
+		else
+		{
+			node->location.row += rows;
+		}
+
+		if ( XMLElement* element = node->ToElement() )
+		{
+			for ( XMLAttribute* attribute = element->FirstAttribute(); attribute; attribute = attribute->Next() )
+			{
+				if ( attribute->location.row == oldEnd.row )
+					attribute->location.col += cols;
+				attribute->location.row += rows;
+			}
+		}
+	}
+}
+
+
 void XMLDocument::SetError( int err, const char* pError, XMLParsingData* data, XMLEncoding encoding )
 {	
 	// The first error in a chain is more accurate - don't set again!
@@ -782,6 +1207,7 @@ void XMLDocument::SetError( int err, const char* pError, XMLParsingData* data, X
 	error   = true;
 	errorId = err;
 	errorDesc = errorString[ errorId ];
+	XML_TRACE_ERROR( this, err );
 
 	errorLocation.Clear();
 	if ( pError && data )
@@ -792,9 +1218,73 @@ void XMLDocument::SetError( int err, const char* pError, XMLParsingData* data, X
 }
 
 
-XMLNode* XMLNode::Identify( const char* p, XMLEncoding encoding )
+// A new, empty node of the given type, as the parser fills them in.
+static XMLNode* CreateNode( XMLNode::NodeType type )
+{
+	switch ( type )
+	{
+		case XMLNode::TINYXML_ELEMENT:		return new XMLElement( "" );
+		case XMLNode::TINYXML_TEXT:			return new XMLText( "" );
+		case XMLNode::TINYXML_COMMENT:		return new XMLComment();
+		case XMLNode::TINYXML_UNKNOWN:		return new XMLUnknown();
+		case XMLNode::TINYXML_DECLARATION:	return new XMLDeclaration();
+		default:							return 0;
+	}
+}
+
+
+#ifdef XML_STATS
+// The size of a node of the given type, for the allocation statistics.
+static size_t NodeSize( XMLNode::NodeType type )
+{
+	switch ( type )
+	{
+		case XMLNode::TINYXML_ELEMENT:		return sizeof( XMLElement );
+		case XMLNode::TINYXML_TEXT:			return sizeof( XMLText );
+		case XMLNode::TINYXML_COMMENT:		return sizeof( XMLComment );
+		case XMLNode::TINYXML_UNKNOWN:		return sizeof( XMLUnknown );
+		case XMLNode::TINYXML_DECLARATION:	return sizeof( XMLDeclaration );
+		default:							return 0;
+	}
+}
+#endif
+
+
+XMLNode* XMLDocument::NewNode( NodeType type )
+{
+	XMLNode* node = freeNodes[ type ];
+	if ( !node )
+	{
+		XML_STAT( allocations++ );
+		XML_STAT( allocatedBytes += NodeSize( type ) );
+		return CreateNode( type );
+	}
+	freeNodes[ type ] = node->next;
+	node->next = 0;
+	return node;
+}
+
+
+XMLAttribute* XMLDocument::NewAttribute()
+{
+	XMLAttribute* attribute = freeAttributes;
+	if ( !attribute )
+	{
+		XML_STAT( allocations++ );
+		XML_STAT( allocatedBytes += sizeof( XMLAttribute ) );
+		return new XMLAttribute();
+	}
+	freeAttributes = attribute->next;
+	attribute->next = 0;
+	return attribute;
+}
+
+
+XMLNode* XMLNode::Identify( const char* p, XMLEncoding encoding, XMLDocument* document )
 {
 	XMLNode* returnNode = 0;
+	NodeType type = TINYXML_UNKNOWN;
+	bool cdata = false;
 
 	p = SkipWhiteSpace( p, encoding );
 	if( !p || !*p || *p != '<' )
@@ -821,54 +1311,43 @@ XMLNode* XMLNode::Identify( const char* p, XMLEncoding encoding )
 	const char* dtdHeader = { "<!" };
 	const char* cdataHeader = { "<![CDATA[" };
 
-	if ( StringEqual( p, xmlHeader, true, encoding ) )
+	// Not <?xml-stylesheet and the like, which are processing instructions.
+	if ( StringEqual( p, xmlHeader, true, encoding ) && ( IsWhiteSpace( p[5] ) || p[5] == '?' ) )
 	{
-		#ifdef DEBUG_PARSER
-			LOG( "XML parsing Declaration\n" );
-		#endif
-		returnNode = new XMLDeclaration();
+		type = TINYXML_DECLARATION;
 	}
 	else if ( StringEqual( p, commentHeader, false, encoding ) )
 	{
-		#ifdef DEBUG_PARSER
-			LOG( "XML parsing Comment\n" );
-		#endif
-		returnNode = new XMLComment();
+		type = TINYXML_COMMENT;
 	}
 	else if ( StringEqual( p, cdataHeader, false, encoding ) )
 	{
-		#ifdef DEBUG_PARSER
-			LOG( "XML parsing CDATA\n" );
-		#endif
-		XMLText* text = new XMLText( "" );
-		text->SetCDATA( true );
-		returnNode = text;
+		type = TINYXML_TEXT;
+		cdata = true;
 	}
 	else if ( StringEqual( p, dtdHeader, false, encoding ) )
 	{
-		#ifdef DEBUG_PARSER
-			LOG( "XML parsing Unknown(1)\n" );
-		#endif
-		returnNode = new XMLUnknown();
+		type = TINYXML_UNKNOWN;
 	}
 	else if (    IsAlpha( *(p+1), encoding )
 			  || *(p+1) == '_' )
 	{
-		#ifdef DEBUG_PARSER
-			LOG( "XML parsing Element\n" );
-		#endif
-		returnNode = new XMLElement( "" );
+		type = TINYXML_ELEMENT;
 	}
 	else
 	{
-		#ifdef DEBUG_PARSER
-			LOG( "XML parsing Unknown(2)\n" );
-		#endif
-		returnNode = new XMLUnknown();
+		type = TINYXML_UNKNOWN;
 	}
 
+	// The document may have a node of the type to reuse.
+	returnNode = document ? document->NewNode( type ) : CreateNode( type );
+
 	if ( returnNode )
 	{
+		XML_STAT( nodes[ type ]++ );
+		if ( cdata )
+			returnNode->ToText()->SetCDATA( true );
+
 		// Set the parent, so it can report errors
 		returnNode->parent = this;
 	}
@@ -1003,7 +1482,7 @@ void XMLElement::StreamIn (std::istream * in, STRING * tag)
 			{
 				// If not a closing tag, id it, and stream.
 				const char* tagloc = tag->c_str() + tagIndex;
-				XMLNode* node = Identify( tagloc, DEFAULT_ENCODING );
+				XMLNode* node = Identify( tagloc, DEFAULT_ENCODING, 0 );
 				if ( !node )
 					return;
 				node->StreamIn( in, tag );
@@ -1018,6 +1497,21 @@ void XMLElement::StreamIn (std::istream * in, STRING * tag)
 #endif
 
 const char* XMLElement::Parse( const char* p, XMLParsingData* data, XMLEncoding encoding )
+{
+	XML_STAT_DEPTH( statsDepth );
+	bool empty = false;
+	p = ParseStartTag( p, data, encoding, &empty );
+	if ( !p || empty )
+		return p;
+
+	// Read the value -- which can include other elements -- read the
+	// end tag, and return.
+	p = ReadValue( p, data, encoding );		// Note this is an Element method, and will set the error if one happens.
+	return ParseEndTag( p, data, encoding );
+}
+
+
+const char* XMLElement::ParseStartTag( const char* p, XMLParsingData* data, XMLEncoding encoding, bool* empty )
 {
 	p = SkipWhiteSpace( p, encoding );
 	XMLDocument* document = GetDocument();
@@ -1051,9 +1545,7 @@ const char* XMLElement::Parse( const char* p, XMLParsingData* data, XMLEncoding
 		if ( document )	document->SetError( ERROR_FAILED_TO_READ_ELEMENT_NAME, pErr, data, encoding );
 		return 0;
 	}
-
-    STRING endTag ("</");
-	endTag += value;
+	XML_TRACE_ELEMENT_BEGIN( this );
 
 	// Check for and read attributes. Also look for an empty
 	// tag or an end tag.
@@ -1075,48 +1567,19 @@ const char* XMLElement::Parse( const char* p, XMLParsingData* data, XMLEncoding
 				if ( document ) document->SetError( ERROR_PARSING_EMPTY, p, data, encoding );		
 				return 0;
 			}
+			XML_TRACE_ELEMENT_END( this );
+			*empty = true;
 			return (p+1);
 		}
 		else if ( *p == '>' )
 		{
 			// Done with attributes (if there were any.)
-			// Read the value -- which can include other
-			// elements -- read the end tag, and return.
-			++p;
-			p = ReadValue( p, data, encoding );		// Note this is an Element method, and will set the error if one happens.
-			if ( !p || !*p ) {
-				// We were looking for the end tag, but found nothing.
-				// Fix for [ 1663758 ] Failure to report error on bad XML
-				if ( document ) document->SetError( ERROR_READING_END_TAG, p, data, encoding );
-				return 0;
-			}
-
-			// We should find the end tag now
-			// note that:
-			// </foo > and
-			// </foo> 
-			// are both valid end tags.
-			if ( StringEqual( p, endTag.c_str(), false, encoding ) )
-			{
-				p += endTag.length();
-				p = SkipWhiteSpace( p, encoding );
-				if ( p && *p && *p == '>' ) {
-					++p;
-					return p;
-				}
-				if ( document ) document->SetError( ERROR_READING_END_TAG, p, data, encoding );
-				return 0;
-			}
-			else
-			{
-				if ( document ) document->SetError( ERROR_READING_END_TAG, p, data, encoding );
-				return 0;
-			}
+			return (p+1);
 		}
 		else
 		{
 			// Try to read an attribute:
-			XMLAttribute* attrib = new XMLAttribute();
+			XMLAttribute* attrib = document ? document->NewAttribute() : new XMLAttribute();
 			if ( !attrib )
 			{
 				return 0;
@@ -1129,7 +1592,7 @@ const char* XMLElement::Parse( const char* p, XMLParsingData* data, XMLEncoding
 			if ( !p || !*p )
 			{
 				if ( document ) document->SetError( ERROR_PARSING_ELEMENT, pErr, data, encoding );
-				delete attrib;
+				if ( document ) document->DeleteAttribute( attrib ); else delete attrib;
 				return 0;
 			}
 
@@ -1142,17 +1605,54 @@ const char* XMLElement::Parse( const char* p, XMLParsingData* data, XMLEncoding
 			if ( node )
 			{
 				if ( document ) document->SetError( ERROR_PARSING_ELEMENT, pErr, data, encoding );
-				delete attrib;
+				if ( document ) document->DeleteAttribute( attrib ); else delete attrib;
 				return 0;
 			}
 
 			attributeSet.Add( attrib );
+			XML_STAT( attributes++ );
 		}
 	}
 	return p;
 }
 
 
+const char* XMLElement::ParseEndTag( const char* p, XMLParsingData* data, XMLEncoding encoding )
+{
+	XMLDocument* document = GetDocument();
+	if ( !p || !*p ) {
+		// We were looking for the end tag, but found nothing.
+		// Fix for [ 1663758 ] Failure to report error on bad XML
+		if ( document ) document->SetError( ERROR_READING_END_TAG, p, data, encoding );
+		return 0;
+	}
+
+	// We should find the end tag now
+	// note that:
+	// </foo > and
+	// </foo> 
+	// are both valid end tags.
+	if (    StringEqual( p, "</", false, encoding )
+		 && strncmp( p+2, value.c_str(), value.length() ) == 0 )
+	{
+		p += 2 + value.length();
+		p = SkipWhiteSpace( p, encoding );
+		if ( p && *p && *p == '>' ) {
+			++p;
+			XML_TRACE_ELEMENT_END( this );
+			return p;
+		}
+		if ( document ) document->SetError( ERROR_READING_END_TAG, p, data, encoding );
+		return 0;
+	}
+	else
+	{
+		if ( document ) document->SetError( ERROR_READING_END_TAG, p, data, encoding );
+		return 0;
+	}
+}
+
+
 const char* XMLElement::ReadValue( const char* p, XMLParsingData* data, XMLEncoding encoding )
 {
 	XMLDocument* document = GetDocument();
@@ -1166,13 +1666,14 @@ const char* XMLElement::ReadValue( const char* p, XMLParsingData* data, XMLEncod
 		if ( *p != '<' )
 		{
 			// Take what we have, make a text element.
-			XMLText* textNode = new XMLText( "" );
+			XMLText* textNode = document ? document->NewNode( TINYXML_TEXT )->ToText() : new XMLText( "" );
 
 			if ( !textNode )
 			{
 			    return 0;
 			}
 
+			const char* begin = p;
 			if ( XMLBase::IsWhiteSpaceCondensed() )
 			{
 				p = textNode->Parse( p, data, encoding );
@@ -1181,11 +1682,19 @@ const char* XMLElement::ReadValue( const char* p, XMLParsingData* data, XMLEncod
 			{
 				// Special case: we want to keep the white space
 				// so that leading spaces aren't removed.
+				begin = pWithWhiteSpace;
 				p = textNode->Parse( pWithWhiteSpace, data, encoding );
 			}
+			if ( p && data )
+				textNode->SetSource( begin - data->Base(), p - begin );
 
 			if ( !textNode->Blank() )
+			{
 				LinkEndChild( textNode );
+				XML_STAT( nodes[ TINYXML_TEXT ]++ );
+			}
+			else if ( document )
+				document->DeleteNode( textNode );
 			else
 				delete textNode;
 		} 
@@ -1200,10 +1709,13 @@ const char* XMLElement::ReadValue( const char* p, XMLParsingData* data, XMLEncod
 			}
 			else
 			{
-				XMLNode* node = Identify( p, encoding );
+				XMLNode* node = Identify( p, encoding, document );
 				if ( node )
 				{
+					const char* begin = p;
 					p = node->Parse( p, data, encoding );
+					if ( p && data )
+						node->SetSource( begin - data->Base(), p - begin );
 					LinkEndChild( node );
 				}				
 				else
@@ -1506,8 +2018,12 @@ const char* XMLText::Parse( const char* p, XMLParsingData* data, XMLEncoding enc
 			++p;
 		}
 
-		STRING dummy; 
-		p = ReadText( p, &dummy, false, endTag, false, encoding );
+		// The "]]>" may be the last of the text, as the last node of a
+		// document: the end pointer is still good then.
+		if ( !p || !*p )
+			return 0;
+		p += strlen( endTag );
+		XML_TRACE_TEXT( this, value.length() );
 		return p;
 	}
 	else
@@ -1517,7 +2033,10 @@ const char* XMLText::Parse( const char* p, XMLParsingData* data, XMLEncoding enc
 		const char* end = "<";
 		p = ReadText( p, &value, ignoreWhite, end, false, encoding );
 		if ( p && *p )
+		{
+			XML_TRACE_TEXT( this, value.length() );
 			return p-1;	// don't truncate the '<'
+		}
 		return 0;
 	}
 }
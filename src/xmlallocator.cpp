@@ -0,0 +1,117 @@
+#include "xmlparser.h"
+
+#include <new>
+
+// Without C++11 there is no portable thread local storage, and documents
+// with allocators of their own can't be used on several threads at once.
+#ifdef XML_CXX11
+static thread_local XMLAllocator* current = 0;
+#else
+static XMLAllocator* current = 0;
+#endif
+
+
+/*	Every block starts with the allocator it came from (null for operator
+	new), so it can be given back wherever it ends up. The rest of the block
+	is aligned to 8 bytes, not to operator new's 16: enough for what lives
+	in these blocks (nodes, attributes, and char and int buffers), and half
+	the cost of a full alignment on every node.
+*/
+union BlockHeader
+{
+	XMLAllocator*	allocator;
+	void*			pointer;
+	double			real;
+	long long		integer;
+};
+
+#ifdef XML_CXX11
+static_assert( alignof( XMLElement ) <= sizeof( BlockHeader ) && alignof( XMLDocument ) <= sizeof( BlockHeader )
+			   && alignof( XMLText ) <= sizeof( BlockHeader ) && alignof( XMLAttribute ) <= sizeof( BlockHeader )
+			   && alignof( XMLComment ) <= sizeof( BlockHeader ) && alignof( XMLUnknown ) <= sizeof( BlockHeader )
+			   && alignof( XMLDeclaration ) <= sizeof( BlockHeader ),
+			   "a block header no longer keeps the nodes aligned" );
+#endif
+
+
+XMLAllocator* XMLAllocator::Current()
+{
+	return current;
+}
+
+
+size_t XMLAllocator::Overhead()
+{
+	return sizeof( BlockHeader );
+}
+
+
+void* XMLAllocateBlock( size_t size )
+{
+	XMLAllocator* allocator = current;
+	size_t bytes = size + sizeof( BlockHeader );
+	BlockHeader* header = static_cast<BlockHeader*>( allocator ? allocator->Allocate( bytes ) : ::operator new( bytes ) );
+	header->allocator = allocator;
+	return header + 1;
+}
+
+
+void XMLFreeBlock( void* block, size_t size )
+{
+	if ( !block )
+		return;
+
+	BlockHeader* header = static_cast<BlockHeader*>( block ) - 1;
+	if ( header->allocator )
+		header->allocator->Free( header, size + sizeof( BlockHeader ) );
+	else
+		::operator delete( header );
+}
+
+
+XMLAllocatorScope::XMLAllocatorScope( XMLAllocator* allocator ) : previous( current )
+{
+	current = allocator;
+}
+
+
+XMLAllocatorScope::~XMLAllocatorScope()
+{
+	current = previous;
+}
+
+
+XMLCountingAllocator::XMLCountingAllocator( XMLAllocator* _parent )
+	: parent( _parent ), allocations( 0 ), frees( 0 ), bytesAllocated( 0 ), liveBytes( 0 ), peakBytes( 0 )
+{
+}
+
+
+void* XMLCountingAllocator::Allocate( size_t size )
+{
+	void* block = parent ? parent->Allocate( size ) : ::operator new( size );
+
+	allocations += 1;
+	bytesAllocated += size;
+	size_t live = ( liveBytes += size );
+	#ifdef XML_THREADS
+	size_t peak = peakBytes.load();
+	while ( live > peak && !peakBytes.compare_exchange_weak( peak, live ) )
+		;
+	#else
+	if ( live > peakBytes )
+		peakBytes = live;
+	#endif
+	return block;
+}
+
+
+void XMLCountingAllocator::Free( void* block, size_t size )
+{
+	frees += 1;
+	liveBytes -= size;
+	if ( parent )
+		parent->Free( block, size );
+	else
+		::operator delete( block );
+}
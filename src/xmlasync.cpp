@@ -0,0 +1,358 @@
+#include "xmlparser.h"
+
+#ifdef XML_THREADS
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+FILE* XMLFOpen( const char* filename, const char* mode );
+
+// The library's executor: a fixed pool of threads, taking the tasks in
+// order. At exit, the tasks already given are run before the threads stop.
+class XMLDefaultExecutor : public XMLExecutor
+{
+public:
+	XMLDefaultExecutor( unsigned threads ) : stopping( false )
+	{
+		for ( unsigned i = 0; i < threads; ++i )
+			workers.push_back( std::thread( &XMLDefaultExecutor::Work, this ) );
+	}
+
+	~XMLDefaultExecutor()
+	{
+		{
+			std::lock_guard< std::mutex > lock( mutex );
+			stopping = true;
+		}
+		ready.notify_all();
+		for ( size_t i = 0; i < workers.size(); ++i )
+			workers[i].join();
+	}
+
+	virtual void Execute( std::function< void() > task )
+	{
+		{
+			std::lock_guard< std::mutex > lock( mutex );
+			tasks.push_back( std::move( task ) );
+		}
+		ready.notify_one();
+	}
+
+private:
+	void Work()
+	{
+		for ( ;; )
+		{
+			std::function< void() > task;
+			{
+				std::unique_lock< std::mutex > lock( mutex );
+				ready.wait( lock, [this] { return stopping || !tasks.empty(); } );
+				if ( tasks.empty() )
+					return;
+				task = std::move( tasks.front() );
+				tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	std::mutex								mutex;
+	std::condition_variable					ready;
+	std::deque< std::function< void() > >	tasks;
+	std::vector< std::thread >				workers;
+	bool									stopping;
+};
+
+
+XMLExecutor* XMLExecutor::Default()
+{
+	static XMLDefaultExecutor executor( std::max( 1u, std::thread::hardware_concurrency() ) );
+	return &executor;
+}
+
+
+// The feed of LoadFileOverlapped(): a thread reads the file into two blocks
+// in turn, and More() normalizes them onto the text, as LoadFile() does.
+// While the parse works on the text from one block, the next is read into
+// the other, so that the parse only waits for the disk when it is ahead.
+// A file of one block has nothing to overlap: the parse reads it itself.
+class XMLDocument::FileFeed : public XMLDocument::Feed
+{
+public:
+	// The parse may look a few bytes past the end of the text so far, as
+	// at a UTF-8 character cut in two there: they are kept 0, like the end.
+	static const size_t GUARD = 8;
+
+	// 'text' has room for 'length' bytes and the GUARD.
+	FileFeed( FILE* _file, size_t _length, char* text )
+		: file( _file ), length( _length ), blockSize( _length ), end( text ), pendingCR( false ), taken( 0 ), next( 0 ), failed( false ), stopping( false )
+	{
+		if ( blockSize > LOAD_BLOCK_SIZE )
+			blockSize = LOAD_BLOCK_SIZE;
+		memset( end, 0, GUARD );
+		for ( int i = 0; i < 2; ++i )
+		{
+			blocks[i] = 0;
+			sizes[i] = 0;
+			full[i] = false;
+		}
+		try
+		{
+			for ( int i = 0; i < 2; ++i )
+				blocks[i] = static_cast< char* >( XMLAllocateBlock( blockSize ) );
+			if ( length > blockSize )
+				reader = std::thread( &FileFeed::Read, this );
+		}
+		catch ( ... )
+		{
+			for ( int i = 0; i < 2; ++i )
+				XMLFreeBlock( blocks[i], blockSize );
+			throw;
+		}
+	}
+
+	~FileFeed()
+	{
+		{
+			std::lock_guard< std::mutex > lock( mutex );
+			stopping = true;
+		}
+		changed.notify_all();
+		if ( reader.joinable() )
+			reader.join();
+		for ( int i = 0; i < 2; ++i )
+			XMLFreeBlock( blocks[i], blockSize );
+	}
+
+	virtual bool More( const char* from )
+	{
+		const size_t had = end - from;
+		if ( !Next() )
+			return false;
+		while ( (size_t)( end - from ) < 2 * had && Next() )
+			;
+		return true;
+	}
+
+	// Whether a read failed: the text stops short of the file.
+	bool Failed() const		{ return failed; }
+
+private:
+	// Take the next block onto the text, waiting for it if it isn't read
+	// yet. Returns false at the end of the file, or if the read failed.
+	bool Next()
+	{
+		if ( taken == length || failed )
+			return false;
+
+		XML_STAT_CLOCK( readStart );
+		if ( reader.joinable() )
+		{
+			std::unique_lock< std::mutex > lock( mutex );
+			changed.wait( lock, [this] { return full[next]; } );
+		}
+		else
+		{
+			sizes[next] = fread( blocks[next], length, 1, file ) == 1 ? length : 0;
+		}
+		XML_STAT( readSeconds += XMLStatsTimer::Now() - readStart );
+		const size_t size = sizes[next];
+		if ( !size )
+		{
+			failed = true;
+			return false;
+		}
+
+		XML_STAT_CLOCK( normalizeStart );
+		end = NormalizeNewLines( end, blocks[next], size, &pendingCR );
+		memset( end, 0, GUARD );
+		XML_STAT( normalizeSeconds += XMLStatsTimer::Now() - normalizeStart );
+
+		{
+			std::lock_guard< std::mutex > lock( mutex );
+			full[next] = false;
+		}
+		changed.notify_all();
+		taken += size;
+		next ^= 1;
+		return true;
+	}
+
+	// The reader thread. A block is only touched by the thread that has
+	// it: this one while it isn't full, the parse's while it is.
+	void Read()
+	{
+		size_t done = 0;
+		for ( int i = 0; done < length; i ^= 1 )
+		{
+			{
+				std::unique_lock< std::mutex > lock( mutex );
+				changed.wait( lock, [this, i] { return stopping || !full[i]; } );
+				if ( stopping )
+					return;
+			}
+			size_t size = length - done;
+			if ( size > blockSize )
+				size = blockSize;
+			const bool read = fread( blocks[i], size, 1, file ) == 1;
+			{
+				std::lock_guard< std::mutex > lock( mutex );
+				sizes[i] = read ? size : 0;
+				full[i] = true;
+			}
+			changed.notify_all();
+			if ( !read )
+				return;
+			done += size;
+		}
+	}
+
+	FILE*		file;
+	size_t		length;
+	size_t		blockSize;	// LOAD_BLOCK_SIZE, or less for a smaller file.
+
+	// The parse's: the end of the text, the file bytes taken onto it, and
+	// the block to take next.
+	char*		end;
+	bool		pendingCR;
+	size_t		taken;
+	int			next;
+	bool		failed;
+
+	std::mutex					mutex;
+	std::condition_variable		changed;	// Signalled when a block is filled or emptied, or on stopping.
+	char*						blocks[2];
+	size_t						sizes[2];	// The bytes read into each block; 0 if the read failed.
+	bool						full[2];
+	bool						stopping;
+	std::thread					reader;
+};
+
+
+bool XMLDocument::LoadFileOverlapped( FILE* file, XMLEncoding encoding )
+{
+	// Get the file size, so we can pre-allocate the string. An empty file
+	// is LoadFile()'s to report.
+	fseek( file, 0, SEEK_END );
+	long length = ftell( file );
+	fseek( file, 0, SEEK_SET );
+	if ( length <= 0 )
+		return LoadFile( file, encoding );
+
+	#ifdef XML_STATS
+	// The statistics cover the whole load; Clear() and Parse() add to them.
+	XMLParseStats* collect = collectStats ? &stats : 0;
+	if ( collect )
+		collect->Clear();
+	XMLStatsScope statsScope( collect );
+	#endif
+	XMLAllocatorScope allocatorScope( allocator );
+
+	// Delete the existing data:
+	Clear();
+	location.Clear();
+
+	const size_t size = (size_t) length + FileFeed::GUARD;
+	char* buf = TakeReadBuffer( size );
+	bool failed = false;
+	try
+	{
+		FileFeed feed( file, (size_t) length, buf );
+		ParseDocument( buf, 0, encoding, &feed );
+		failed = feed.Failed();
+	}
+	catch ( ... )
+	{
+		GiveReadBuffer( buf, size );
+		throw;
+	}
+	GiveReadBuffer( buf, size );
+
+	// The parse saw the text up to where the read failed.
+	if ( failed )
+	{
+		Clear();
+		ClearError();
+		parseEncoding = ENCODING_UNKNOWN;
+		SetError( ERROR_OPENING_FILE, 0, 0, ENCODING_UNKNOWN );
+	}
+	return !Error();
+}
+
+
+bool XMLDocument::LoadFileTask( const char* filename, XMLEncoding encoding )
+{
+	// Nothing may be thrown on the executor's threads: an exception, most
+	// likely std::bad_alloc, fails the load instead.
+	int thrown = NO_ERROR;
+	try
+	{
+		value = filename;
+		FILE* file = XMLFOpen( value.c_str(), "rb" );
+		if ( !file )
+		{
+			SetError( ERROR_OPENING_FILE, 0, 0, ENCODING_UNKNOWN );
+			return false;
+		}
+		bool result = false;
+		try
+		{
+			result = LoadFileOverlapped( file, encoding );
+		}
+		catch ( ... )
+		{
+			fclose( file );
+			throw;
+		}
+		fclose( file );
+		return result;
+	}
+	catch ( const std::bad_alloc& )
+	{
+		thrown = ERROR_OUT_OF_MEMORY;
+	}
+	catch ( ... )
+	{
+		thrown = ERROR;
+	}
+	Clear();
+	ClearError();
+	parseEncoding = ENCODING_UNKNOWN;
+	SetError( thrown, 0, 0, ENCODING_UNKNOWN );
+	return false;
+}
+
+
+std::future< bool > XMLDocument::LoadFileAsync( const char* filename, XMLEncoding encoding, XMLExecutor* executor )
+{
+	// The name is copied: the caller's may be gone by the time the task runs.
+	XMLDocument* document = this;
+	std::string name( filename );
+	std::shared_ptr< std::packaged_task< bool() > > load = std::make_shared< std::packaged_task< bool() > >(
+		[document, name, encoding] { return document->LoadFileTask( name.c_str(), encoding ); } );
+	std::future< bool > result = load->get_future();
+
+	( executor ? executor : XMLExecutor::Default() )->Execute( [load] { ( *load )(); } );
+	return result;
+}
+
+
+void XMLDocument::LoadFileAsync( const char* filename, std::function< void( XMLDocument* document, bool loaded ) > done,
+								 XMLEncoding encoding, XMLExecutor* executor )
+{
+	XMLDocument* document = this;
+	std::string name( filename );
+	( executor ? executor : XMLExecutor::Default() )->Execute( [document, name, encoding, done]
+	{
+		bool loaded = document->LoadFileTask( name.c_str(), encoding );
+		done( document, loaded );
+	} );
+}
+
+#endif	// XML_THREADS
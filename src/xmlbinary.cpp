@@ -0,0 +1,638 @@
+#ifdef USE_STL
+
+#include "xmlbinary.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#if !defined( _WIN32 )
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+FILE* XMLFOpen( const char* filename, const char* mode );
+
+const uint32_t XMLBinaryImage::NONE;
+
+static bool Aligned( uint32_t offset )
+{
+	return ( offset & 3 ) == 0;
+}
+
+static bool NameBefore( const char* a, const char* b )
+{
+	return strcmp( a, b ) < 0;
+}
+
+
+// Collects the columns of the image in document order, then lays them out.
+class XMLBinaryImage::Writer
+{
+public:
+	Writer()
+	{
+		// Reference 4 is always the empty string.
+		uint32_t zero = 0;
+		strings.append( (const char*) &zero, 4 );
+		strings.append( (const char*) &zero, 4 );
+	}
+
+	void Write( const XMLDocument& document, uint32_t flags, std::string* out )
+	{
+		Frame frame;
+		frame.node = &document;
+		frame.index = AddNode( document, NONE );
+		frame.lastChild = NONE;
+
+		std::vector<Frame> stack;
+		const XMLNode* node = document.FirstChild();
+		if ( node )
+			stack.push_back( frame );
+		else
+			ends[0] = 1;
+
+		while ( node )
+		{
+			Frame& top = stack.back();
+			uint32_t index = AddNode( *node, top.index );
+			if ( top.lastChild != NONE )
+				prevs[index] = top.lastChild;
+			top.lastChild = index;
+
+			if ( node->FirstChild() )
+			{
+				frame.node = node;
+				frame.index = index;
+				frame.lastChild = NONE;
+				stack.push_back( frame );
+				node = node->FirstChild();
+				continue;
+			}
+			ends[index] = index+1;
+
+			// Close every subtree that ends here.
+			while ( node && !node->NextSibling() )
+			{
+				const Frame& done = stack.back();
+				ends[done.index] = (uint32_t) types.size();
+				prevs[done.index+1] = done.lastChild;
+				node = stack.size() > 1 ? done.node : 0;
+				stack.pop_back();
+			}
+			if ( node )
+				node = node->NextSibling();
+		}
+		attributeStarts.push_back( (uint32_t) attributeNames.size() );
+
+		Layout( document, flags, out );
+	}
+
+private:
+	// An open node, kept rather than found again with Parent(): below the
+	// nodes a clone still shares with a XMLSnapshot, that is the snapshot's.
+	struct Frame
+	{
+		const XMLNode* node;
+		uint32_t index;
+		uint32_t lastChild;
+	};
+
+	// Names repeat, and are written once; values are written as they come.
+	uint32_t AddName( const char* str, size_t length )
+	{
+		if ( length == 0 )
+			return 4;
+
+		std::string key( str, length );
+		std::map<std::string, uint32_t>::const_iterator it = names.find( key );
+		if ( it != names.end() )
+			return it->second;
+		uint32_t ref = AddString( str, length );
+		names[key] = ref;
+		return ref;
+	}
+
+	uint32_t AddName( const STRING& str )		{ return AddName( str.data(), str.size() ); }
+
+	uint32_t AddString( const char* str, size_t length )
+	{
+		if ( length == 0 )
+			return 4;
+
+		uint32_t length32 = (uint32_t) length;
+		strings.append( (const char*) &length32, 4 );
+		uint32_t ref = (uint32_t) strings.size();
+		strings.append( str, length );
+		strings.append( 4 - ( length & 3 ), '\0' );
+		return ref;
+	}
+
+	uint32_t AddString( const STRING& str )		{ return AddString( str.data(), str.size() ); }
+
+	void AddAttribute( uint32_t name, uint32_t value, int row, int col )
+	{
+		attributeNames.push_back( name );
+		attributeValues.push_back( value );
+		attributeRows.push_back( row );
+		attributeCols.push_back( col );
+	}
+
+	uint32_t AddNode( const XMLNode& node, uint32_t parent )
+	{
+		uint32_t index = (uint32_t) types.size();
+		uint8_t type = (uint8_t) node.Type();
+		if ( node.ToText() && node.ToText()->CDATA() )
+			type |= CDATA_FLAG;
+
+		types.push_back( type );
+		parents.push_back( parent );
+		ends.push_back( index+1 );
+		prevs.push_back( NONE );
+		values.push_back( node.ToElement() ? AddName( node.ValueTStr() ) : AddString( node.ValueTStr() ) );
+		rows.push_back( node.Row() - 1 );
+		cols.push_back( node.Column() - 1 );
+		attributeStarts.push_back( (uint32_t) attributeNames.size() );
+
+		if ( node.ToElement() )
+		{
+			for( const XMLAttribute* attrib = node.ToElement()->FirstAttribute(); attrib; attrib = attrib->Next() )
+				AddAttribute( AddName( attrib->NameTStr() ), AddString( attrib->ValueStr() ), attrib->Row() - 1, attrib->Column() - 1 );
+		}
+		else if ( node.ToDeclaration() )
+		{
+			const XMLDeclaration* decl = node.ToDeclaration();
+			AddAttribute( AddName( "version", 7 ), AddString( decl->Version(), strlen( decl->Version() ) ), -1, -1 );
+			AddAttribute( AddName( "encoding", 8 ), AddString( decl->Encoding(), strlen( decl->Encoding() ) ), -1, -1 );
+			AddAttribute( AddName( "standalone", 10 ), AddString( decl->Standalone(), strlen( decl->Standalone() ) ), -1, -1 );
+		}
+		return index;
+	}
+
+	template< class T >
+	static uint32_t Append( std::string* out, const std::vector<T>& column )
+	{
+		uint32_t offset = (uint32_t) out->size();
+		if ( !column.empty() )
+			out->append( (const char*) &column[0], column.size() * sizeof( T ) );
+		out->append( ( 4 - ( out->size() & 3 ) ) & 3, '\0' );
+		return offset;
+	}
+
+	void Layout( const XMLDocument& document, uint32_t flags, std::string* out )
+	{
+		Header h;
+		memset( &h, 0, sizeof( h ) );
+		memcpy( h.magic, "XMLB", 4 );
+		h.byteOrder = IMAGE_BYTE_ORDER;
+		h.version = VERSION;
+		h.flags = flags;
+		h.tabSize = document.TabSize();
+		h.nodeCount = (uint32_t) types.size();
+		h.attributeCount = (uint32_t) attributeNames.size();
+		h.stringSize = (uint32_t) strings.size();
+
+		out->clear();
+		out->reserve(   sizeof( Header ) + strings.size()
+					  + types.size() * ( 1 + 7*4 ) + attributeNames.size() * 4*4 + 16*4 );
+		out->append( sizeof( Header ), '\0' );
+
+		h.typeOffset = Append( out, types );
+		h.parentOffset = Append( out, parents );
+		h.endOffset = Append( out, ends );
+		h.prevOffset = Append( out, prevs );
+		h.valueOffset = Append( out, values );
+		h.rowOffset = Append( out, rows );
+		h.colOffset = Append( out, cols );
+		h.attributeStartOffset = Append( out, attributeStarts );
+		h.attributeNameOffset = Append( out, attributeNames );
+		h.attributeValueOffset = Append( out, attributeValues );
+		h.attributeRowOffset = Append( out, attributeRows );
+		h.attributeColOffset = Append( out, attributeCols );
+		h.stringOffset = (uint32_t) out->size();
+		out->append( strings );
+		h.size = (uint32_t) out->size();
+
+		memcpy( &(*out)[0], &h, sizeof( h ) );
+	}
+
+	std::vector<uint8_t>	types;
+	std::vector<uint32_t>	parents;
+	std::vector<uint32_t>	ends;
+	std::vector<uint32_t>	prevs;
+	std::vector<uint32_t>	values;
+	std::vector<int32_t>	rows;
+	std::vector<int32_t>	cols;
+	std::vector<uint32_t>	attributeStarts;
+	std::vector<uint32_t>	attributeNames;
+	std::vector<uint32_t>	attributeValues;
+	std::vector<int32_t>	attributeRows;
+	std::vector<int32_t>	attributeCols;
+	std::string				strings;
+	std::map<std::string, uint32_t>	names;
+};
+
+
+XMLBinaryImage::XMLBinaryImage()
+	: data( 0 ), size( 0 ), mapping( 0 ), mappingSize( 0 ), header( 0 )
+{
+}
+
+
+XMLBinaryImage::~XMLBinaryImage()
+{
+	Close();
+}
+
+
+void XMLBinaryImage::Close()
+{
+	#if !defined( _WIN32 )
+	if ( mapping )
+		munmap( mapping, mappingSize );
+	#endif
+	mapping = 0;
+	mappingSize = 0;
+	std::string().swap( buffer );
+	data = 0;
+	size = 0;
+	header = 0;
+}
+
+
+bool XMLBinaryImage::Open( const char* filename )
+{
+	Close();
+
+	#if !defined( _WIN32 )
+	int fd = open( filename, O_RDONLY );
+	if ( fd < 0 )
+		return false;
+
+	struct stat info;
+	if ( fstat( fd, &info ) == 0 && info.st_size >= (off_t) sizeof( Header ) )
+	{
+		void* p = mmap( 0, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if ( p != MAP_FAILED )
+		{
+			mapping = p;
+			mappingSize = (size_t) info.st_size;
+		}
+	}
+	close( fd );
+
+	if ( !mapping )
+		return false;
+	data = (const char*) mapping;
+	size = mappingSize;
+	#else
+	FILE* fp = XMLFOpen( filename, "rb" );
+	if ( !fp )
+		return false;
+	char block[ 64*1024 ];
+	size_t n;
+	while ( ( n = fread( block, 1, sizeof( block ), fp ) ) > 0 )
+		buffer.append( block, n );
+	fclose( fp );
+	data = buffer.data();
+	size = buffer.size();
+	#endif
+
+	if ( !Load() )
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+
+bool XMLBinaryImage::Attach( const void* _data, size_t _size )
+{
+	Close();
+	if ( !_data || ( (size_t) _data & 3 ) )
+		return false;
+
+	data = (const char*) _data;
+	size = _size;
+	if ( !Load() )
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+
+bool XMLBinaryImage::Build( const XMLDocument& document )
+{
+	Close();
+
+	Writer writer;
+	writer.Write( document, document.useMicrosoftBOM ? FLAG_BOM : 0, &buffer );
+	data = buffer.data();
+	size = buffer.size();
+	if ( !Load() )
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+
+bool XMLBinaryImage::Load()
+{
+	if ( size < sizeof( Header ) )
+		return false;
+
+	header = (const Header*) data;
+	if (    memcmp( header->magic, "XMLB", 4 ) != 0
+		 || header->byteOrder != IMAGE_BYTE_ORDER
+		 || header->version != VERSION
+		 || header->size != size
+		 || header->nodeCount == 0
+		 || header->nodeCount >= NONE
+		 || header->attributeCount >= NONE )
+	{
+		return false;
+	}
+
+	// Every column has to fit in the image.
+	const uint64_t n = header->nodeCount;
+	const uint64_t a = header->attributeCount;
+	struct { uint32_t offset; uint64_t bytes; } sections[] =
+	{
+		{ header->typeOffset,				n },
+		{ header->parentOffset,				n*4 },
+		{ header->endOffset,				n*4 },
+		{ header->prevOffset,				n*4 },
+		{ header->valueOffset,				n*4 },
+		{ header->rowOffset,				n*4 },
+		{ header->colOffset,				n*4 },
+		{ header->attributeStartOffset,		(n+1)*4 },
+		{ header->attributeNameOffset,		a*4 },
+		{ header->attributeValueOffset,		a*4 },
+		{ header->attributeRowOffset,		a*4 },
+		{ header->attributeColOffset,		a*4 },
+		{ header->stringOffset,				header->stringSize },
+	};
+	for( size_t i=0; i<sizeof( sections ) / sizeof( sections[0] ); ++i )
+	{
+		if (    !Aligned( sections[i].offset )
+			 || sections[i].offset < sizeof( Header )
+			 || sections[i].offset + sections[i].bytes > size )
+		{
+			return false;
+		}
+	}
+
+	types = (const uint8_t*)( data + header->typeOffset );
+	parents = (const uint32_t*)( data + header->parentOffset );
+	ends = (const uint32_t*)( data + header->endOffset );
+	prevs = (const uint32_t*)( data + header->prevOffset );
+	values = (const uint32_t*)( data + header->valueOffset );
+	rows = (const int32_t*)( data + header->rowOffset );
+	cols = (const int32_t*)( data + header->colOffset );
+	attributeStarts = (const uint32_t*)( data + header->attributeStartOffset );
+	attributeNames = (const uint32_t*)( data + header->attributeNameOffset );
+	attributeValues = (const uint32_t*)( data + header->attributeValueOffset );
+	attributeRows = (const int32_t*)( data + header->attributeRowOffset );
+	attributeCols = (const int32_t*)( data + header->attributeColOffset );
+	strings = data + header->stringOffset;
+
+	return Validate();
+}
+
+
+bool XMLBinaryImage::ValidString( uint32_t ref ) const
+{
+	if ( ref < 4 || !Aligned( ref ) || ref > header->stringSize )
+		return false;
+	uint64_t end = (uint64_t) ref + StringLength( ref );
+	return end < header->stringSize && strings[end] == 0;
+}
+
+
+// Check that the tables describe a tree, so that none of the navigation
+// functions can step outside the image.
+bool XMLBinaryImage::Validate() const
+{
+	const uint32_t n = header->nodeCount;
+
+	if (    Type( 0 ) != XMLNode::TINYXML_DOCUMENT
+		 || parents[0] != NONE
+		 || ends[0] != n
+		 || attributeStarts[0] != 0
+		 || attributeStarts[n] != header->attributeCount )
+	{
+		return false;
+	}
+
+	// The stack holds the open ancestors of node i, and their last child so far.
+	std::vector<uint32_t> open( 1, 0 );
+	std::vector<uint32_t> lastChild( 1, NONE );
+
+	for( uint32_t i=0; i<n; ++i )
+	{
+		if ( i > 0 )
+		{
+			while ( ends[open.back()] <= i )
+			{
+				uint32_t done = open.back();
+				if ( ends[done] > done+1 && prevs[done+1] != lastChild.back() )
+					return false;
+				open.pop_back();
+				lastChild.pop_back();
+			}
+
+			uint32_t parent = open.back();
+			if (    Type( i ) == XMLNode::TINYXML_DOCUMENT
+				 || parents[i] != parent
+				 || ends[i] <= i
+				 || ends[i] > ends[parent]
+				 || ( i != parent+1 && prevs[i] != lastChild.back() ) )
+			{
+				return false;
+			}
+			lastChild.back() = i;
+			open.push_back( i );
+			lastChild.push_back( NONE );
+		}
+
+		if ( Type( i ) >= XMLNode::TINYXML_TYPECOUNT || !ValidString( values[i] ) )
+			return false;
+
+		uint32_t first = attributeStarts[i];
+		uint32_t end = attributeStarts[i+1];
+		if ( end < first || end > header->attributeCount )
+			return false;
+		if ( Type( i ) == XMLNode::TINYXML_DECLARATION ? end - first != 3
+													   : Type( i ) != XMLNode::TINYXML_ELEMENT && end != first )
+		{
+			return false;
+		}
+	}
+	while ( !open.empty() )
+	{
+		uint32_t done = open.back();
+		if ( ends[done] > done+1 && prevs[done+1] != lastChild.back() )
+			return false;
+		open.pop_back();
+		lastChild.pop_back();
+	}
+
+	for( uint32_t i=0; i<header->attributeCount; ++i )
+	{
+		if ( !ValidString( attributeNames[i] ) || !ValidString( attributeValues[i] ) )
+			return false;
+	}
+
+	// No element has two attributes of the same name: XMLAttributeSet
+	// holds one of each.
+	std::vector<const char*> names;
+	for( uint32_t i=0; i<n; ++i )
+	{
+		if ( Type( i ) != XMLNode::TINYXML_ELEMENT || attributeStarts[i+1] - attributeStarts[i] < 2 )
+			continue;
+		names.clear();
+		for( uint32_t attrib = attributeStarts[i]; attrib != attributeStarts[i+1]; ++attrib )
+			names.push_back( AttributeName( attrib ) );
+		std::sort( names.begin(), names.end(), NameBefore );
+		for( size_t k=1; k<names.size(); ++k )
+		{
+			if ( strcmp( names[k-1], names[k] ) == 0 )
+				return false;
+		}
+	}
+	return true;
+}
+
+
+bool XMLDocument::SaveBinary( FILE* fp ) const
+{
+	XMLBinaryImage image;
+	if ( !fp || !image.Build( *this ) )
+		return false;
+	return fwrite( image.Data(), 1, image.Size(), fp ) == image.Size();
+}
+
+
+bool XMLDocument::SaveBinary( const char* filename ) const
+{
+	FILE* fp = XMLFOpen( filename, "wb" );
+	if ( fp )
+	{
+		bool result = SaveBinary( fp );
+		if ( fclose( fp ) != 0 )
+			result = false;
+		return result;
+	}
+	return false;
+}
+
+
+bool XMLDocument::LoadBinary( const char* filename )
+{
+	XMLBinaryImage image;
+	if ( !image.Open( filename ) )
+	{
+		// Tell a missing file from a bad one.
+		FILE* fp = XMLFOpen( filename, "rb" );
+		if ( fp )
+			fclose( fp );
+		Clear();
+		ClearError();
+		SetError( fp ? ERROR_BINARY_IMAGE : ERROR_OPENING_FILE, 0, 0, ENCODING_UNKNOWN );
+		return false;
+	}
+	return LoadBinary( image );
+}
+
+
+bool XMLDocument::LoadBinary( const XMLBinaryImage& image )
+{
+	XMLAllocatorScope allocatorScope( allocator );
+	Clear();
+	ClearError();
+	location.Clear();
+
+	if ( !image.IsOpen() )
+	{
+		SetError( ERROR_BINARY_IMAGE, 0, 0, ENCODING_UNKNOWN );
+		return false;
+	}
+
+	const uint32_t n = image.NodeCount();
+	value.assign( image.Value( 0 ), image.ValueLength( 0 ) );
+	location.row = image.Row( 0 );
+	location.col = image.Column( 0 );
+	tabsize = image.TabSize();
+	useMicrosoftBOM = image.UsesMicrosoftBOM();
+
+	// Nodes come in document order, so every parent exists before its children.
+	std::vector<XMLNode*> nodes( n );
+	nodes[0] = this;
+	for( uint32_t i=1; i<n; ++i )
+	{
+		XMLNode* node = 0;
+		uint32_t attrib = image.FirstAttribute( i );
+
+		switch ( image.Type( i ) )
+		{
+			case TINYXML_ELEMENT:
+			{
+				XMLElement* element = new XMLElement( "" );
+				for( ; attrib != image.AttributeEnd( i ); ++attrib )
+				{
+					XMLAttribute* attribute = new XMLAttribute();
+					attribute->SetName( std::string( image.AttributeName( attrib ), image.AttributeNameLength( attrib ) ) );
+					attribute->SetValue( std::string( image.AttributeValue( attrib ), image.AttributeValueLength( attrib ) ) );
+					attribute->location.row = image.AttributeRow( attrib );
+					attribute->location.col = image.AttributeColumn( attrib );
+					element->attributeSet.Add( attribute );
+				}
+				node = element;
+				break;
+			}
+			case TINYXML_COMMENT:
+				node = new XMLComment();
+				break;
+			case TINYXML_UNKNOWN:
+				node = new XMLUnknown();
+				break;
+			case TINYXML_TEXT:
+			{
+				XMLText* text = new XMLText( "" );
+				text->SetCDATA( image.CDATA( i ) );
+				node = text;
+				break;
+			}
+			case TINYXML_DECLARATION:
+				node = new XMLDeclaration( std::string( image.AttributeValue( attrib ), image.AttributeValueLength( attrib ) ),
+										   std::string( image.AttributeValue( attrib+1 ), image.AttributeValueLength( attrib+1 ) ),
+										   std::string( image.AttributeValue( attrib+2 ), image.AttributeValueLength( attrib+2 ) ) );
+				break;
+			default:
+				// Validate() lets no other type through.
+				break;
+		}
+		if ( !node )
+		{
+			Clear();
+			SetError( ERROR_BINARY_IMAGE, 0, 0, ENCODING_UNKNOWN );
+			return false;
+		}
+
+		node->value.assign( image.Value( i ), image.ValueLength( i ) );
+		node->location.row = image.Row( i );
+		node->location.col = image.Column( i );
+		nodes[ image.Parent( i ) ]->LinkEndChild( node );
+		nodes[i] = node;
+	}
+	return true;
+}
+
+#endif	// USE_STL
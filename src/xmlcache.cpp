@@ -0,0 +1,263 @@
+#include "xmlcache.h"
+
+#ifdef XML_THREADS
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "xmlmemory.h"
+
+const size_t XMLDocumentCache::DEFAULT_MAX_BYTES;
+
+
+// What the system says of a file: if any of it changed, so may have the file.
+struct XMLDocumentCache::Identity
+{
+	unsigned long long device;
+	unsigned long long inode;
+	unsigned long long size;
+	unsigned long long modified;	// In nanoseconds, where the system has them.
+
+	bool operator==( const Identity& rhs ) const
+	{
+		return device == rhs.device && inode == rhs.inode && size == rhs.size && modified == rhs.modified;
+	}
+};
+
+
+// A file in the cache: its document, or a load of it under way.
+struct XMLDocumentCache::Entry
+{
+	Entry() : ready( false ), bytes( 0 ), cached( false ) {}
+
+	std::string				filename;
+	Identity				identity;
+	bool					ready;		// The load is over: 'snapshot' is set.
+	XMLSnapshot				snapshot;
+	size_t					bytes;
+	bool					cached;		// In 'recent', at 'position'.
+	EntryList::iterator		position;
+};
+
+
+bool XMLDocumentCache::GetIdentity( const char* filename, Identity* identity )
+{
+	#if defined( _WIN32 )
+	struct _stat64 info;
+	if ( _stat64( filename, &info ) != 0 )
+		return false;
+	identity->inode = 0;		// No inodes: the name, size and time have to do.
+	identity->modified = info.st_mtime;
+	#else
+	struct stat info;
+	if ( stat( filename, &info ) != 0 )
+		return false;
+	identity->inode = info.st_ino;
+	#if defined( __APPLE__ )
+	identity->modified = info.st_mtimespec.tv_sec * 1000000000ULL + info.st_mtimespec.tv_nsec;
+	#else
+	identity->modified = info.st_mtim.tv_sec * 1000000000ULL + info.st_mtim.tv_nsec;
+	#endif
+	#endif
+	identity->device = info.st_dev;
+	identity->size = info.st_size;
+	return true;
+}
+
+
+XMLDocumentCache::XMLDocumentCache( size_t _maxBytes )
+{
+	maxBytes = _maxBytes;
+}
+
+
+XMLDocumentCache::~XMLDocumentCache()
+{
+	Clear();
+}
+
+
+XMLDocumentCache& XMLDocumentCache::Shared()
+{
+	static XMLDocumentCache cache;
+	return cache;
+}
+
+
+XMLSnapshot XMLDocumentCache::Load( const char* filename, XMLEncoding encoding )
+{
+	Identity identity;
+	if ( !GetIdentity( filename, &identity ) )
+	{
+		// Missing or unreadable: LoadFile() says why. A copy cached under
+		// that name is gone with the file.
+		XMLSnapshot failed = XMLSnapshot::LoadFile( filename, encoding );
+		std::lock_guard< std::mutex > lock( mutex );
+		EntryMap::iterator found = entries.find( filename );
+		if ( found != entries.end() )
+			Drop( found->second, false );
+		++stats.misses;
+		if ( failed.Error() )
+			++stats.errors;
+		return failed;
+	}
+	std::unique_lock< std::mutex > lock( mutex );
+	EntryMap::iterator found = entries.find( filename );
+	if ( found != entries.end() )
+	{
+		EntryPtr entry = found->second;
+		if ( entry->identity == identity )
+		{
+			if ( entry->ready )
+			{
+				++stats.hits;
+				recent.splice( recent.begin(), recent, entry->position );
+				return entry->snapshot;
+			}
+			// Another thread is parsing the same file: wait for its document.
+			++stats.joins;
+			loaded.wait( lock, [&entry] { return entry->ready; } );
+			return entry->snapshot;
+		}
+		// The file changed. A load of the old one still under way is left
+		// to finish on its own; it won't be kept.
+		Drop( entry, false );
+	}
+
+	EntryPtr entry = std::make_shared< Entry >();
+	entry->filename = filename;
+	entry->identity = identity;
+	entries[ entry->filename ] = entry;
+	++stats.misses;
+	lock.unlock();
+
+	XMLSnapshot snapshot;
+	size_t bytes = 0;
+	try
+	{
+		snapshot = XMLSnapshot::LoadFile( filename, encoding );
+		if ( !snapshot.Error() )
+			bytes = snapshot->MemoryUsage().TotalBytes();
+	}
+	catch ( ... )
+	{
+		// Release the waiters, with an empty snapshot, before passing it on.
+		lock.lock();
+		entry->ready = true;
+		Drop( entry, false );
+		lock.unlock();
+		loaded.notify_all();
+		throw;
+	}
+
+	lock.lock();
+	entry->snapshot = snapshot;
+	entry->bytes = bytes;
+	entry->ready = true;
+	found = entries.find( entry->filename );
+	bool current = found != entries.end() && found->second == entry;
+	if ( snapshot.Error() )
+		++stats.errors;
+	if ( current && !snapshot.Error() && bytes <= maxBytes )
+	{
+		recent.push_front( entry );
+		entry->position = recent.begin();
+		entry->cached = true;
+		++stats.documents;
+		stats.bytes += bytes;
+		Trim();
+	}
+	else if ( current )
+	{
+		entries.erase( found );
+	}
+	lock.unlock();
+	loaded.notify_all();
+	return snapshot;
+}
+
+
+void XMLDocumentCache::Drop( const EntryPtr& entry, bool evicted )
+{
+	if ( entry->cached )
+	{
+		recent.erase( entry->position );
+		entry->cached = false;
+		--stats.documents;
+		stats.bytes -= entry->bytes;
+		if ( evicted )
+			++stats.evictions;
+	}
+	EntryMap::iterator found = entries.find( entry->filename );
+	if ( found != entries.end() && found->second == entry )
+		entries.erase( found );
+}
+
+
+void XMLDocumentCache::Trim()
+{
+	while ( stats.bytes > maxBytes && !recent.empty() )
+	{
+		// Copied: Drop() erases the list's own reference.
+		EntryPtr oldest = recent.back();
+		Drop( oldest, true );
+	}
+}
+
+
+void XMLDocumentCache::Remove( const char* filename )
+{
+	std::lock_guard< std::mutex > lock( mutex );
+	EntryMap::iterator found = entries.find( filename );
+	if ( found != entries.end() )
+	{
+		EntryPtr entry = found->second;
+		Drop( entry, false );
+	}
+}
+
+
+void XMLDocumentCache::Clear()
+{
+	std::lock_guard< std::mutex > lock( mutex );
+	for ( EntryList::iterator it = recent.begin(); it != recent.end(); ++it )
+		( *it )->cached = false;
+	recent.clear();
+	entries.clear();
+	stats.documents = 0;
+	stats.bytes = 0;
+}
+
+
+void XMLDocumentCache::SetMaxBytes( size_t _maxBytes )
+{
+	std::lock_guard< std::mutex > lock( mutex );
+	maxBytes = _maxBytes;
+	Trim();
+}
+
+
+size_t XMLDocumentCache::MaxBytes() const
+{
+	std::lock_guard< std::mutex > lock( mutex );
+	return maxBytes;
+}
+
+
+XMLDocumentCache::Stats XMLDocumentCache::GetStats() const
+{
+	std::lock_guard< std::mutex > lock( mutex );
+	return stats;
+}
+
+
+void XMLDocumentCache::ResetStats()
+{
+	std::lock_guard< std::mutex > lock( mutex );
+	Stats counts;
+	counts.documents = stats.documents;
+	counts.bytes = stats.bytes;
+	stats = counts;
+}
+
+#endif	// XML_THREADS
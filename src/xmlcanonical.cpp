@@ -0,0 +1,453 @@
+#include "xmlparser.h"
+
+#include <algorithm>
+#include <limits.h>
+
+// The namespace of the "xml" prefix, which is bound without a declaration.
+static const char XML_NAMESPACE[] = "http://www.w3.org/XML/1998/namespace";
+
+
+// A namespace declaration in scope: the attribute, and the element depth it is on.
+struct XMLCanonicalPrinter::Binding
+{
+	const XMLAttribute*	attribute;
+	const char*			prefix;			// Empty for the default namespace.
+	size_t				prefixLength;
+	int					depth;
+};
+
+
+// An attribute to write, with what it is sorted by.
+struct XMLCanonicalPrinter::Entry
+{
+	const XMLAttribute*	attribute;
+	bool				declaration;	// A namespace declaration, sorted by prefix before the others.
+	const char*			uri;			// The namespace of the attribute, empty for none.
+	size_t				uriLength;
+	const char*			local;			// The name without the prefix.
+	size_t				localLength;
+};
+
+
+// The order of two strings by code point, which for UTF-8 is the order of their bytes.
+static int Compare( const char* a, size_t aLength, const char* b, size_t bLength )
+{
+	int result = memcmp( a, b, aLength < bLength ? aLength : bLength );
+	if ( result )
+		return result;
+	return aLength < bLength ? -1 : ( aLength > bLength ? 1 : 0 );
+}
+
+
+bool XMLCanonicalPrinter::Before( const Entry& a, const Entry& b )
+{
+	if ( a.declaration != b.declaration )
+		return a.declaration;
+	if ( !a.declaration )
+	{
+		int uri = Compare( a.uri, a.uriLength, b.uri, b.uriLength );
+		if ( uri )
+			return uri < 0;
+	}
+	return Compare( a.local, a.localLength, b.local, b.localLength ) < 0;
+}
+
+
+static bool IsSpace( char c )
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+
+// If 'name' declares a namespace, set its prefix and return true.
+static bool IsDeclaration( const STRING& name, const char** prefix, size_t* length )
+{
+	if ( name.length() < 5 || memcmp( name.data(), "xmlns", 5 ) != 0 )
+		return false;
+	if ( name.length() == 5 )
+	{
+		*prefix = name.data() + 5;
+		*length = 0;
+		return true;
+	}
+	if ( name[5] != ':' )
+		return false;
+	*prefix = name.data() + 6;
+	*length = name.length() - 6;
+	return true;
+}
+
+
+XMLCanonicalPrinter::XMLCanonicalPrinter( XMLWriteCallback _callback, void* _userData, size_t _bufferSize )
+	: callback( _callback ), userData( _userData ), file( 0 )
+{
+	Init( _bufferSize );
+}
+
+
+XMLCanonicalPrinter::XMLCanonicalPrinter( FILE* _file, size_t _bufferSize )
+	: callback( 0 ), userData( 0 ), file( _file )
+{
+	Init( _bufferSize );
+}
+
+
+void XMLCanonicalPrinter::Init( size_t _bufferSize )
+{
+	bufferSize = _bufferSize ? _bufferSize : 1;
+	buffer = new char[ bufferSize ];
+	used = 0;
+	bytesWritten = 0;
+	error = false;
+	withComments = false;
+	afterRoot = false;
+	depth = 0;
+	bindings = 0;
+	bindingCount = 0;
+	bindingCapacity = 0;
+	entries = 0;
+	entryCount = 0;
+	entryCapacity = 0;
+}
+
+
+XMLCanonicalPrinter::~XMLCanonicalPrinter()
+{
+	Flush();
+	delete [] buffer;
+	delete [] bindings;
+	delete [] entries;
+}
+
+
+bool XMLCanonicalPrinter::Drain( const char* data, size_t size )
+{
+	if ( error )
+		return false;
+
+	XML_TRACE_FLUSH( size );
+	size_t written = 0;
+	if ( file )
+		written = fwrite( data, 1, size, file );
+	else if ( callback )
+		written = callback( data, size, userData );
+
+	bytesWritten += written;
+	if ( written != size )
+		error = true;
+	return !error;
+}
+
+
+bool XMLCanonicalPrinter::Flush()
+{
+	if ( used )
+	{
+		Drain( buffer, used );
+		used = 0;
+	}
+	if ( file && fflush( file ) != 0 )
+		error = true;
+	return !error;
+}
+
+
+void XMLCanonicalPrinter::WriteLarge( const char* data, size_t size )
+{
+	if ( used )
+	{
+		Drain( buffer, used );
+		used = 0;
+	}
+	if ( size > bufferSize )
+	{
+		Drain( data, size );
+		return;
+	}
+	memcpy( buffer, data, size );
+	used = size;
+}
+
+
+void XMLCanonicalPrinter::WriteEscaped( const STRING& str, bool attribute )
+{
+	const char* run = str.data();
+	const char* end = run + str.length();
+	for ( const char* p = run; p < end; ++p )
+	{
+		const char* escape;
+		switch ( *p )
+		{
+			case '&':	escape = "&amp;";								break;
+			case '<':	escape = "&lt;";								break;
+			case '>':	escape = attribute ? 0 : "&gt;";				break;
+			case '"':	escape = attribute ? "&quot;" : 0;				break;
+			case '\t':	escape = attribute ? "&#x9;" : 0;				break;
+			case '\n':	escape = attribute ? "&#xA;" : 0;				break;
+			case '\r':	escape = "&#xD;";								break;
+			default:	escape = 0;										break;
+		}
+		if ( escape )
+		{
+			Write( run, p - run );
+			Write( escape );
+			run = p + 1;
+		}
+	}
+	Write( run, end - run );
+}
+
+
+void XMLCanonicalPrinter::BeginTopLevel()
+{
+	if ( depth == 0 && afterRoot )
+		Write( "\n", 1 );
+}
+
+
+void XMLCanonicalPrinter::EndTopLevel()
+{
+	if ( depth == 0 && !afterRoot )
+		Write( "\n", 1 );
+}
+
+
+const XMLCanonicalPrinter::Binding* XMLCanonicalPrinter::Lookup( const char* prefix, size_t length, int below ) const
+{
+	for ( size_t i=bindingCount; i-- > 0; )
+	{
+		const Binding& binding = bindings[i];
+		if ( binding.depth < below && binding.prefixLength == length && memcmp( binding.prefix, prefix, length ) == 0 )
+			return &binding;
+	}
+	return 0;
+}
+
+
+void XMLCanonicalPrinter::Bind( const XMLAttribute* attribute, int at )
+{
+	if ( bindingCount == bindingCapacity )
+	{
+		bindingCapacity = bindingCapacity ? bindingCapacity * 2 : 16;
+		Binding* grown = new Binding[ bindingCapacity ];
+		for ( size_t i=0; i<bindingCount; ++i )
+			grown[i] = bindings[i];
+		delete [] bindings;
+		bindings = grown;
+	}
+	Binding& binding = bindings[ bindingCount++ ];
+	binding.attribute = attribute;
+	IsDeclaration( attribute->NameTStr(), &binding.prefix, &binding.prefixLength );
+	binding.depth = at;
+}
+
+
+XMLCanonicalPrinter::Entry* XMLCanonicalPrinter::AddEntry()
+{
+	if ( entryCount == entryCapacity )
+	{
+		entryCapacity = entryCapacity ? entryCapacity * 2 : 16;
+		Entry* grown = new Entry[ entryCapacity ];
+		for ( size_t i=0; i<entryCount; ++i )
+			grown[i] = entries[i];
+		delete [] entries;
+		entries = grown;
+	}
+	return &entries[ entryCount++ ];
+}
+
+
+bool XMLCanonicalPrinter::VisitEnter( const XMLDocument& )
+{
+	depth = 0;
+	afterRoot = false;
+	bindingCount = 0;
+	return true;
+}
+
+
+bool XMLCanonicalPrinter::VisitExit( const XMLDocument& )
+{
+	Flush();
+	return true;
+}
+
+
+bool XMLCanonicalPrinter::VisitEnter( const XMLElement& element, const XMLAttribute* firstAttribute )
+{
+	const int at = ++depth;
+	entryCount = 0;
+
+	// The namespace declarations first: they are in scope for the names of the attributes.
+	const char* prefix;
+	size_t length;
+	for ( const XMLAttribute* attribute = firstAttribute; attribute; attribute = attribute->Next() )
+	{
+		if ( !IsDeclaration( attribute->NameTStr(), &prefix, &length ) )
+			continue;
+
+		// Written unless the element above has the same in scope.
+		const Binding* above = Lookup( prefix, length, at );
+		const STRING& uri = attribute->ValueTStr();
+		bool superfluous = above ? above->attribute->ValueTStr() == uri : uri.empty();
+		Bind( attribute, at );
+		if ( !superfluous )
+		{
+			Entry* entry = AddEntry();
+			entry->attribute = attribute;
+			entry->declaration = true;
+			entry->local = prefix;
+			entry->localLength = length;
+		}
+	}
+
+	// The top element of a subtree gets the declarations in scope of it, the nearest first.
+	if ( at == 1 && element.Parent() && element.Parent()->ToElement() )
+	{
+		for ( const XMLNode* node = element.Parent(); node && node->ToElement(); node = node->Parent() )
+		{
+			for ( const XMLAttribute* attribute = node->ToElement()->FirstAttribute(); attribute; attribute = attribute->Next() )
+			{
+				if ( !IsDeclaration( attribute->NameTStr(), &prefix, &length ) || Lookup( prefix, length, INT_MAX ) )
+					continue;
+				Bind( attribute, at );
+				if ( !( length == 0 && attribute->ValueTStr().empty() ) )
+				{
+					Entry* entry = AddEntry();
+					entry->attribute = attribute;
+					entry->declaration = true;
+					entry->local = prefix;
+					entry->localLength = length;
+				}
+			}
+		}
+	}
+
+	for ( const XMLAttribute* attribute = firstAttribute; attribute; attribute = attribute->Next() )
+	{
+		const STRING& name = attribute->NameTStr();
+		if ( IsDeclaration( name, &prefix, &length ) )
+			continue;
+
+		Entry* entry = AddEntry();
+		entry->attribute = attribute;
+		entry->declaration = false;
+		entry->uri = "";
+		entry->uriLength = 0;
+		entry->local = name.data();
+		entry->localLength = name.length();
+
+		const char* colon = (const char*) memchr( name.data(), ':', name.length() );
+		if ( colon )
+		{
+			length = colon - name.data();
+			entry->local = colon + 1;
+			entry->localLength = name.length() - length - 1;
+			const Binding* binding = Lookup( name.data(), length, INT_MAX );
+			if ( length == 3 && memcmp( name.data(), "xml", 3 ) == 0 )
+			{
+				entry->uri = XML_NAMESPACE;
+				entry->uriLength = sizeof( XML_NAMESPACE ) - 1;
+			}
+			else if ( binding )
+			{
+				entry->uri = binding->attribute->ValueTStr().data();
+				entry->uriLength = binding->attribute->ValueTStr().length();
+			}
+			else
+			{
+				// An undeclared prefix: the document isn't namespace well-formed. Sort by the prefix.
+				entry->uri = name.data();
+				entry->uriLength = length;
+			}
+		}
+	}
+
+	std::sort( entries, entries + entryCount, Before );
+
+	Write( "<", 1 );
+	Write( element.ValueTStr() );
+	for ( size_t i=0; i<entryCount; ++i )
+	{
+		Write( " ", 1 );
+		Write( entries[i].attribute->NameTStr() );
+		Write( "=\"", 2 );
+		WriteEscaped( entries[i].attribute->ValueTStr(), true );
+		Write( "\"", 1 );
+	}
+	Write( ">", 1 );
+	return true;
+}
+
+
+bool XMLCanonicalPrinter::VisitExit( const XMLElement& element )
+{
+	Write( "</", 2 );
+	Write( element.ValueTStr() );
+	Write( ">", 1 );
+
+	while ( bindingCount && bindings[ bindingCount-1 ].depth == depth )
+		bindingCount--;
+	if ( --depth == 0 )
+		afterRoot = true;
+	return true;
+}
+
+
+bool XMLCanonicalPrinter::Visit( const XMLDeclaration& )
+{
+	return true;
+}
+
+
+bool XMLCanonicalPrinter::Visit( const XMLText& text )
+{
+	// CDATA sections are text like any other.
+	WriteEscaped( text.ValueTStr(), false );
+	return true;
+}
+
+
+bool XMLCanonicalPrinter::Visit( const XMLComment& comment )
+{
+	if ( withComments )
+	{
+		BeginTopLevel();
+		Write( "<!--", 4 );
+		Write( comment.ValueTStr() );
+		Write( "-->", 3 );
+		EndTopLevel();
+	}
+	return true;
+}
+
+
+bool XMLCanonicalPrinter::Visit( const XMLUnknown& unknown )
+{
+	// Processing instructions are kept, with a single space between the
+	// target and the data. The rest (the DTD) is left out.
+	const STRING& value = unknown.ValueTStr();
+	if ( value.length() < 2 || value[0] != '?' || value[ value.length()-1 ] != '?' )
+		return true;
+
+	const char* p = value.data() + 1;
+	const char* end = value.data() + value.length() - 1;
+	const char* target = p;
+	while ( p < end && !IsSpace( *p ) )
+		++p;
+	const char* targetEnd = p;
+	while ( p < end && IsSpace( *p ) )
+		++p;
+
+	BeginTopLevel();
+	Write( "<?", 2 );
+	Write( target, targetEnd - target );
+	if ( p < end )
+	{
+		Write( " ", 1 );
+		Write( p, end - p );
+	}
+	Write( "?>", 2 );
+	EndTopLevel();
+	return true;
+}
@@ -0,0 +1,668 @@
+#ifdef USE_STL
+
+#include "xmldiff.h"
+
+#include <algorithm>
+
+typedef unsigned long long	HashValue;
+
+static const size_t NO_PATH = (size_t) -1;
+
+
+// The positions of the hashes in a list of children, sorted by hash then
+// position, to find whether a hash is still ahead in the list. A sorted
+// vector rather than a map: it is filled once, and the lists can be long.
+class HashPositions
+{
+public:
+	void Clear()									{ positions.clear(); }
+	void Add( const XMLFingerprint& hash, size_t position )	{ Position entry = { hash, position }; positions.push_back( entry ); }
+	void Sort()										{ std::sort( positions.begin(), positions.end(), Less ); }
+
+	// Returns true if 'hash' is at 'position' or after.
+	bool Ahead( const XMLFingerprint& hash, size_t position ) const
+	{
+		Position key = { hash, position };
+		std::vector< Position >::const_iterator it = std::lower_bound( positions.begin(), positions.end(), key, Less );
+		return it != positions.end() && it->hash == hash;
+	}
+
+private:
+	struct Position
+	{
+		XMLFingerprint	hash;
+		size_t			position;
+	};
+
+	static bool Less( const Position& a, const Position& b )
+	{
+		return a.hash < b.hash || ( a.hash == b.hash && a.position < b.position );
+	}
+
+	std::vector< Position > positions;
+};
+
+
+/*	The diff of two documents. The pairs of nodes to compare are kept on a
+	stack rather than recursed into. A pair is only pushed once the children
+	of its parents are all edited, so every path an edit is given holds in
+	the document as the edits before it left it. The paths of the pairs
+	are kept as a tree of steps, and only written out for the edits.
+*/
+class XMLDiff::Differ
+{
+public:
+	Differ( XMLDiff* _diff ) : diff( _diff ) {}
+
+	void Run( const XMLDocument& from, const XMLDocument& to )
+	{
+		diff->sourceHash = XMLDiff::Hash( from );
+		diff->targetHash = XMLDiff::Hash( to );
+
+		Pair root = { &from, &to, NO_PATH };
+		pending.push_back( root );
+		while ( !pending.empty() )
+		{
+			Pair pair = pending.back();
+			pending.pop_back();
+			if ( pair.from->ToElement() )
+				DiffAttributes( pair );
+			DiffChildren( pair );
+		}
+	}
+
+private:
+	// Two nodes to diff, at 'path'.
+	struct Pair
+	{
+		const XMLNode* from;
+		const XMLNode* to;
+		size_t path;
+	};
+
+	// A step of a path: the child index, under the step 'parent'.
+	struct Step
+	{
+		size_t parent;
+		size_t index;
+	};
+
+	// A child, and the fingerprint of its subtree.
+	struct Child
+	{
+		const XMLNode* node;
+		XMLFingerprint hash;
+	};
+
+	// The path of the child 'index' of the node at 'path'.
+	std::vector< size_t > Path( size_t path, size_t index ) const
+	{
+		std::vector< size_t > out;
+		out.push_back( index );
+		for ( ; path != NO_PATH; path = steps[path].parent )
+			out.push_back( steps[path].index );
+		return std::vector< size_t >( out.rbegin(), out.rend() );
+	}
+
+	// The path of the node at 'path'.
+	std::vector< size_t > Path( size_t path ) const
+	{
+		return Path( steps[path].parent, steps[path].index );
+	}
+
+	// The fingerprints were all computed by Run(), so this only reads them.
+	static void Children( const XMLNode* node, std::vector< Child >* out )
+	{
+		out->clear();
+		for ( const XMLNode* child = node->FirstChild(); child; child = child->NextSibling() )
+		{
+			Child entry = { child, child->Fingerprint() };
+			out->push_back( entry );
+		}
+	}
+
+	void DiffAttributes( const Pair& pair )
+	{
+		const XMLElement* from = pair.from->ToElement();
+		const XMLElement* to = pair.to->ToElement();
+		for ( const XMLAttribute* attribute = to->FirstAttribute(); attribute; attribute = attribute->Next() )
+		{
+			const std::string* value = from->Attribute( attribute->NameTStr() );
+			if ( !value || *value != attribute->ValueStr() )
+			{
+				Edit* edit = diff->AddEdit( SET_ATTRIBUTE, Path( pair.path ) );
+				edit->name = attribute->NameTStr();
+				edit->value = attribute->ValueStr();
+			}
+		}
+		for ( const XMLAttribute* attribute = from->FirstAttribute(); attribute; attribute = attribute->Next() )
+		{
+			if ( !to->Attribute( attribute->NameTStr() ) )
+				diff->AddEdit( REMOVE_ATTRIBUTE, Path( pair.path ) )->name = attribute->NameTStr();
+		}
+	}
+
+	const XMLFingerprint& FromHash( size_t i ) const	{ return fromChildren[i].hash; }
+	const XMLFingerprint& ToHash( size_t j ) const		{ return toChildren[j].hash; }
+
+	void Skip( size_t )									{ diff->skippedSubtrees++; }
+
+	// Elements of the same name are diffed in depth, and texts of the same kind get their value set.
+	static bool Similar( const XMLNode* a, const XMLNode* b )
+	{
+		if ( a->Type() != b->Type() )
+			return false;
+		if ( a->ToElement() )
+			return a->ValueStr() == b->ValueStr();
+		if ( a->ToText() )
+			return a->ToText()->CDATA() == b->ToText()->CDATA();
+		return false;
+	}
+
+	/*	The children common to both ends are skipped first. In what is left,
+		the two lists are walked together: a child found again later in the
+		other list is kept for then, and the one facing it is inserted or
+		deleted; two similar children are diffed; anything else is replaced.
+	*/
+	void DiffChildren( const Pair& pair )
+	{
+		Children( pair.from, &fromChildren );
+		Children( pair.to, &toChildren );
+		const size_t m = fromChildren.size();
+		const size_t n = toChildren.size();
+
+		size_t prefix = 0;
+		while ( prefix < m && prefix < n && FromHash( prefix ) == ToHash( prefix ) )
+			Skip( prefix++ );
+		size_t suffix = 0;
+		while ( suffix < m - prefix && suffix < n - prefix && FromHash( m-1-suffix ) == ToHash( n-1-suffix ) )
+			Skip( m-1 - suffix++ );
+
+		fromLeft.Clear();
+		toLeft.Clear();
+		if ( prefix + suffix < m && prefix + suffix < n )
+		{
+			for ( size_t i=prefix; i<m-suffix; ++i )
+				fromLeft.Add( FromHash( i ), i );
+			for ( size_t j=prefix; j<n-suffix; ++j )
+				toLeft.Add( ToHash( j ), j );
+			fromLeft.Sort();
+			toLeft.Sort();
+		}
+
+		std::vector< Pair > matched;
+		size_t i = prefix;
+		size_t j = prefix;
+		while ( i < m-suffix || j < n-suffix )
+		{
+			// The children before 'j' are final, so the one facing it is at 'j'.
+			if ( i == m-suffix )
+			{
+				diff->AddEdit( INSERT_NODE, Path( pair.path, j ), toChildren[j].node );
+				j++;
+			}
+			else if ( j == n-suffix )
+			{
+				diff->AddEdit( DELETE_NODE, Path( pair.path, j ) );
+				i++;
+			}
+			else if ( FromHash( i ) == ToHash( j ) )
+			{
+				Skip( i++ );
+				j++;
+			}
+			else if ( toLeft.Ahead( FromHash( i ), j+1 ) )
+			{
+				diff->AddEdit( INSERT_NODE, Path( pair.path, j ), toChildren[j].node );
+				j++;
+			}
+			else if ( fromLeft.Ahead( ToHash( j ), i+1 ) )
+			{
+				diff->AddEdit( DELETE_NODE, Path( pair.path, j ) );
+				i++;
+			}
+			else
+			{
+				const XMLNode* from = fromChildren[i].node;
+				const XMLNode* to = toChildren[j].node;
+				if ( Similar( from, to ) && from->ToText() )
+				{
+					diff->AddEdit( SET_TEXT, Path( pair.path, j ) )->value = to->ValueStr();
+				}
+				else if ( Similar( from, to ) )
+				{
+					Step step = { pair.path, j };
+					Pair child = { from, to, steps.size() };
+					steps.push_back( step );
+					matched.push_back( child );
+				}
+				else
+				{
+					diff->AddEdit( REPLACE_NODE, Path( pair.path, j ), to );
+				}
+				i++;
+				j++;
+			}
+		}
+
+		// In reverse, so that they are diffed in document order.
+		pending.insert( pending.end(), matched.rbegin(), matched.rend() );
+	}
+
+	XMLDiff* diff;
+	std::vector< Pair > pending;
+	std::vector< Step > steps;
+	std::vector< Child > fromChildren;
+	std::vector< Child > toChildren;
+	HashPositions fromLeft;			// The hashes of the children of 'from' left after the common ends.
+	HashPositions toLeft;			// The same for 'to'.
+};
+
+
+/*	Plays the edits of a script. Finding the node of a path walks children
+	from the first, so the patcher remembers the nodes of the last path, at
+	every level, and starts from them when the next path is further along:
+	edits come in document order, and most of them start where the previous
+	one was. The nodes remembered are kept right through the edits.
+*/
+class XMLDiff::Patcher
+{
+public:
+	Patcher( XMLDocument* _document ) : document( _document ) {}
+
+	bool Play( const Edit& edit )
+	{
+		if ( edit.path.empty() )
+			return false;
+
+		// The parent of the node, then the node: null if 'path' is one past the last child.
+		const size_t level = edit.path.size() - 1;
+		XMLNode* parent = document;
+		for ( size_t l=0; l<level && parent; ++l )
+		{
+			if ( !Find( parent, l, edit.path[l], &parent ) )
+				return false;
+		}
+		XMLNode* node = 0;
+		if ( !parent || !Find( parent, level, edit.path[level], &node ) )
+			return false;
+
+		switch ( edit.operation )
+		{
+			case INSERT_NODE:
+			{
+				XMLNode* inserted = node ? parent->InsertBeforeChild( node, *edit.node ) : parent->InsertEndChild( *edit.node );
+				Remember( level, edit.path[level], inserted );
+				return inserted != 0;
+			}
+
+			case DELETE_NODE:
+			{
+				if ( !node )
+					return false;
+				XMLNode* next = node->NextSibling();
+				Remember( level, edit.path[level], next );
+				return parent->RemoveChild( node );
+			}
+
+			case REPLACE_NODE:
+			{
+				if ( !node )
+					return false;
+				XMLNode* replaced = parent->ReplaceChild( node, *edit.node );
+				Remember( level, edit.path[level], replaced );
+				return replaced != 0;
+			}
+
+			case SET_ATTRIBUTE:
+				if ( !node || !node->ToElement() )
+					return false;
+				node->ToElement()->SetAttribute( edit.name, edit.value );
+				return true;
+
+			case REMOVE_ATTRIBUTE:
+				if ( !node || !node->ToElement() || !node->ToElement()->Attribute( edit.name ) )
+					return false;
+				node->ToElement()->RemoveAttribute( edit.name );
+				return true;
+
+			case SET_TEXT:
+				if ( !node || !node->ToText() )
+					return false;
+				node->SetValue( edit.value );
+				return true;
+		}
+		return false;
+	}
+
+private:
+	// A node of the last path, and its index among its siblings.
+	struct Step
+	{
+		size_t index;
+		XMLNode* node;
+	};
+
+	// Find the child 'index' of 'parent', at depth 'level'. Returns false if
+	// there are fewer children, and sets a null 'child' if there are just as many.
+	bool Find( XMLNode* parent, size_t level, size_t index, XMLNode** child )
+	{
+		XMLNode* node = parent->FirstChild();
+		size_t at = 0;
+		if ( level < cursor.size() && cursor[level].index <= index )
+		{
+			node = cursor[level].node;
+			at = cursor[level].index;
+		}
+		for ( ; node && at < index; ++at )
+			node = node->NextSibling();
+		if ( at < index )
+			return false;
+
+		// The nodes remembered below stay good as long as this one is the same.
+		if ( level >= cursor.size() || cursor[level].index != index )
+			Remember( level, index, node );
+		*child = node;
+		return true;
+	}
+
+	// Remember 'node' at 'index' on 'level', and forget the levels below.
+	void Remember( size_t level, size_t index, XMLNode* node )
+	{
+		cursor.resize( level < cursor.size() ? level : cursor.size() );
+		if ( node && level == cursor.size() )
+		{
+			Step step = { index, node };
+			cursor.push_back( step );
+		}
+	}
+
+	XMLDocument* document;
+	std::vector< Step > cursor;
+};
+
+
+XMLDiff::XMLDiff()
+{
+	Clear();
+}
+
+
+void XMLDiff::Clear()
+{
+	edits.clear();
+	nodes.Clear();
+	sourceHash = 0;
+	targetHash = 0;
+	skippedSubtrees = 0;
+}
+
+
+XMLDiff::Edit* XMLDiff::AddEdit( Operation operation, const std::vector< size_t >& path, const XMLNode* node )
+{
+	edits.push_back( Edit() );
+	Edit* edit = &edits.back();
+	edit->operation = operation;
+	edit->path = path;
+	if ( node )
+		edit->node = nodes.LinkEndChild( node->Clone() );
+	return edit;
+}
+
+
+HashValue XMLDiff::Hash( const XMLDocument& document )
+{
+	return document.Fingerprint().low;
+}
+
+
+bool XMLDiff::Compute( const XMLDocument& from, const XMLDocument& to )
+{
+	Clear();
+	if ( from.Error() || to.Error() )
+		return false;
+
+	Differ differ( this );
+	differ.Run( from, to );
+	return true;
+}
+
+
+bool XMLDiff::Apply( XMLDocument* document, bool verify ) const
+{
+	if ( document->Error() )
+		return false;
+	if ( verify && Hash( *document ) != sourceHash )
+		return false;
+
+	Patcher patcher( document );
+	for ( size_t i=0; i<edits.size(); ++i )
+	{
+		if ( !patcher.Play( edits[i] ) )
+			return false;
+	}
+	return !verify || Hash( *document ) == targetHash;
+}
+
+
+// The element names of the operations in ToDocument(), in order.
+static const char* const OPERATION_NAMES[] = { "insert", "delete", "replace", "set", "remove", "text" };
+static const int OPERATION_COUNT = sizeof( OPERATION_NAMES ) / sizeof( OPERATION_NAMES[0] );
+
+
+static std::string FormatHash( HashValue hash )
+{
+	static const char DIGITS[] = "0123456789abcdef";
+	std::string out( 16, '0' );
+	for ( int i=15; i>=0; --i, hash >>= 4 )
+		out[i] = DIGITS[ hash & 15 ];
+	return out;
+}
+
+
+static bool ParseHash( const std::string* text, HashValue* hash )
+{
+	if ( !text || text->size() != 16 )
+		return false;
+	*hash = 0;
+	for ( size_t i=0; i<text->size(); ++i )
+	{
+		const char c = (*text)[i];
+		int digit;
+		if ( c >= '0' && c <= '9' )			digit = c - '0';
+		else if ( c >= 'a' && c <= 'f' )	digit = c - 'a' + 10;
+		else								return false;
+		*hash = ( *hash << 4 ) | digit;
+	}
+	return true;
+}
+
+
+static std::string FormatPath( const std::vector< size_t >& path )
+{
+	std::string out;
+	for ( size_t i=0; i<path.size(); ++i )
+	{
+		// The digits of the index, last first.
+		char buf[ XMLBase::NUMBER_BUFFER_SIZE ];
+		char* p = buf + sizeof( buf );
+		size_t index = path[i];
+		do
+		{
+			*--p = (char)( '0' + index % 10 );
+			index /= 10;
+		} while ( index );
+
+		if ( i )
+			out += '/';
+		out.append( p, buf + sizeof( buf ) - p );
+	}
+	return out;
+}
+
+
+static bool ParsePath( const std::string* text, std::vector< size_t >* path )
+{
+	path->clear();
+	if ( !text || text->empty() )
+		return false;
+
+	size_t index = 0;
+	bool digits = false;
+	for ( size_t i=0; i<=text->size(); ++i )
+	{
+		if ( i == text->size() || (*text)[i] == '/' )
+		{
+			if ( !digits )
+				return false;
+			path->push_back( index );
+			index = 0;
+			digits = false;
+		}
+		else if ( (*text)[i] >= '0' && (*text)[i] <= '9' )
+		{
+			// An index out of range is an error, not one that wraps around.
+			const size_t digit = (size_t)( (*text)[i] - '0' );
+			if ( index > ( (size_t) -1 - digit ) / 10 )
+				return false;
+			index = index * 10 + digit;
+			digits = true;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+void XMLDiff::ToDocument( XMLDocument* out ) const
+{
+	out->Clear();
+	XMLElement* root = new XMLElement( "xmldiff" );
+	out->LinkEndChild( root );
+	root->SetAttribute( "source", FormatHash( sourceHash ) );
+	root->SetAttribute( "target", FormatHash( targetHash ) );
+
+	for ( size_t i=0; i<edits.size(); ++i )
+	{
+		const Edit& edit = edits[i];
+		XMLElement* element = new XMLElement( OPERATION_NAMES[ edit.operation ] );
+		root->LinkEndChild( element );
+		element->SetAttribute( "path", FormatPath( edit.path ) );
+
+		switch ( edit.operation )
+		{
+			case SET_ATTRIBUTE:
+				element->SetAttribute( "name", edit.name );
+				element->SetAttribute( "value", edit.value );
+				break;
+			case REMOVE_ATTRIBUTE:
+				element->SetAttribute( "name", edit.name );
+				break;
+			case SET_TEXT:
+				element->SetAttribute( "value", edit.value );
+				break;
+			case INSERT_NODE:
+			case REPLACE_NODE:
+				// A text as a child would lose its whitespace when read back.
+				if ( edit.node->ToText() )
+				{
+					element->SetAttribute( "text", edit.node->ValueStr() );
+					if ( edit.node->ToText()->CDATA() )
+						element->SetAttribute( "cdata", "1" );
+				}
+				else
+				{
+					element->LinkEndChild( edit.node->Clone() );
+				}
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+
+bool XMLDiff::FromDocument( const XMLDocument& in )
+{
+	Clear();
+	const XMLElement* root = in.RootElement();
+	if ( in.Error() || !root || root->ValueStr() != "xmldiff"
+		 || !ParseHash( root->Attribute( std::string( "source" ) ), &sourceHash )
+		 || !ParseHash( root->Attribute( std::string( "target" ) ), &targetHash ) )
+	{
+		Clear();
+		return false;
+	}
+
+	std::vector< size_t > path;
+	for ( const XMLElement* element = root->FirstChildElement(); element; element = element->NextSiblingElement() )
+	{
+		int operation = 0;
+		while ( operation < OPERATION_COUNT && element->ValueStr() != OPERATION_NAMES[ operation ] )
+			++operation;
+		if ( operation == OPERATION_COUNT || !ParsePath( element->Attribute( std::string( "path" ) ), &path ) )
+		{
+			Clear();
+			return false;
+		}
+
+		const std::string* name = element->Attribute( std::string( "name" ) );
+		const std::string* value = element->Attribute( std::string( "value" ) );
+		const std::string* text = element->Attribute( std::string( "text" ) );
+		const XMLNode* node = 0;
+		bool valid = true;
+		switch ( operation )
+		{
+			case SET_ATTRIBUTE:
+				valid = name && value;
+				break;
+			case REMOVE_ATTRIBUTE:
+				valid = name != 0;
+				break;
+			case SET_TEXT:
+				valid = value != 0;
+				break;
+			case INSERT_NODE:
+			case REPLACE_NODE:
+				// The node: the one child that isn't a text, or else the 'text' attribute.
+				for ( const XMLNode* child = element->FirstChild(); child; child = child->NextSibling() )
+				{
+					if ( child->ToText() )
+						continue;
+					valid = !node;
+					node = child;
+				}
+				valid = valid && ( node != 0 ) != ( text != 0 );
+				break;
+			default:
+				break;
+		}
+		if ( !valid )
+		{
+			Clear();
+			return false;
+		}
+
+		if ( text )
+		{
+			XMLText textNode( text->c_str() );
+			const std::string* cdata = element->Attribute( std::string( "cdata" ) );
+			textNode.SetCDATA( cdata && *cdata == "1" );
+			AddEdit( (Operation) operation, path, &textNode );
+		}
+		else
+		{
+			Edit* edit = AddEdit( (Operation) operation, path, node );
+			if ( name )
+				edit->name = *name;
+			if ( value )
+				edit->value = *value;
+		}
+	}
+	return true;
+}
+
+#endif	// USE_STL
@@ -25,4 +25,6 @@ const char* XMLBase::errorString[ XMLBase::ERROR_STRING_COUNT ] =
 	"Error null (0) or unexpected EOF found in input stream.",
 	"Error parsing CDATA.",
 	"Error when XMLDocument added to document, because XMLDocument can only be at the root.",
+	"Error reading binary image: bad header, version or contents.",
+	"Error: out of memory.",
 };
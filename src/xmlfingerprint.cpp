@@ -0,0 +1,202 @@
+#include "xmlparser.h"
+
+#include <string.h>
+
+// The two halves are hashed separately, with different constants, so that
+// a collision in one tells nothing about the other.
+static const unsigned long long LOW_SEED = 0xcbf29ce484222325ULL;		// FNV-1a offset basis
+static const unsigned long long HIGH_SEED = 0x6a09e667f3bcc909ULL;
+static const unsigned long long LOW_PRIME = 0x100000001b3ULL;			// FNV-1a prime
+static const unsigned long long HIGH_PRIME = 0x9e3779b97f4a7c15ULL;
+
+
+// The splitmix64 finalizer: every bit of the result depends on every bit of 'h'.
+static unsigned long long Mix( unsigned long long h )
+{
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+	return h;
+}
+
+
+static XMLFingerprint HashString( const char* text, size_t length )
+{
+	unsigned long long low = LOW_SEED ^ length;
+	unsigned long long high = HIGH_SEED + length;
+	for ( size_t i = 0; i < length; ++i )
+	{
+		unsigned char c = (unsigned char) text[i];
+		low = ( low ^ c ) * LOW_PRIME;
+		high = ( high ^ c ) * HIGH_PRIME;
+	}
+	XMLFingerprint result;
+	result.low = Mix( low );
+	result.high = Mix( high );
+	return result;
+}
+
+
+static XMLFingerprint HashString( const char* text )
+{
+	return HashString( text, strlen( text ) );
+}
+
+
+static XMLFingerprint HashNumber( unsigned long long n )
+{
+	XMLFingerprint result;
+	result.low = Mix( n ^ LOW_SEED );
+	result.high = Mix( n + HIGH_SEED );
+	return result;
+}
+
+
+// Add 'part' to 'h'. Only 'h' is multiplied, so that the order of the
+// parts matters: a name and a value swapped don't hash the same.
+static void Combine( XMLFingerprint* h, const XMLFingerprint& part )
+{
+	h->low = Mix( h->low * HIGH_PRIME + part.low );
+	h->high = Mix( ( h->high ^ HIGH_SEED ) * LOW_PRIME ^ part.high );
+}
+
+
+void XMLNode::ForgetFingerprints()
+{
+	for ( XMLNode* node = this; node && node->HasFingerprint(); node = node->parent )
+		node->fingerprintHigh = 0;
+}
+
+
+XMLFingerprint XMLNode::LoadFingerprint() const
+{
+	XMLFingerprint result;
+	#ifdef XML_THREADS
+	result.low = fingerprintLow.load( std::memory_order_relaxed );
+	result.high = fingerprintHigh.load( std::memory_order_relaxed );
+	#else
+	result.low = fingerprintLow;
+	result.high = fingerprintHigh;
+	#endif
+	return result;
+}
+
+
+void XMLNode::StoreFingerprint( const XMLFingerprint& fingerprint ) const
+{
+	// The high half says whether there is a fingerprint, so it can't be 0.
+	const unsigned long long high = fingerprint.high ? fingerprint.high : 1;
+
+	// Threads computing at once store the same value: only the order of
+	// the stores matters, the low half being seen before the high one.
+	#ifdef XML_THREADS
+	fingerprintLow.store( fingerprint.low, std::memory_order_relaxed );
+	fingerprintHigh.store( high, std::memory_order_release );
+	#else
+	fingerprintLow = fingerprint.low;
+	fingerprintHigh = high;
+	#endif
+}
+
+
+void XMLNode::CopyFingerprint( const XMLNode& source )
+{
+	if ( source.HasFingerprint() )
+		StoreFingerprint( source.LoadFingerprint() );
+}
+
+
+void XMLNode::ComputeFingerprint() const
+{
+	XMLFingerprint h = HashNumber( type );
+
+	// The value of a document is its file name, not its content.
+	if ( type != TINYXML_DOCUMENT )
+		Combine( &h, HashString( value.c_str(), value.length() ) );
+
+	if ( const XMLElement* element = ToElement() )
+	{
+		// Summed, so that the order of the attributes doesn't count.
+		XMLFingerprint attributes;
+		unsigned long long count = 0;
+		for ( const XMLAttribute* attribute = element->FirstAttribute(); attribute; attribute = attribute->Next() )
+		{
+			XMLFingerprint a = HashString( attribute->NameTStr().c_str(), attribute->NameTStr().length() );
+			Combine( &a, HashString( attribute->ValueTStr().c_str(), attribute->ValueTStr().length() ) );
+			attributes.low += a.low;
+			attributes.high += a.high;
+			++count;
+		}
+		Combine( &h, HashNumber( count ) );
+		Combine( &h, attributes );
+	}
+	else if ( const XMLText* text = ToText() )
+	{
+		Combine( &h, HashNumber( text->CDATA() ) );
+	}
+	else if ( const XMLDeclaration* declaration = ToDeclaration() )
+	{
+		Combine( &h, HashString( declaration->Version() ) );
+		Combine( &h, HashString( declaration->Encoding() ) );
+		Combine( &h, HashString( declaration->Standalone() ) );
+	}
+
+	unsigned long long count = 0;
+	#ifdef XML_THREADS
+	if ( shared )
+	{
+		// Still the snapshot's children, which are only read.
+		for ( const XMLNode* child = shared->source->firstChild; child; child = child->next, ++count )
+			Combine( &h, child->Fingerprint() );
+	}
+	else
+	#endif
+	{
+		for ( const XMLNode* child = firstChild; child; child = child->next, ++count )
+			Combine( &h, child->LoadFingerprint() );
+	}
+	Combine( &h, HashNumber( count ) );
+
+	StoreFingerprint( h );
+}
+
+
+XMLFingerprint XMLNode::Fingerprint() const
+{
+	// Post-order over the nodes without a fingerprint: those that have one
+	// are skipped with their subtree, and so cost nothing. Shared children
+	// are not walked, as their parents are the snapshot's; they are hashed
+	// from the snapshot instead, where their fingerprints are kept for
+	// every clone.
+	if ( HasFingerprint() )
+		return LoadFingerprint();
+
+	const XMLNode* node = this;
+	bool down = true;
+	for ( ;; )
+	{
+		if ( down )
+		{
+			const XMLNode* child = node->IsShared() ? 0 : node->firstChild;
+			while ( child && child->HasFingerprint() )
+				child = child->next;
+			if ( child )
+			{
+				node = child;
+				continue;
+			}
+		}
+		node->ComputeFingerprint();
+		if ( node == this )
+			break;
+
+		const XMLNode* sibling = node->next;
+		while ( sibling && sibling->HasFingerprint() )
+			sibling = sibling->next;
+		down = sibling != 0;
+		node = down ? sibling : node->parent;
+	}
+	return LoadFingerprint();
+}
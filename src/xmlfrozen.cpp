@@ -0,0 +1,289 @@
+#ifdef USE_STL
+
+#include "xmlfrozen.h"
+
+FILE* XMLFOpen( const char* filename, const char* mode );
+
+
+XMLFrozenNode XMLFrozenNode::FirstChild( const char* value ) const
+{
+	if ( IsNull() )
+		return XMLFrozenNode();
+	for( uint32_t node = image->FirstChild( index ); node != XMLBinaryImage::NONE; node = image->NextSibling( node ) )
+	{
+		if ( ValueIs( node, value ) )
+			return XMLFrozenNode( image, node );
+	}
+	return XMLFrozenNode();
+}
+
+
+XMLFrozenNode XMLFrozenNode::LastChild( const char* value ) const
+{
+	if ( IsNull() )
+		return XMLFrozenNode();
+	for( uint32_t node = image->LastChild( index ); node != XMLBinaryImage::NONE; node = image->PreviousSibling( node ) )
+	{
+		if ( ValueIs( node, value ) )
+			return XMLFrozenNode( image, node );
+	}
+	return XMLFrozenNode();
+}
+
+
+XMLFrozenNode XMLFrozenNode::NextSibling( const char* value ) const
+{
+	if ( IsNull() )
+		return XMLFrozenNode();
+	for( uint32_t node = image->NextSibling( index ); node != XMLBinaryImage::NONE; node = image->NextSibling( node ) )
+	{
+		if ( ValueIs( node, value ) )
+			return XMLFrozenNode( image, node );
+	}
+	return XMLFrozenNode();
+}
+
+
+XMLFrozenNode XMLFrozenNode::PreviousSibling( const char* value ) const
+{
+	if ( IsNull() )
+		return XMLFrozenNode();
+	for( uint32_t node = image->PreviousSibling( index ); node != XMLBinaryImage::NONE; node = image->PreviousSibling( node ) )
+	{
+		if ( ValueIs( node, value ) )
+			return XMLFrozenNode( image, node );
+	}
+	return XMLFrozenNode();
+}
+
+
+XMLFrozenNode XMLFrozenNode::FirstChildElement() const
+{
+	if ( IsNull() )
+		return XMLFrozenNode();
+	for( uint32_t node = image->FirstChild( index ); node != XMLBinaryImage::NONE; node = image->NextSibling( node ) )
+	{
+		if ( image->Type( node ) == XMLNode::TINYXML_ELEMENT )
+			return XMLFrozenNode( image, node );
+	}
+	return XMLFrozenNode();
+}
+
+
+XMLFrozenNode XMLFrozenNode::FirstChildElement( const char* value ) const
+{
+	if ( IsNull() )
+		return XMLFrozenNode();
+	for( uint32_t node = image->FirstChild( index ); node != XMLBinaryImage::NONE; node = image->NextSibling( node ) )
+	{
+		if ( image->Type( node ) == XMLNode::TINYXML_ELEMENT && ValueIs( node, value ) )
+			return XMLFrozenNode( image, node );
+	}
+	return XMLFrozenNode();
+}
+
+
+XMLFrozenNode XMLFrozenNode::NextSiblingElement() const
+{
+	if ( IsNull() )
+		return XMLFrozenNode();
+	for( uint32_t node = image->NextSibling( index ); node != XMLBinaryImage::NONE; node = image->NextSibling( node ) )
+	{
+		if ( image->Type( node ) == XMLNode::TINYXML_ELEMENT )
+			return XMLFrozenNode( image, node );
+	}
+	return XMLFrozenNode();
+}
+
+
+XMLFrozenNode XMLFrozenNode::NextSiblingElement( const char* value ) const
+{
+	if ( IsNull() )
+		return XMLFrozenNode();
+	for( uint32_t node = image->NextSibling( index ); node != XMLBinaryImage::NONE; node = image->NextSibling( node ) )
+	{
+		if ( image->Type( node ) == XMLNode::TINYXML_ELEMENT && ValueIs( node, value ) )
+			return XMLFrozenNode( image, node );
+	}
+	return XMLFrozenNode();
+}
+
+
+XMLFrozenAttribute XMLFrozenNode::FirstAttribute() const
+{
+	if ( !IsElement() )
+		return XMLFrozenAttribute();
+	uint32_t first = image->FirstAttribute( index );
+	uint32_t end = image->AttributeEnd( index );
+	if ( first == end )
+		return XMLFrozenAttribute();
+	return XMLFrozenAttribute( image, first, end );
+}
+
+
+const char* XMLFrozenNode::Attribute( const char* name ) const
+{
+	if ( !IsElement() )
+		return 0;
+	uint32_t end = image->AttributeEnd( index );
+	for( uint32_t attrib = image->FirstAttribute( index ); attrib < end; ++attrib )
+	{
+		if ( strcmp( image->AttributeName( attrib ), name ) == 0 )
+			return image->AttributeValue( attrib );
+	}
+	return 0;
+}
+
+
+int XMLFrozenNode::QueryIntAttribute( const char* name, int* value ) const
+{
+	const char* str = Attribute( name );
+	if ( !str )
+		return NO_ATTRIBUTE;
+	return XMLBase::ConvertToInt( str, value );
+}
+
+
+int XMLFrozenNode::QueryUnsignedAttribute( const char* name, unsigned* value ) const
+{
+	const char* str = Attribute( name );
+	if ( !str )
+		return NO_ATTRIBUTE;
+	return XMLBase::ConvertToUnsigned( str, value );
+}
+
+
+int XMLFrozenNode::QueryDoubleAttribute( const char* name, double* value ) const
+{
+	const char* str = Attribute( name );
+	if ( !str )
+		return NO_ATTRIBUTE;
+	return XMLBase::ConvertToDouble( str, value );
+}
+
+
+int XMLFrozenNode::QueryBoolAttribute( const char* name, bool* value ) const
+{
+	const char* str = Attribute( name );
+	if ( !str )
+		return NO_ATTRIBUTE;
+	return XMLBase::ConvertToBool( str, value );
+}
+
+
+const char* XMLFrozenNode::GetText() const
+{
+	if ( IsNull() )
+		return 0;
+	uint32_t child = image->FirstChild( index );
+	if ( child != XMLBinaryImage::NONE && image->Type( child ) == XMLNode::TINYXML_TEXT )
+		return image->Value( child );
+	return 0;
+}
+
+
+// The image keeps version, encoding and standalone as the three
+// attributes of a declaration.
+const char* XMLFrozenNode::DeclarationString( uint32_t which ) const
+{
+	if ( !IsDeclaration() )
+		return 0;
+	return image->AttributeValue( image->FirstAttribute( index ) + which );
+}
+
+
+const char* XMLFrozenNode::Version() const		{ return DeclarationString( 0 ); }
+const char* XMLFrozenNode::Encoding() const		{ return DeclarationString( 1 ); }
+const char* XMLFrozenNode::Standalone() const	{ return DeclarationString( 2 ); }
+
+
+XMLFrozenDocument::XMLFrozenDocument()
+	: error( false ), errorId( 0 ), errorRow( 0 ), errorCol( 0 )
+{
+}
+
+
+XMLFrozenDocument::XMLFrozenDocument( const XMLDocument& document )
+	: error( false ), errorId( 0 ), errorRow( 0 ), errorCol( 0 )
+{
+	Freeze( document );
+}
+
+
+void XMLFrozenDocument::SetError( const XMLDocument& document )
+{
+	error = document.Error();
+	errorId = document.ErrorId();
+	errorDesc = document.ErrorDesc();
+	errorRow = document.Error() ? document.ErrorRow() : 0;
+	errorCol = document.Error() ? document.ErrorCol() : 0;
+}
+
+
+void XMLFrozenDocument::SetError( int id )
+{
+	XMLDocument document;
+	document.SetError( id, 0, 0, ENCODING_UNKNOWN );
+	SetError( document );
+}
+
+
+bool XMLFrozenDocument::Freeze( const XMLDocument& document )
+{
+	image.Close();
+	SetError( document );
+	if ( !image.Build( document ) )
+	{
+		SetError( XMLBase::ERROR_BINARY_IMAGE );
+		return false;
+	}
+	return !error;
+}
+
+
+bool XMLFrozenDocument::Parse( const char* xml, XMLEncoding encoding )
+{
+	// Parsed through a XMLDocument, which lives only until it is frozen.
+	XMLDocument document;
+	document.Parse( xml, 0, encoding );
+	return Freeze( document );
+}
+
+
+bool XMLFrozenDocument::LoadFile( const char* filename, XMLEncoding encoding )
+{
+	XMLDocument document;
+	document.LoadFile( filename, encoding );
+	return Freeze( document );
+}
+
+
+bool XMLFrozenDocument::LoadBinary( const char* filename )
+{
+	SetError( XMLDocument() );
+	if ( !image.Open( filename ) )
+	{
+		FILE* fp = XMLFOpen( filename, "rb" );
+		if ( fp )
+			fclose( fp );
+		SetError( fp ? XMLBase::ERROR_BINARY_IMAGE : XMLBase::ERROR_OPENING_FILE );
+		return false;
+	}
+	return true;
+}
+
+
+bool XMLFrozenDocument::SaveBinary( const char* filename ) const
+{
+	if ( !image.IsOpen() )
+		return false;
+	FILE* fp = XMLFOpen( filename, "wb" );
+	if ( !fp )
+		return false;
+	bool result = fwrite( image.Data(), 1, image.Size(), fp ) == image.Size();
+	if ( fclose( fp ) != 0 )
+		result = false;
+	return result;
+}
+
+#endif	// USE_STL
@@ -0,0 +1,211 @@
+#ifdef USE_STL
+
+#include "xmlmemory.h"
+
+#include <algorithm>
+#include <vector>
+
+// The names the nodes other than elements are counted under, by type.
+static const std::string TYPE_NAMES[ XMLNode::TINYXML_TYPECOUNT ] =
+{
+	"#document",
+	"",
+	"#comment",
+	"#unknown",
+	"#text",
+	"#declaration"
+};
+
+
+void XMLMemoryUsage::Bytes::Add( const Bytes& other )
+{
+	nodes += other.nodes;
+	attributes += other.attributes;
+	nodeBytes += other.nodeBytes;
+	attributeBytes += other.attributeBytes;
+	stringBytes += other.stringBytes;
+	overheadBytes += other.overheadBytes;
+}
+
+
+void XMLMemoryUsage::Clear()
+{
+	tree = Bytes();
+	byName.clear();
+	reservedBytes = 0;
+	sharedNodes = 0;
+}
+
+
+size_t XMLMemoryUsage::StringBytes( const std::string& str )
+{
+	// A short string is kept in the object itself, and its data is there.
+	const char* data = str.data();
+	const char* object = reinterpret_cast< const char* >( &str );
+	if ( ( data >= object && data < object + sizeof( str ) ) || str.capacity() == 0 )
+		return 0;
+	return str.capacity() + 1;
+}
+
+
+void XMLMemoryUsage::AddNode( const XMLNode* node, Bytes* bytes )
+{
+	bytes->nodes++;
+	bytes->overheadBytes += XMLAllocator::Overhead();
+	bytes->stringBytes += StringBytes( node->value );
+
+	switch ( node->type )
+	{
+		case XMLNode::TINYXML_ELEMENT:
+		{
+			bytes->nodeBytes += sizeof( XMLElement );
+			for ( const XMLAttribute* attribute = node->ToElement()->FirstAttribute(); attribute; attribute = attribute->Next() )
+			{
+				bytes->attributes++;
+				bytes->attributeBytes += sizeof( XMLAttribute );
+				bytes->overheadBytes += XMLAllocator::Overhead();
+				bytes->stringBytes += StringBytes( attribute->NameTStr() ) + StringBytes( attribute->ValueStr() );
+			}
+			break;
+		}
+		case XMLNode::TINYXML_COMMENT:		bytes->nodeBytes += sizeof( XMLComment );		break;
+		case XMLNode::TINYXML_UNKNOWN:		bytes->nodeBytes += sizeof( XMLUnknown );		break;
+		case XMLNode::TINYXML_TEXT:			bytes->nodeBytes += sizeof( XMLText );			break;
+		case XMLNode::TINYXML_DECLARATION:
+		{
+			const XMLDeclaration* declaration = node->ToDeclaration();
+			bytes->nodeBytes += sizeof( XMLDeclaration );
+			bytes->stringBytes += StringBytes( declaration->version ) + StringBytes( declaration->encoding ) + StringBytes( declaration->standalone );
+			break;
+		}
+		default:							bytes->nodeBytes += sizeof( XMLDocument );		break;
+	}
+}
+
+
+void XMLMemoryUsage::Collect( const XMLDocument& document )
+{
+	Clear();
+
+	// The tree, in document order, without recursion: inputs can be deep.
+	// The children of a node still shared with a snapshot are the snapshot's.
+	#ifdef XML_THREADS
+	const XMLNode* node = document.shared ? 0 : document.firstChild;
+	if ( document.shared )
+		sharedNodes++;
+	#else
+	const XMLNode* node = document.firstChild;
+	#endif
+	while ( node )
+	{
+		const std::string& name = node->type == XMLNode::TINYXML_ELEMENT ? node->value : TYPE_NAMES[ node->type ];
+		Bytes* bytes = &byName[ name ];
+		AddNode( node, bytes );
+
+		bool descend = node->firstChild != 0;
+		#ifdef XML_THREADS
+		if ( node->shared )
+		{
+			sharedNodes++;
+			bytes->nodeBytes += sizeof( XMLNode::SharedChildren );
+			descend = false;
+		}
+		#endif
+
+		if ( descend )
+		{
+			node = node->firstChild;
+		}
+		else
+		{
+			while ( !node->next && node->parent != &document )
+				node = node->parent;
+			node = node->next;
+		}
+	}
+
+	for ( NameMap::const_iterator it = byName.begin(); it != byName.end(); ++it )
+		tree.Add( it->second );
+
+	// What the document keeps for reuse, with the capacity of its strings.
+	Bytes kept;
+	for ( int i=0; i<XMLNode::TINYXML_TYPECOUNT; ++i )
+	{
+		for ( const XMLNode* free = document.freeNodes[i]; free; free = free->next )
+			AddNode( free, &kept );
+	}
+	for ( const XMLAttribute* free = document.freeAttributes; free; free = free->next )
+	{
+		kept.attributeBytes += sizeof( XMLAttribute );
+		kept.overheadBytes += XMLAllocator::Overhead();
+		kept.stringBytes += StringBytes( free->NameTStr() ) + StringBytes( free->ValueStr() );
+	}
+	reservedBytes = kept.Total();
+	if ( document.readBuffer )
+		reservedBytes += document.readBufferSize + XMLAllocator::Overhead();
+	reservedBytes += StringBytes( document.value ) + StringBytes( document.errorDesc );
+}
+
+
+// Largest first, then by name.
+static bool ByBytes( const XMLMemoryUsage::NameMap::value_type* a, const XMLMemoryUsage::NameMap::value_type* b )
+{
+	if ( a->second.Total() != b->second.Total() )
+		return a->second.Total() > b->second.Total();
+	return a->first < b->first;
+}
+
+
+static void AppendValue( const char* prefix, const char* key, const std::string& name, const char* suffix, size_t value, std::string* out )
+{
+	char buf[ XMLBase::NUMBER_BUFFER_SIZE ];
+	*out += prefix;
+	*out += key;
+	*out += name;
+	*out += suffix;
+	*out += "=";
+	out->append( buf, XMLBase::FormatDouble( (double) value, buf ) );
+	*out += "\n";
+}
+
+
+std::string XMLMemoryUsage::ToString( size_t maxNames, const char* prefix ) const
+{
+	std::string out;
+	const std::string none;
+	AppendValue( prefix, "nodes", none, "", tree.nodes, &out );
+	AppendValue( prefix, "attributes", none, "", tree.attributes, &out );
+	AppendValue( prefix, "node_bytes", none, "", tree.nodeBytes, &out );
+	AppendValue( prefix, "attribute_bytes", none, "", tree.attributeBytes, &out );
+	AppendValue( prefix, "string_bytes", none, "", tree.stringBytes, &out );
+	AppendValue( prefix, "overhead_bytes", none, "", tree.overheadBytes, &out );
+	AppendValue( prefix, "tree_bytes", none, "", tree.Total(), &out );
+	AppendValue( prefix, "reserved_bytes", none, "", reservedBytes, &out );
+	AppendValue( prefix, "total_bytes", none, "", TotalBytes(), &out );
+	AppendValue( prefix, "shared_nodes", none, "", sharedNodes, &out );
+
+	std::vector< const NameMap::value_type* > names;
+	names.reserve( byName.size() );
+	for ( NameMap::const_iterator it = byName.begin(); it != byName.end(); ++it )
+		names.push_back( &*it );
+	std::sort( names.begin(), names.end(), ByBytes );
+	if ( maxNames && names.size() > maxNames )
+		names.resize( maxNames );
+
+	for ( size_t i=0; i<names.size(); ++i )
+	{
+		AppendValue( prefix, "name.", names[i]->first, ".nodes", names[i]->second.nodes, &out );
+		AppendValue( prefix, "name.", names[i]->first, ".bytes", names[i]->second.Total(), &out );
+	}
+	return out;
+}
+
+
+XMLMemoryUsage XMLDocument::MemoryUsage() const
+{
+	XMLMemoryUsage usage;
+	usage.Collect( *this );
+	return usage;
+}
+
+#endif	// USE_STL
@@ -0,0 +1,410 @@
+#include "xmlparser.h"
+
+// Number formatting for the attribute setters. Integers are written
+// right to left, two digits at a time. Doubles use Grisu2 (Florian Loitsch,
+// "Printing Floating-Point Numbers Quickly and Accurately with Integers",
+// PLDI 2010): the output always reads back to the same double, and is the
+// shortest such string in all but a handful of cases.
+
+typedef unsigned long long	XMLUInt64;
+
+static const char digitPairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+static const unsigned powersOfTen32[] =
+{
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+// The scale of the rounding margin after the fractional digits, up to the
+// 19 that a 64 bit fraction can give.
+static const XMLUInt64 powersOfTen64[] =
+{
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+	100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+	10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+
+static int CountDigits( unsigned n )
+{
+	int count = 1;
+	while ( count < 10 && n >= powersOfTen32[count] )
+		++count;
+	return count;
+}
+
+
+// Write the decimal digits of 'n', exactly 'count' of them, ending just before 'end'.
+static void WriteDigits( unsigned n, char* end )
+{
+	while ( n >= 100 )
+	{
+		unsigned i = ( n % 100 ) * 2;
+		n /= 100;
+		*--end = digitPairs[i+1];
+		*--end = digitPairs[i];
+	}
+	if ( n < 10 )
+	{
+		*--end = (char)( '0' + n );
+	}
+	else
+	{
+		*--end = digitPairs[n*2+1];
+		*--end = digitPairs[n*2];
+	}
+}
+
+
+size_t XMLBase::FormatInt( int value, char* buffer )
+{
+	char* p = buffer;
+	unsigned magnitude = (unsigned) value;
+	if ( value < 0 )
+	{
+		*p++ = '-';
+		magnitude = 0U - magnitude;
+	}
+	int count = CountDigits( magnitude );
+	WriteDigits( magnitude, p + count );
+	return ( p - buffer ) + count;
+}
+
+
+// A "do it yourself" floating point number: f * 2^e
+struct XMLDiyFp
+{
+	XMLDiyFp() : f( 0 ), e( 0 ) {}
+	XMLDiyFp( XMLUInt64 _f, int _e ) : f( _f ), e( _e ) {}
+
+	explicit XMLDiyFp( double d )
+	{
+		XMLUInt64 bits;
+		memcpy( &bits, &d, sizeof( bits ) );
+		int biasedExponent = (int)( ( bits & EXPONENT_MASK ) >> SIGNIFICAND_SIZE );
+		XMLUInt64 significand = bits & SIGNIFICAND_MASK;
+		if ( biasedExponent != 0 )
+		{
+			f = significand + HIDDEN_BIT;
+			e = biasedExponent - EXPONENT_BIAS;
+		}
+		else
+		{
+			f = significand;
+			e = 1 - EXPONENT_BIAS;
+		}
+	}
+
+	XMLDiyFp operator-( const XMLDiyFp& rhs ) const
+	{
+		return XMLDiyFp( f - rhs.f, e );
+	}
+
+	// The upper 64 bits of the 128 bit product, rounded.
+	XMLDiyFp operator*( const XMLDiyFp& rhs ) const
+	{
+		const XMLUInt64 M32 = 0xFFFFFFFFULL;
+		const XMLUInt64 a = f >> 32;
+		const XMLUInt64 b = f & M32;
+		const XMLUInt64 c = rhs.f >> 32;
+		const XMLUInt64 d = rhs.f & M32;
+		const XMLUInt64 ac = a * c;
+		const XMLUInt64 bc = b * c;
+		const XMLUInt64 ad = a * d;
+		const XMLUInt64 bd = b * d;
+		XMLUInt64 tmp = ( bd >> 32 ) + ( ad & M32 ) + ( bc & M32 );
+		tmp += 1ULL << 31;
+		return XMLDiyFp( ac + ( ad >> 32 ) + ( bc >> 32 ) + ( tmp >> 32 ), e + rhs.e + 64 );
+	}
+
+	XMLDiyFp Normalize() const
+	{
+		XMLDiyFp res = *this;
+		while ( !( res.f & ( 1ULL << 63 ) ) )
+		{
+			res.f <<= 1;
+			--res.e;
+		}
+		return res;
+	}
+
+	XMLDiyFp NormalizeBoundary() const
+	{
+		XMLDiyFp res = *this;
+		while ( !( res.f & ( HIDDEN_BIT << 1 ) ) )
+		{
+			res.f <<= 1;
+			--res.e;
+		}
+		res.f <<= ( 64 - SIGNIFICAND_SIZE - 2 );
+		res.e -= ( 64 - SIGNIFICAND_SIZE - 2 );
+		return res;
+	}
+
+	// The boundaries m- and m+ halfway to the neighbouring doubles,
+	// normalized to the same exponent.
+	void NormalizedBoundaries( XMLDiyFp* minus, XMLDiyFp* plus ) const
+	{
+		XMLDiyFp pl = XMLDiyFp( ( f << 1 ) + 1, e - 1 ).NormalizeBoundary();
+		XMLDiyFp mi = ( f == HIDDEN_BIT ) ? XMLDiyFp( ( f << 2 ) - 1, e - 2 ) : XMLDiyFp( ( f << 1 ) - 1, e - 1 );
+		mi.f <<= mi.e - pl.e;
+		mi.e = pl.e;
+		*plus = pl;
+		*minus = mi;
+	}
+
+	static const int SIGNIFICAND_SIZE = 52;
+	static const int EXPONENT_BIAS = 0x3FF + SIGNIFICAND_SIZE;
+	static const XMLUInt64 EXPONENT_MASK = 0x7FF0000000000000ULL;
+	static const XMLUInt64 SIGNIFICAND_MASK = 0x000FFFFFFFFFFFFFULL;
+	static const XMLUInt64 HIDDEN_BIT = 0x0010000000000000ULL;
+
+	XMLUInt64 f;
+	int e;
+};
+
+
+// 10^k, k = -348, -340, ..., 340, as normalized 64 bit significands
+// and binary exponents.
+static const XMLUInt64 cachedPowersF[] =
+{
+	0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+	0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+	0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+	0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+	0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+	0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+	0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+	0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+	0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+	0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+	0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+	0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+	0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+	0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+	0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+	0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+	0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+	0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+	0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+	0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+	0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+	0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+	0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+	0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+	0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+	0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+	0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+	0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+	0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const short cachedPowersE[] =
+{
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007,  -980,
+	 -954,  -927,  -901,  -874,  -847,  -821,  -794,  -768,  -741,  -715,
+	 -688,  -661,  -635,  -608,  -582,  -555,  -529,  -502,  -475,  -449,
+	 -422,  -396,  -369,  -343,  -316,  -289,  -263,  -236,  -210,  -183,
+	 -157,  -130,  -103,   -77,   -50,   -24,     3,    30,    56,    83,
+	  109,   136,   162,   189,   216,   242,   269,   295,   322,   348,
+	  375,   402,   428,   455,   481,   508,   534,   561,   588,   614,
+	  641,   667,   694,   720,   747,   774,   800,   827,   853,   880,
+	  907,   933,   960,   986,  1013,  1039,  1066
+};
+
+
+// A cached power c = 10^-K such that c * 2^e lands the product in a
+// convenient range for DigitGen.
+static XMLDiyFp GetCachedPower( int e, int* K )
+{
+	double dk = ( -61 - e ) * 0.30102999566398114 + 347;	// dk must be positive, so can do ceiling in positive
+	int k = (int) dk;
+	if ( dk - k > 0.0 )
+		++k;
+
+	unsigned index = (unsigned)( ( k >> 3 ) + 1 );
+	*K = -( -348 + (int)( index << 3 ) );	// decimal exponent no need lookup table
+	return XMLDiyFp( cachedPowersF[index], cachedPowersE[index] );
+}
+
+
+static void GrisuRound( char* buffer, int len, XMLUInt64 delta, XMLUInt64 rest, XMLUInt64 tenKappa, XMLUInt64 wpw )
+{
+	while (    rest < wpw
+			&& delta - rest >= tenKappa
+			&& ( rest + tenKappa < wpw || wpw - rest > rest + tenKappa - wpw ) )
+	{
+		buffer[len-1]--;
+		rest += tenKappa;
+	}
+}
+
+
+static void DigitGen( const XMLDiyFp& W, const XMLDiyFp& Mp, XMLUInt64 delta, char* buffer, int* len, int* K )
+{
+	const XMLDiyFp one( 1ULL << -Mp.e, Mp.e );
+	const XMLDiyFp wpw = Mp - W;
+	unsigned p1 = (unsigned)( Mp.f >> -one.e );
+	XMLUInt64 p2 = Mp.f & ( one.f - 1 );
+	int kappa = CountDigits( p1 );
+	*len = 0;
+
+	while ( kappa > 0 )
+	{
+		unsigned d = p1 / powersOfTen32[kappa-1];
+		p1 %= powersOfTen32[kappa-1];
+		if ( d || *len )
+			buffer[(*len)++] = (char)( '0' + d );
+		--kappa;
+		XMLUInt64 tmp = ( (XMLUInt64) p1 << -one.e ) + p2;
+		if ( tmp <= delta )
+		{
+			*K += kappa;
+			GrisuRound( buffer, *len, delta, tmp, (XMLUInt64) powersOfTen32[kappa] << -one.e, wpw.f );
+			return;
+		}
+	}
+
+	for( ;; )
+	{
+		p2 *= 10;
+		delta *= 10;
+		char d = (char)( p2 >> -one.e );
+		if ( d || *len )
+			buffer[(*len)++] = (char)( '0' + d );
+		p2 &= one.f - 1;
+		--kappa;
+		if ( p2 < delta )
+		{
+			*K += kappa;
+			int index = -kappa;
+			GrisuRound( buffer, *len, delta, p2, one.f, wpw.f * ( index < 20 ? powersOfTen64[index] : 0 ) );
+			return;
+		}
+	}
+}
+
+
+// Shortest digits of a positive, finite, non-zero value: value = digits * 10^K.
+static void Grisu2( double value, char* buffer, int* length, int* K )
+{
+	const XMLDiyFp v( value );
+	XMLDiyFp mMinus, mPlus;
+	v.NormalizedBoundaries( &mMinus, &mPlus );
+
+	const XMLDiyFp cMinusK = GetCachedPower( mPlus.e, K );
+	const XMLDiyFp W = v.Normalize() * cMinusK;
+	XMLDiyFp Wp = mPlus * cMinusK;
+	XMLDiyFp Wm = mMinus * cMinusK;
+	Wm.f++;
+	Wp.f--;
+	DigitGen( W, Wp, Wp.f - Wm.f, buffer, length, K );
+}
+
+
+// Lay out 'length' digits (value = digits * 10^k) in place, the way printf
+// "%.17g" would: plain notation for exponents from -4 to 16, scientific
+// with at least two exponent digits otherwise.
+static size_t Prettify( char* buffer, int length, int k )
+{
+	const int kk = length + k;	// 10^(kk-1) <= v < 10^kk
+
+	if ( length <= kk && kk <= 17 )
+	{
+		// 1234e2 -> 123400
+		for ( int i = length; i < kk; ++i )
+			buffer[i] = '0';
+		return kk;
+	}
+	else if ( 0 < kk && kk <= 17 )
+	{
+		// 1234e-2 -> 12.34
+		memmove( &buffer[kk + 1], &buffer[kk], length - kk );
+		buffer[kk] = '.';
+		return length + 1;
+	}
+	else if ( -4 < kk && kk <= 0 )
+	{
+		// 1234e-6 -> 0.001234
+		const int offset = 2 - kk;
+		memmove( &buffer[offset], &buffer[0], length );
+		buffer[0] = '0';
+		buffer[1] = '.';
+		for ( int i = 2; i < offset; ++i )
+			buffer[i] = '0';
+		return length + offset;
+	}
+
+	// 1234e30 -> 1.234e+33
+	size_t n;
+	if ( length == 1 )
+	{
+		n = 1;
+	}
+	else
+	{
+		memmove( &buffer[2], &buffer[1], length - 1 );
+		buffer[1] = '.';
+		n = length + 1;
+	}
+	int exponent = kk - 1;
+	buffer[n++] = 'e';
+	if ( exponent < 0 )
+	{
+		buffer[n++] = '-';
+		exponent = -exponent;
+	}
+	else
+	{
+		buffer[n++] = '+';
+	}
+	int count = exponent < 10 ? 2 : CountDigits( (unsigned) exponent );
+	WriteDigits( (unsigned) exponent, &buffer[n + count] );
+	if ( exponent < 10 )
+		buffer[n] = '0';
+	return n + count;
+}
+
+
+size_t XMLBase::FormatDouble( double value, char* buffer )
+{
+	char* p = buffer;
+
+	if ( value != value )
+	{
+		memcpy( p, "nan", 3 );
+		return 3;
+	}
+	XMLUInt64 bits;
+	memcpy( &bits, &value, sizeof( bits ) );
+	if ( bits >> 63 )
+	{
+		*p++ = '-';
+		value = -value;
+	}
+	if ( value == 0.0 )
+	{
+		*p++ = '0';
+		return p - buffer;
+	}
+	if ( value > 1.7976931348623157e308 )
+	{
+		memcpy( p, "inf", 3 );
+		return ( p - buffer ) + 3;
+	}
+
+	int length, K;
+	Grisu2( value, p, &length, &K );
+	return ( p - buffer ) + Prettify( p, length, K );
+}
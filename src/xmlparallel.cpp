@@ -0,0 +1,351 @@
+#include "xmlparallel.h"
+
+#ifdef XML_THREADS
+
+#include <atomic>
+#include <thread>
+
+#if defined( _WIN32 )
+#include <io.h>
+#else
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+// Subtrees lighter than this are never handed to a worker on their own;
+// below it the cost of a thread hand-off outweighs the printing.
+static const size_t MIN_GRAIN = 4096;
+// How many segments to aim for per worker, so that uneven subtrees even out.
+static const size_t SEGMENTS_PER_THREAD = 8;
+// How deep the planner will cut elements open.
+static const int MAX_SPLIT_DEPTH = 64;
+
+
+// A XMLPrinter that can start part way into a document.
+class XMLParallelPrinter::SegmentPrinter : public XMLPrinter
+{
+public:
+	SegmentPrinter( const std::string& _indent, const std::string& _lineBreak, int _depth )
+	{
+		indent = _indent;
+		lineBreak = _lineBreak;
+		depth = _depth;
+	}
+
+	void SetDepth( int _depth )		{ depth = _depth; }
+	void TakeBuffer( std::string* str )	{ str->swap( buffer ); buffer.clear(); }
+};
+
+
+// The printing cost of a node: one per node plus its text, in 64 byte units.
+// Counting stops once 'cap' is passed, so sizing a big subtree is cheap.
+static size_t SubtreeWeight( const XMLNode* node, size_t cap )
+{
+	size_t weight = 1 + ( node->ValueTStr().size() >> 6 );
+	for( const XMLAttribute* attrib = node->ToElement() ? node->ToElement()->FirstAttribute() : 0;
+		 attrib;
+		 attrib = attrib->Next() )
+	{
+		weight += 1 + ( attrib->ValueStr().size() >> 6 );
+	}
+	for( const XMLNode* child = node->FirstChild(); child && weight <= cap; child = child->NextSibling() )
+		weight += SubtreeWeight( child, cap - weight );
+	return weight;
+}
+
+
+// True if XMLPrinter prints the element on one line, with its text inline.
+// Such an element can't be cut open: its parts depend on each other.
+static bool IsSimpleTextElement( const XMLElement* element )
+{
+	const XMLNode* child = element->FirstChild();
+	return    child
+		   && child->ToText()
+		   && element->LastChild() == child
+		   && !child->ToText()->CDATA();
+}
+
+
+XMLParallelPrinter::XMLParallelPrinter( unsigned _threads )
+	: threads( _threads ), indent( "    " ), lineBreak( "\n" )
+{
+	if ( threads == 0 )
+		threads = std::thread::hardware_concurrency();
+	if ( threads == 0 )
+		threads = 1;
+}
+
+
+void XMLParallelPrinter::AddText( const std::string& str )
+{
+	if ( str.empty() )
+		return;
+	// Adjacent tags are merged into one segment.
+	if ( !segments.empty() && !segments.back().first )
+	{
+		segments.back().text += str;
+		return;
+	}
+	Segment segment;
+	segment.first = 0;
+	segment.count = 0;
+	segment.depth = 0;
+	segment.text = str;
+	segments.push_back( segment );
+}
+
+
+void XMLParallelPrinter::AddRun( const XMLNode* first, size_t count, int depth )
+{
+	Segment segment;
+	segment.first = first;
+	segment.count = count;
+	segment.depth = depth;
+	segments.push_back( segment );
+}
+
+
+// Cut the children of 'parent' into runs of about 'grain' weight. A child
+// heavier than that is cut open in turn: its start and end tags are printed
+// here, and its own children planned one level deeper.
+void XMLParallelPrinter::Plan( const XMLNode* parent, int depth, size_t grain, int splitsLeft )
+{
+	const XMLNode* runStart = 0;
+	size_t runCount = 0;
+	size_t runWeight = 0;
+
+	for( const XMLNode* node = parent->FirstChild(); node; node = node->NextSibling() )
+	{
+		size_t weight = SubtreeWeight( node, grain );
+		const XMLElement* element = node->ToElement();
+
+		if (    weight > grain
+			 && element
+			 && splitsLeft > 0
+			 && element->FirstChild()
+			 && !IsSimpleTextElement( element ) )
+		{
+			if ( runStart )
+			{
+				AddRun( runStart, runCount, depth );
+				runStart = 0;
+			}
+
+			SegmentPrinter printer( indent, lineBreak, depth );
+			std::string tag;
+			printer.VisitEnter( *element, element->FirstAttribute() );
+			printer.TakeBuffer( &tag );
+			AddText( tag );
+
+			Plan( element, depth+1, grain, splitsLeft-1 );
+
+			printer.SetDepth( depth+1 );
+			printer.VisitExit( *element );
+			printer.TakeBuffer( &tag );
+			AddText( tag );
+			continue;
+		}
+
+		if ( runStart && runWeight + weight > grain )
+		{
+			AddRun( runStart, runCount, depth );
+			runStart = 0;
+		}
+		if ( !runStart )
+		{
+			runStart = node;
+			runCount = 0;
+			runWeight = 0;
+		}
+		++runCount;
+		runWeight += weight;
+	}
+	if ( runStart )
+		AddRun( runStart, runCount, depth );
+}
+
+
+void XMLParallelPrinter::PrintSegment( Segment* segment ) const
+{
+	SegmentPrinter printer( indent, lineBreak, segment->depth );
+	const XMLNode* node = segment->first;
+	for( size_t i=0; i<segment->count; ++i, node = node->NextSibling() )
+		node->Accept( &printer );
+	printer.TakeBuffer( &segment->text );
+}
+
+
+void XMLParallelPrinter::Print( const XMLNode& node )
+{
+	segments.clear();
+
+	size_t total = SubtreeWeight( &node, (size_t)-1 );
+	size_t grain = total / ( threads * SEGMENTS_PER_THREAD );
+	if ( grain < MIN_GRAIN )
+		grain = MIN_GRAIN;
+
+	if ( threads == 1 || total <= grain )
+	{
+		AddRun( &node, 1, 0 );
+		PrintSegment( &segments[0] );
+		return;
+	}
+
+	// The document itself prints nothing; an element is cut open like any other.
+	const XMLElement* element = node.ToElement();
+	if ( element && element->FirstChild() && !IsSimpleTextElement( element ) )
+	{
+		SegmentPrinter printer( indent, lineBreak, 0 );
+		std::string tag;
+		printer.VisitEnter( *element, element->FirstAttribute() );
+		printer.TakeBuffer( &tag );
+		AddText( tag );
+
+		Plan( element, 1, grain, MAX_SPLIT_DEPTH );
+
+		printer.SetDepth( 1 );
+		printer.VisitExit( *element );
+		printer.TakeBuffer( &tag );
+		AddText( tag );
+	}
+	else if ( node.ToDocument() )
+	{
+		Plan( &node, 0, grain, MAX_SPLIT_DEPTH );
+	}
+	else
+	{
+		AddRun( &node, 1, 0 );
+	}
+
+	// Workers take the next unprinted run until none are left. Every run
+	// prints into its own segment, so no further ordering is needed.
+	std::atomic<size_t> next( 0 );
+	auto work = [this, &next]()
+	{
+		for( ;; )
+		{
+			size_t i = next++;
+			if ( i >= segments.size() )
+				return;
+			if ( segments[i].first )
+				PrintSegment( &segments[i] );
+		}
+	};
+
+	size_t workers = threads;
+	if ( workers > segments.size() )
+		workers = segments.size();
+
+	std::vector<std::thread> pool;
+	pool.reserve( workers );
+	for( size_t i=1; i<workers; ++i )
+		pool.push_back( std::thread( work ) );
+	work();
+	for( size_t i=0; i<pool.size(); ++i )
+		pool[i].join();
+}
+
+
+size_t XMLParallelPrinter::Size() const
+{
+	size_t size = 0;
+	for( size_t i=0; i<segments.size(); ++i )
+		size += segments[i].text.size();
+	return size;
+}
+
+
+std::string XMLParallelPrinter::Str() const
+{
+	std::string str;
+	str.reserve( Size() );
+	for( size_t i=0; i<segments.size(); ++i )
+		str += segments[i].text;
+	return str;
+}
+
+
+bool XMLParallelPrinter::Write( FILE* fp ) const
+{
+	for( size_t i=0; i<segments.size(); ++i )
+	{
+		const std::string& text = segments[i].text;
+		if ( !text.empty() && fwrite( text.data(), 1, text.size(), fp ) != text.size() )
+			return false;
+	}
+	return true;
+}
+
+
+bool XMLParallelPrinter::Write( int fd ) const
+{
+#if defined( _WIN32 )
+	for( size_t i=0; i<segments.size(); ++i )
+	{
+		const char* data = segments[i].text.data();
+		size_t size = segments[i].text.size();
+		while ( size )
+		{
+			unsigned chunk = size > 0x40000000 ? 0x40000000 : (unsigned) size;
+			int n = _write( fd, data, chunk );
+			if ( n <= 0 )
+				return false;
+			data += n;
+			size -= n;
+		}
+	}
+	return true;
+#else
+	#ifdef IOV_MAX
+	const size_t maxVectors = IOV_MAX;
+	#else
+	const size_t maxVectors = 16;
+	#endif
+
+	std::vector<struct iovec> vectors;
+	vectors.reserve( segments.size() );
+	for( size_t i=0; i<segments.size(); ++i )
+	{
+		if ( segments[i].text.empty() )
+			continue;
+		struct iovec v;
+		v.iov_base = const_cast< char* >( segments[i].text.data() );
+		v.iov_len = segments[i].text.size();
+		vectors.push_back( v );
+	}
+
+	size_t first = 0;
+	while ( first < vectors.size() )
+	{
+		size_t count = vectors.size() - first;
+		if ( count > maxVectors )
+			count = maxVectors;
+
+		ssize_t n = writev( fd, &vectors[first], (int) count );
+		if ( n < 0 )
+		{
+			if ( errno == EINTR )
+				continue;
+			return false;
+		}
+
+		// Step over what was written; a short write leaves a partial vector.
+		size_t written = (size_t) n;
+		while ( first < vectors.size() && written >= vectors[first].iov_len )
+		{
+			written -= vectors[first].iov_len;
+			++first;
+		}
+		if ( written )
+		{
+			vectors[first].iov_base = (char*) vectors[first].iov_base + written;
+			vectors[first].iov_len -= written;
+		}
+	}
+	return true;
+#endif
+}
+
+#endif
@@ -1,4 +1,31 @@
 #include <ctype.h>
+#include <errno.h>
+#include <locale.h>
+#include <math.h>
+
+#if defined( _WIN32 )
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Where the system can be told which part of a file is read next, so that
+// it reads it ahead while LoadFile() works on the part before.
+#if defined( POSIX_FADV_WILLNEED )
+#	define XML_READ_AHEAD
+#endif
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#	include <emmintrin.h>
+#	if defined( _MSC_VER )
+#		include <intrin.h>
+#	endif
+#	define XML_ENCODE_SSE2
+#elif defined( __aarch64__ ) || defined( _M_ARM64 )
+#	include <arm_neon.h>
+#	define XML_ENCODE_NEON
+#endif
 
 #ifdef USE_STL
 #include <sstream>
@@ -25,16 +52,148 @@ FILE* XMLFOpen( const char* filename, const char* mode )
 	#endif
 }
 
-void XMLBase::EncodeString( const STRING& str, STRING* outString )
+XMLFileWriter::XMLFileWriter( FILE* _file ) : file( _file ), buffer( inlineBuffer ), capacity( INLINE_SIZE ), used( 0 ), failed( false )
+{
+	assert( file );
+}
+
+
+void XMLFileWriter::Grow()
+{
+	if ( buffer != inlineBuffer )
+		return;
+	buffer = new char[ BUFFER_SIZE ];
+	memcpy( buffer, inlineBuffer, used );
+	capacity = BUFFER_SIZE;
+}
+
+
+void XMLFileWriter::Put( const char* data, size_t size )
+{
+	XML_TRACE_FLUSH( size );
+	if ( fwrite( data, 1, size, file ) != size )
+		failed = true;
+}
+
+
+void XMLFileWriter::Flush()
+{
+	if ( used )
+	{
+		Put( buffer, used );
+		used = 0;
+	}
+}
+
+
+void XMLFileWriter::WriteEncoded( const STRING& str )
+{
+	XMLBase::EncodeString( str.data(), str.length(), *this );
+}
+
+
+void XMLFileWriter::Indent( int depth )
+{
+	// Print() indents with four spaces per level.
+	static const char spaces[] = "                                                                ";
+	const size_t chunk = sizeof( spaces ) - 1;
+
+	size_t n = depth > 0 ? (size_t) depth * 4 : 0;
+	while ( n > chunk )
+	{
+		Write( spaces, chunk );
+		n -= chunk;
+	}
+	Write( spaces, n );
+}
+
+
+size_t XMLBase::FindEncodable( const char* str, size_t length )
+{
+	size_t i = 0;
+
+	#if defined( XML_ENCODE_SSE2 )
+		const __m128i amp   = _mm_set1_epi8( '&' );
+		const __m128i lt    = _mm_set1_epi8( '<' );
+		const __m128i gt    = _mm_set1_epi8( '>' );
+		const __m128i quot  = _mm_set1_epi8( '\"' );
+		const __m128i apos  = _mm_set1_epi8( '\'' );
+		const __m128i ctrl  = _mm_set1_epi8( 0x1f );
+
+		for ( ; i + 16 <= length; i += 16 )
+		{
+			__m128i v = _mm_loadu_si128( (const __m128i*)( str + i ) );
+			__m128i hit = _mm_or_si128(
+				_mm_or_si128( _mm_cmpeq_epi8( v, amp ), _mm_cmpeq_epi8( v, lt ) ),
+				_mm_or_si128( _mm_cmpeq_epi8( v, gt ), _mm_cmpeq_epi8( v, quot ) ) );
+			hit = _mm_or_si128( hit, _mm_cmpeq_epi8( v, apos ) );
+			// v <= 0x1f, unsigned
+			hit = _mm_or_si128( hit, _mm_cmpeq_epi8( _mm_min_epu8( v, ctrl ), v ) );
+
+			int mask = _mm_movemask_epi8( hit );
+			if ( mask )
+			{
+				#if defined( _MSC_VER )
+					unsigned long bit;
+					_BitScanForward( &bit, (unsigned long) mask );
+					return i + bit;
+				#else
+					return i + __builtin_ctz( (unsigned) mask );
+				#endif
+			}
+		}
+	#elif defined( XML_ENCODE_NEON )
+		const uint8x16_t amp   = vdupq_n_u8( '&' );
+		const uint8x16_t lt    = vdupq_n_u8( '<' );
+		const uint8x16_t gt    = vdupq_n_u8( '>' );
+		const uint8x16_t quot  = vdupq_n_u8( '\"' );
+		const uint8x16_t apos  = vdupq_n_u8( '\'' );
+		const uint8x16_t ctrl  = vdupq_n_u8( 0x20 );
+
+		for ( ; i + 16 <= length; i += 16 )
+		{
+			uint8x16_t v = vld1q_u8( (const uint8_t*)( str + i ) );
+			uint8x16_t hit = vorrq_u8(
+				vorrq_u8( vceqq_u8( v, amp ), vceqq_u8( v, lt ) ),
+				vorrq_u8( vceqq_u8( v, gt ), vceqq_u8( v, quot ) ) );
+			hit = vorrq_u8( hit, vorrq_u8( vceqq_u8( v, apos ), vcltq_u8( v, ctrl ) ) );
+			if ( vmaxvq_u8( hit ) )
+				break;	// the scalar loop below finds the exact position
+		}
+	#endif
+
+	for ( ; i < length; ++i )
+	{
+		unsigned char c = (unsigned char) str[i];
+		if ( c < 32 || c == '&' || c == '<' || c == '>' || c == '\"' || c == '\'' )
+			return i;
+	}
+	return length;
+}
+
+
+template< class OUT >
+void XMLBase::EncodeString( const char* str, size_t length, OUT& out )
 {
-	int i=0;
+	static const char hexDigits[] = "0123456789ABCDEF";
+	size_t i = 0;
 
-	while( i<(int)str.length() )
+	while ( i < length )
 	{
+		// Copy the run of plain chars in one go.
+		size_t next = i + FindEncodable( str + i, length - i );
+		if ( next > i )
+		{
+			out.Write( str + i, next - i );
+			i = next;
+			if ( i == length )
+				break;
+		}
+
 		unsigned char c = (unsigned char) str[i];
 
 		if (    c == '&' 
-		     && i < ( (int)str.length() - 2 )
+		     && i + 2 < length
 			 && str[i+1] == '#'
 			 && str[i+2] == 'x' )
 		{
@@ -42,73 +201,343 @@ void XMLBase::EncodeString( const STRING& str, STRING* outString )
 			// Pass through unchanged.
 			// &#xA9;	-- copyright symbol, for example.
 			//
-			// The -1 is a bug fix from Rob Laveaux. It keeps
-			// an overflow from happening if there is no ';'.
-			// There are actually 2 ways to exit this loop -
-			// while fails (error case) and break (semicolon found).
+			// The last char is never passed through here; that keeps
+			// an overflow from happening if there is no ';'. The ';' (or
+			// the last char) is then handled like any other.
 			// However, there is no mechanism (currently) for
 			// this function to return an error.
-			while ( i<(int)str.length()-1 )
-			{
-				outString->append( str.c_str() + i, 1 );
-				++i;
-				if ( str[i] == ';' )
-					break;
-			}
+			size_t end = i + 1;
+			while ( end < length - 1 && str[end] != ';' )
+				++end;
+			out.Write( str + i, end - i );
+			i = end;
 		}
 		else if ( c == '&' )
 		{
-			outString->append( entity[0].str, entity[0].strLength );
+			out.Write( entity[0].str, entity[0].strLength );
 			++i;
 		}
 		else if ( c == '<' )
 		{
-			outString->append( entity[1].str, entity[1].strLength );
+			out.Write( entity[1].str, entity[1].strLength );
 			++i;
 		}
 		else if ( c == '>' )
 		{
-			outString->append( entity[2].str, entity[2].strLength );
+			out.Write( entity[2].str, entity[2].strLength );
 			++i;
 		}
 		else if ( c == '\"' )
 		{
-			outString->append( entity[3].str, entity[3].strLength );
+			out.Write( entity[3].str, entity[3].strLength );
 			++i;
 		}
 		else if ( c == '\'' )
 		{
-			outString->append( entity[4].str, entity[4].strLength );
+			out.Write( entity[4].str, entity[4].strLength );
 			++i;
 		}
-		else if ( c < 32 )
+		else
 		{
-			// Easy pass at non-alpha/numeric/symbol
-			// Below 32 is symbolic.
-			char buf[ 32 ];
-			
-			#if defined(SNPRINTF)		
-				SNPRINTF( buf, sizeof(buf), "&#x%02X;", (unsigned) ( c & 0xff ) );
-			#else
-				sprintf( buf, "&#x%02X;", (unsigned) ( c & 0xff ) );
-			#endif		
-
-			//*ME:	warning C4267: convert 'size_t' to 'int'
-			//*ME:	Int-Cast to make compiler happy ...
-			outString->append( buf, (int)strlen( buf ) );
+			// Below 32 is symbolic: &#xHH;
+			char buf[6] = { '&', '#', 'x', hexDigits[ c >> 4 ], hexDigits[ c & 0xf ], ';' };
+			out.Write( buf, 6 );
 			++i;
 		}
+	}
+}
+
+
+// Lets EncodeString() append to a string the same way it writes to a XMLFileWriter.
+class XMLStringAppender
+{
+public:
+	XMLStringAppender( STRING* _str ) : str( _str ) {}
+	void Write( const char* data, size_t size )	{ str->append( data, size ); }
+private:
+	STRING* str;
+};
+
+
+void XMLBase::EncodeString( const STRING& str, STRING* outString )
+{
+	XMLStringAppender out( outString );
+	EncodeString( str.data(), str.length(), out );
+}
+
+
+// Powers of ten that are exactly representable as a double.
+static const double exactPowersOfTen[] =
+{
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+// The rare inputs the fast path can't round correctly (long mantissas, large
+// exponents, hex, inf and nan) go to strtod. strtod expects the decimal point
+// of the current C locale, so give it a translated copy when that isn't '.'.
+// A value too large for a double is WRONG_TYPE, like an int out of range;
+// "inf" itself is a value.
+static int SlowConvertToDouble( const char* str, double* dval )
+{
+	const char* point = localeconv()->decimal_point;
+	char* end = 0;
+	double d;
+
+	errno = 0;
+	if ( point[0] == '.' && point[1] == 0 )
+	{
+		d = strtod( str, &end );
+		if ( end == str )
+			return WRONG_TYPE;
+	}
+	else
+	{
+		// Only the characters strtod may take are copied; the copy is on
+		// the stack unless the number is very long.
+		static const char numberChars[] = "0123456789abcdefABCDEFinityINITYxXpP+-.";
+		size_t length = strspn( str, numberChars );
+		size_t pointLength = strlen( point );
+		size_t points = 0;
+		for ( size_t i = 0; i < length; ++i )
+		{
+			if ( str[i] == '.' )
+				++points;
+		}
+
+		char stackBuf[128];
+		size_t size = length + points * ( pointLength - 1 ) + 1;
+		char* buf = size <= sizeof( stackBuf ) ? stackBuf : new char[size];
+		size_t n = 0;
+		for ( size_t i = 0; i < length; ++i )
+		{
+			if ( str[i] == '.' )
+			{
+				memcpy( buf + n, point, pointLength );
+				n += pointLength;
+			}
+			else
+			{
+				buf[n++] = str[i];
+			}
+		}
+		buf[n] = 0;
+		d = strtod( buf, &end );
+		bool parsed = ( end != buf );
+		if ( buf != stackBuf )
+			delete [] buf;
+		if ( !parsed )
+			return WRONG_TYPE;
+	}
+	if ( errno == ERANGE && ( d == HUGE_VAL || d == -HUGE_VAL ) )
+		return WRONG_TYPE;
+	*dval = d;
+	return SUCCESS;
+}
+
+
+int XMLBase::ConvertToInt( const char* str, int* ival )
+{
+	const char* p = str;
+	while ( IsWhiteSpace( *p ) )
+		++p;
+
+	bool negative = false;
+	if ( *p == '-' || *p == '+' )
+	{
+		negative = ( *p == '-' );
+		++p;
+	}
+	if ( *p < '0' || *p > '9' )
+		return WRONG_TYPE;
+
+	// Accumulate as a positive magnitude, allowing one more for INT_MIN.
+	const unsigned long limit = negative ? 2147483648UL : 2147483647UL;
+	unsigned long magnitude = 0;
+	for ( ; *p >= '0' && *p <= '9'; ++p )
+	{
+		magnitude = magnitude * 10 + (unsigned long)( *p - '0' );
+		if ( magnitude > limit )
+			return WRONG_TYPE;
+	}
+	*ival = negative ? (int)( 0UL - magnitude ) : (int) magnitude;
+	return SUCCESS;
+}
+
+
+int XMLBase::ConvertToUnsigned( const char* str, unsigned* uval )
+{
+	const char* p = str;
+	while ( IsWhiteSpace( *p ) )
+		++p;
+
+	// A leading '-' negates modulo 2^32, as strtoul (and the old int cast) does.
+	bool negative = false;
+	if ( *p == '-' || *p == '+' )
+	{
+		negative = ( *p == '-' );
+		++p;
+	}
+	if ( *p < '0' || *p > '9' )
+		return WRONG_TYPE;
+
+	unsigned long magnitude = 0;
+	for ( ; *p >= '0' && *p <= '9'; ++p )
+	{
+		magnitude = magnitude * 10 + (unsigned long)( *p - '0' );
+		if ( magnitude > 4294967295UL )
+			return WRONG_TYPE;
+	}
+	*uval = negative ? (unsigned)( 0UL - magnitude ) : (unsigned) magnitude;
+	return SUCCESS;
+}
+
+
+int XMLBase::ConvertToDouble( const char* str, double* dval )
+{
+	const char* p = str;
+	while ( IsWhiteSpace( *p ) )
+		++p;
+	const char* start = p;
+
+	bool negative = false;
+	if ( *p == '-' || *p == '+' )
+	{
+		negative = ( *p == '-' );
+		++p;
+	}
+
+	// Hex floats, inf and nan.
+	if ( ( p[0] == '0' && ( p[1] == 'x' || p[1] == 'X' ) ) || ( isalpha( (unsigned char) *p ) ) )
+	{
+		return SlowConvertToDouble( start, dval );
+	}
+
+	// Up to 19 significant decimal digits fit in the mantissa. Leading
+	// zeros are not significant; digits beyond 19 send us to the slow path.
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool anyDigit = false;
+	bool truncated = false;
+
+	for ( ; *p >= '0' && *p <= '9'; ++p )
+	{
+		anyDigit = true;
+		if ( digits < 19 )
+		{
+			mantissa = mantissa * 10 + (unsigned)( *p - '0' );
+			if ( mantissa )
+				++digits;
+		}
 		else
 		{
-			//char realc = (char) c;
-			//outString->append( &realc, 1 );
-			*outString += (char) c;	// somewhat more efficient function call.
-			++i;
+			++exponent;
+			truncated = truncated || *p != '0';
+		}
+	}
+	if ( *p == '.' )
+	{
+		for ( ++p; *p >= '0' && *p <= '9'; ++p )
+		{
+			anyDigit = true;
+			if ( digits < 19 )
+			{
+				mantissa = mantissa * 10 + (unsigned)( *p - '0' );
+				if ( mantissa )
+					++digits;
+				--exponent;
+			}
+			else
+			{
+				truncated = truncated || *p != '0';
+			}
+		}
+	}
+	if ( !anyDigit )
+		return WRONG_TYPE;
+
+	// The exponent is only taken if there are digits after the 'e'.
+	if ( *p == 'e' || *p == 'E' )
+	{
+		const char* q = p + 1;
+		bool negativeExponent = false;
+		if ( *q == '-' || *q == '+' )
+		{
+			negativeExponent = ( *q == '-' );
+			++q;
+		}
+		if ( *q >= '0' && *q <= '9' )
+		{
+			int e = 0;
+			for ( ; *q >= '0' && *q <= '9'; ++q )
+			{
+				if ( e < 100000 )
+					e = e * 10 + ( *q - '0' );
+			}
+			exponent += negativeExponent ? -e : e;
 		}
 	}
+
+	if ( mantissa == 0 && !truncated )
+	{
+		*dval = negative ? -0.0 : 0.0;
+		return SUCCESS;
+	}
+
+	// Clinger's fast path: both the mantissa and the power of ten are exact
+	// doubles, so one multiply or divide rounds correctly.
+	if ( !truncated && mantissa <= ( 1ULL << 53 ) && exponent >= -22 && exponent <= 22 )
+	{
+		double d = (double) mantissa;
+		if ( exponent < 0 )
+			d /= exactPowersOfTen[ -exponent ];
+		else
+			d *= exactPowersOfTen[ exponent ];
+		*dval = negative ? -d : d;
+		return SUCCESS;
+	}
+
+	return SlowConvertToDouble( start, dval );
 }
 
 
+// Case insensitive test that 'str' starts with 'prefix'. ASCII only.
+static bool StartsWithNoCase( const char* str, const char* prefix )
+{
+	for ( ; *prefix; ++str, ++prefix )
+	{
+		if ( tolower( (unsigned char) *str ) != *prefix )
+			return false;
+	}
+	return true;
+}
+
+
+int XMLBase::ConvertToBool( const char* str, bool* bval )
+{
+	if (    StartsWithNoCase( str, "true" )
+		 || StartsWithNoCase( str, "yes" )
+		 || StartsWithNoCase( str, "1" ) )
+	{
+		*bval = true;
+		return SUCCESS;
+	}
+	if (    StartsWithNoCase( str, "false" )
+		 || StartsWithNoCase( str, "no" )
+		 || StartsWithNoCase( str, "0" ) )
+	{
+		*bval = false;
+		return SUCCESS;
+	}
+	return WRONG_TYPE;
+}
+
+
+const size_t XMLNode::NO_SOURCE;
+
+
 XMLNode::XMLNode( NodeType _type ) : XMLBase()
 {
 	parent = 0;
@@ -117,6 +546,13 @@ XMLNode::XMLNode( NodeType _type ) : XMLBase()
 	lastChild = 0;
 	prev = 0;
 	next = 0;
+	sourceOffset = NO_SOURCE;
+	sourceLength = 0;
+	#ifdef XML_THREADS
+	shared = 0;
+	#endif
+	fingerprintLow = 0;
+	fingerprintHigh = 0;
 }
 
 
@@ -131,17 +567,135 @@ XMLNode::~XMLNode()
 		node = node->next;
 		delete temp;
 	}	
+	#ifdef XML_THREADS
+	delete shared;
+	#endif
 }
 
 
 void XMLNode::CopyTo( XMLNode* target ) const
 {
-	target->SetValue (value.c_str() );
+	target->value = value;
 	target->userData = userData; 
 	target->location = location;
+	// A copy wasn't parsed, even from the same text.
+	target->SetSource( NO_SOURCE, 0 );
+	target->ContentChanged();
+}
+
+
+void XMLNode::CopyChildrenTo( XMLNode* target ) const
+{
+	#ifdef XML_THREADS
+	// Still shared: the copy shares the same children, whatever their number.
+	if ( shared )
+	{
+		target->shared = new SharedChildren( *shared );
+		return;
+	}
+	#endif
+	for ( const XMLNode* node = firstChild; node; node = node->next )
+	{
+		target->LinkEndChild( node->Clone() );
+	}
+}
+
+
+#ifdef XML_CXX11
+void XMLNode::MoveFrom( XMLNode& source )
+{
+	Clear();
+
+	value.swap( source.value );
+	source.value.clear();
+	userData = source.userData;
+	location = source.location;
+	SetSource( source.sourceOffset, source.sourceLength );
+	source.SetSource( NO_SOURCE, 0 );
+
+	// The children change parent, but are otherwise left where they are.
+	firstChild = source.firstChild;
+	lastChild = source.lastChild;
+	source.firstChild = 0;
+	source.lastChild = 0;
+	for ( XMLNode* node = firstChild; node; node = node->next )
+	{
+		node->parent = this;
+	}
+
+	#ifdef XML_THREADS
+	shared = source.shared;
+	source.shared = 0;
+	#endif
+	ContentChanged();
+	source.ContentChanged();
+}
+#endif
+
+
+#ifdef XML_THREADS
+void XMLNode::ShareChildrenWith( XMLNode* target, const std::shared_ptr<const XMLDocument>& owner ) const
+{
+	if ( shared )
+	{
+		target->shared = new SharedChildren( *shared );
+	}
+	else if ( firstChild )
+	{
+		target->shared = new SharedChildren();
+		target->shared->source = this;
+		target->shared->owner = owner;
+	}
+}
+
+
+void XMLNode::CopySharedChildren()
+{
+	SharedChildren* from = shared;
+	shared = 0;
+	XMLAllocatorScope allocatorScope( NodeAllocator() );
+
+	// The source belongs to a snapshot, which never has shared nodes, so
+	// it is only read here. The content doesn't change: the copies are
+	// linked directly rather than with LinkEndChild(), so that this node
+	// and its ancestors keep their fingerprints, and take the fingerprints
+	// of their originals.
+	for ( const XMLNode* node = from->source->firstChild; node; node = node->next )
+	{
+		XMLNode* copy = node->CloneShared( from->owner );
+		copy->CopyFingerprint( *node );
+		copy->parent = this;
+		copy->prev = lastChild;
+		copy->next = 0;
+		if ( lastChild )
+			lastChild->next = copy;
+		else
+			firstChild = copy;
+		lastChild = copy;
+	}
+	delete from;
 }
 
 
+void XMLNode::UnshareAll()
+{
+	// Walk the subtree in document order; FirstChild() does the copying.
+	XMLNode* node = this;
+	while ( node )
+	{
+		if ( node->FirstChild() )
+		{
+			node = node->firstChild;
+			continue;
+		}
+		while ( node != this && !node->next )
+			node = node->parent;
+		node = ( node == this ) ? 0 : node->next;
+	}
+}
+#endif
+
+
 void XMLNode::Clear()
 {
 	XMLNode* node = firstChild;
@@ -156,11 +710,19 @@ void XMLNode::Clear()
 
 	firstChild = 0;
 	lastChild = 0;
+
+	#ifdef XML_THREADS
+	delete shared;
+	shared = 0;
+	#endif
+	ContentChanged();
 }
 
 
 XMLNode* XMLNode::LinkEndChild( XMLNode* node )
 {
+	Unshare();
+
 	assert( node->parent == 0 || node->parent == this );
 	assert( node->GetDocument() == 0 || node->GetDocument() == this->GetDocument() );
 
@@ -172,6 +734,7 @@ XMLNode* XMLNode::LinkEndChild( XMLNode* node )
 		return 0;
 	}
 
+	ContentChanged();
 	node->parent = this;
 
 	node->prev = lastChild;
@@ -195,6 +758,7 @@ XMLNode* XMLNode::InsertEndChild( const XMLNode& addThis )
 			GetDocument()->SetError( ERROR_DOCUMENT_TOP_ONLY, 0, 0, ENCODING_UNKNOWN );
 		return 0;
 	}
+	XMLAllocatorScope allocatorScope( NodeAllocator() );
 	XMLNode* node = addThis.Clone();
 	if ( !node )
 		return 0;
@@ -203,6 +767,22 @@ XMLNode* XMLNode::InsertEndChild( const XMLNode& addThis )
 }
 
 
+#ifdef XML_CXX11
+XMLNode* XMLNode::InsertEndChild( XMLElement&& addThis )
+{
+	XMLAllocatorScope allocatorScope( NodeAllocator() );
+	return LinkEndChild( new XMLElement( static_cast< XMLElement&& >( addThis ) ) );
+}
+
+
+XMLNode* XMLNode::InsertEndChild( XMLText&& addThis )
+{
+	XMLAllocatorScope allocatorScope( NodeAllocator() );
+	return LinkEndChild( new XMLText( static_cast< XMLText&& >( addThis ) ) );
+}
+#endif
+
+
 XMLNode* XMLNode::InsertBeforeChild( XMLNode* beforeThis, const XMLNode& addThis )
 {	
 	if ( !beforeThis || beforeThis->parent != this ) {
@@ -215,9 +795,11 @@ XMLNode* XMLNode::InsertBeforeChild( XMLNode* beforeThis, const XMLNode& addThis
 		return 0;
 	}
 
+	XMLAllocatorScope allocatorScope( NodeAllocator() );
 	XMLNode* node = addThis.Clone();
 	if ( !node )
 		return 0;
+	ContentChanged();
 	node->parent = this;
 
 	node->next = beforeThis;
@@ -248,9 +830,11 @@ XMLNode* XMLNode::InsertAfterChild( XMLNode* afterThis, const XMLNode& addThis )
 		return 0;
 	}
 
+	XMLAllocatorScope allocatorScope( NodeAllocator() );
 	XMLNode* node = addThis.Clone();
 	if ( !node )
 		return 0;
+	ContentChanged();
 	node->parent = this;
 
 	node->prev = afterThis;
@@ -285,10 +869,12 @@ XMLNode* XMLNode::ReplaceChild( XMLNode* replaceThis, const XMLNode& withThis )
 		return 0;
 	}
 
+	XMLAllocatorScope allocatorScope( NodeAllocator() );
 	XMLNode* node = withThis.Clone();
 	if ( !node )
 		return 0;
 
+	ContentChanged();
 	node->next = replaceThis->next;
 	node->prev = replaceThis->prev;
 
@@ -320,6 +906,7 @@ bool XMLNode::RemoveChild( XMLNode* removeThis )
 		return false;
 	}
 
+	ContentChanged();
 	if ( removeThis->next )
 		removeThis->next->prev = removeThis->prev;
 	else
@@ -337,7 +924,7 @@ bool XMLNode::RemoveChild( XMLNode* removeThis )
 const XMLNode* XMLNode::FirstChild( const char * _value ) const
 {
 	const XMLNode* node;
-	for ( node = firstChild; node; node = node->next )
+	for ( node = FirstChild(); node; node = node->next )
 	{
 		if ( strcmp( node->Value(), _value ) == 0 )
 			return node;
@@ -349,7 +936,7 @@ const XMLNode* XMLNode::FirstChild( const char * _value ) const
 const XMLNode* XMLNode::LastChild( const char * _value ) const
 {
 	const XMLNode* node;
-	for ( node = lastChild; node; node = node->prev )
+	for ( node = LastChild(); node; node = node->prev )
 	{
 		if ( strcmp( node->Value(), _value ) == 0 )
 			return node;
@@ -366,7 +953,7 @@ const XMLNode* XMLNode::IterateChildren( const XMLNode* previous ) const
 	}
 	else
 	{
-		assert( previous->parent == this );
+		assert( previous->parent == ChildSource() );
 		return previous->NextSibling();
 	}
 }
@@ -380,7 +967,7 @@ const XMLNode* XMLNode::IterateChildren( const char * val, const XMLNode* previo
 	}
 	else
 	{
-		assert( previous->parent == this );
+		assert( previous->parent == ChildSource() );
 		return previous->NextSibling( val );
 	}
 }
@@ -498,9 +1085,17 @@ const XMLDocument* XMLNode::GetDocument() const
 }
 
 
+XMLAllocator* XMLNode::NodeAllocator() const
+{
+	const XMLDocument* document = GetDocument();
+	return document ? document->Allocator() : XMLAllocator::Current();
+}
+
+
 XMLElement::XMLElement (const char * _value)
 	: XMLNode( XMLNode::TINYXML_ELEMENT )
 {
+	attributeSet.SetOwner( this );
 	firstChild = lastChild = 0;
 	value = _value;
 }
@@ -510,6 +1105,7 @@ XMLElement::XMLElement (const char * _value)
 XMLElement::XMLElement( const std::string& _value ) 
 	: XMLNode( XMLNode::TINYXML_ELEMENT )
 {
+	attributeSet.SetOwner( this );
 	firstChild = lastChild = 0;
 	value = _value;
 }
@@ -519,6 +1115,7 @@ XMLElement::XMLElement( const std::string& _value )
 XMLElement::XMLElement( const XMLElement& copy)
 	: XMLNode( XMLNode::TINYXML_ELEMENT )
 {
+	attributeSet.SetOwner( this );
 	firstChild = lastChild = 0;
 	copy.CopyTo( this );	
 }
@@ -532,6 +1129,29 @@ XMLElement& XMLElement::operator=( const XMLElement& base )
 }
 
 
+#ifdef XML_CXX11
+XMLElement::XMLElement( XMLElement&& other )
+	: XMLNode( XMLNode::TINYXML_ELEMENT )
+{
+	attributeSet.SetOwner( this );
+	MoveFrom( other );
+	attributeSet.MoveFrom( other.attributeSet );
+}
+
+
+XMLElement& XMLElement::operator=( XMLElement&& other )
+{
+	if ( &other != this )
+	{
+		ClearThis();
+		MoveFrom( other );
+		attributeSet.MoveFrom( other.attributeSet );
+	}
+	return *this;
+}
+#endif
+
+
 XMLElement::~XMLElement()
 {
 	ClearThis();
@@ -649,10 +1269,7 @@ int XMLElement::QueryUnsignedAttribute( const char* name, unsigned* value ) cons
 	if ( !node )
 		return NO_ATTRIBUTE;
 
-	int ival = 0;
-	int result = node->QueryIntValue( &ival );
-	*value = (unsigned)ival;
-	return result;
+	return ConvertToUnsigned( node->Value(), value );
 }
 
 
@@ -661,23 +1278,7 @@ int XMLElement::QueryBoolAttribute( const char* name, bool* bval ) const
 	const XMLAttribute* node = attributeSet.Find( name );
 	if ( !node )
 		return NO_ATTRIBUTE;
-	
-	int result = WRONG_TYPE;
-	if (    StringEqual( node->Value(), "true", true, ENCODING_UNKNOWN ) 
-		 || StringEqual( node->Value(), "yes", true, ENCODING_UNKNOWN ) 
-		 || StringEqual( node->Value(), "1", true, ENCODING_UNKNOWN ) ) 
-	{
-		*bval = true;
-		result = SUCCESS;
-	}
-	else if (    StringEqual( node->Value(), "false", true, ENCODING_UNKNOWN ) 
-			  || StringEqual( node->Value(), "no", true, ENCODING_UNKNOWN ) 
-			  || StringEqual( node->Value(), "0", true, ENCODING_UNKNOWN ) ) 
-	{
-		*bval = false;
-		result = SUCCESS;
-	}
-	return result;
+	return ConvertToBool( node->Value(), bval );
 }
 
 
@@ -715,6 +1316,7 @@ int XMLElement::QueryDoubleAttribute( const std::string& name, double* dval ) co
 
 void XMLElement::SetAttribute( const char * name, int val )
 {	
+	XMLAllocatorScope allocatorScope( NodeAllocator() );
 	XMLAttribute* attrib = attributeSet.FindOrCreate( name );
 	if ( attrib ) {
 		attrib->SetIntValue( val );
@@ -725,6 +1327,7 @@ void XMLElement::SetAttribute( const char * name, int val )
 #ifdef USE_STL
 void XMLElement::SetAttribute( const std::string& name, int val )
 {	
+	XMLAllocatorScope allocatorScope( NodeAllocator() );
 	XMLAttribute* attrib = attributeSet.FindOrCreate( name );
 	if ( attrib ) {
 		attrib->SetIntValue( val );
@@ -735,6 +1338,7 @@ void XMLElement::SetAttribute( const std::string& name, int val )
 
 void XMLElement::SetDoubleAttribute( const char * name, double val )
 {	
+	XMLAllocatorScope allocatorScope( NodeAllocator() );
 	XMLAttribute* attrib = attributeSet.FindOrCreate( name );
 	if ( attrib ) {
 		attrib->SetDoubleValue( val );
@@ -745,6 +1349,7 @@ void XMLElement::SetDoubleAttribute( const char * name, double val )
 #ifdef USE_STL
 void XMLElement::SetDoubleAttribute( const std::string& name, double val )
 {	
+	XMLAllocatorScope allocatorScope( NodeAllocator() );
 	XMLAttribute* attrib = attributeSet.FindOrCreate( name );
 	if ( attrib ) {
 		attrib->SetDoubleValue( val );
@@ -755,6 +1360,7 @@ void XMLElement::SetDoubleAttribute( const std::string& name, double val )
 
 void XMLElement::SetAttribute( const char * cname, const char * cvalue )
 {
+	XMLAllocatorScope allocatorScope( NodeAllocator() );
 	XMLAttribute* attrib = attributeSet.FindOrCreate( cname );
 	if ( attrib ) {
 		attrib->SetValue( cvalue );
@@ -765,63 +1371,75 @@ void XMLElement::SetAttribute( const char * cname, const char * cvalue )
 #ifdef USE_STL
 void XMLElement::SetAttribute( const std::string& _name, const std::string& _value )
 {
+	XMLAllocatorScope allocatorScope( NodeAllocator() );
 	XMLAttribute* attrib = attributeSet.FindOrCreate( _name );
 	if ( attrib ) {
 		attrib->SetValue( _value );
 	}
 }
-#endif
 
 
-void XMLElement::Print( FILE* cfile, int depth ) const
+#ifdef XML_CXX11
+void XMLElement::SetAttribute( const std::string& _name, std::string&& _value )
 {
-	int i;
-	assert( cfile );
-	for ( i=0; i<depth; i++ ) {
-		fprintf( cfile, "    " );
+	XMLAllocatorScope allocatorScope( NodeAllocator() );
+	XMLAttribute* attrib = attributeSet.FindOrCreate( _name );
+	if ( attrib ) {
+		attrib->SetValue( std::move( _value ) );
 	}
+}
+#endif
+#endif
 
-	fprintf( cfile, "<%s", value.c_str() );
+
+void XMLElement::Print( XMLFileWriter& out, int depth ) const
+{
+	out.Indent( depth );
+	out.Write( '<' );
+	out.Write( value );
 
 	const XMLAttribute* attrib;
 	for ( attrib = attributeSet.First(); attrib; attrib = attrib->Next() )
 	{
-		fprintf( cfile, " " );
-		attrib->Print( cfile, depth );
+		out.Write( ' ' );
+		attrib->Print( out, depth );
 	}
 
 	// There are 3 different formatting approaches:
 	// 1) An element without children is printed as a <foo /> node
 	// 2) An element with only a text child is printed as <foo> text </foo>
 	// 3) An element with children is printed on multiple lines.
-	XMLNode* node;
-	if ( !firstChild )
+	const XMLNode* first = FirstChild();
+	const XMLNode* node;
+	if ( !first )
 	{
-		fprintf( cfile, " />" );
+		out.Write( " />", 3 );
 	}
-	else if ( firstChild == lastChild && firstChild->ToText() )
+	else if ( first == LastChild() && first->ToText() )
 	{
-		fprintf( cfile, ">" );
-		firstChild->Print( cfile, depth + 1 );
-		fprintf( cfile, "</%s>", value.c_str() );
+		out.Write( '>' );
+		first->Print( out, depth + 1 );
+		out.Write( "</", 2 );
+		out.Write( value );
+		out.Write( '>' );
 	}
 	else
 	{
-		fprintf( cfile, ">" );
+		out.Write( '>' );
 
-		for ( node = firstChild; node; node=node->NextSibling() )
+		for ( node = first; node; node=node->NextSibling() )
 		{
 			if ( !node->ToText() )
 			{
-				fprintf( cfile, "\n" );
+				out.Write( '\n' );
 			}
-			node->Print( cfile, depth+1 );
-		}
-		fprintf( cfile, "\n" );
-		for( i=0; i<depth; ++i ) {
-			fprintf( cfile, "    " );
+			node->Print( out, depth+1 );
 		}
-		fprintf( cfile, "</%s>", value.c_str() );
+		out.Write( '\n' );
+		out.Indent( depth );
+		out.Write( "</", 2 );
+		out.Write( value );
+		out.Write( '>' );
 	}
 }
 
@@ -833,20 +1451,37 @@ void XMLElement::CopyTo( XMLElement* target ) const
 
 	// Element class: 
 	// Clone the attributes, then clone the children.
+	CopyAttributesTo( target );
+	CopyChildrenTo( target );
+}
+
+
+void XMLElement::CopyAttributesTo( XMLElement* target ) const
+{
+	// The target has no attributes yet, and ours are unique, so they are
+	// added straight to the set rather than looked up one by one.
 	const XMLAttribute* attribute = 0;
 	for(	attribute = attributeSet.First();
 	attribute;
 	attribute = attribute->Next() )
 	{
-		target->SetAttribute( attribute->Name(), attribute->Value() );
+		XMLAttribute* copy = new XMLAttribute( attribute->Name(), attribute->Value() );
+		copy->location = attribute->location;
+		target->attributeSet.Add( copy );
 	}
+}
 
-	XMLNode* node = 0;
-	for ( node = firstChild; node; node = node->NextSibling() )
-	{
-		target->LinkEndChild( node->Clone() );
-	}
+
+#ifdef XML_THREADS
+XMLNode* XMLElement::CloneShared( const std::shared_ptr<const XMLDocument>& owner ) const
+{
+	XMLElement* clone = new XMLElement( Value() );
+	XMLNode::CopyTo( clone );
+	CopyAttributesTo( clone );
+	ShareChildrenWith( clone, owner );
+	return clone;
 }
+#endif
 
 bool XMLElement::Accept( XMLVisitor* visitor ) const
 {
@@ -888,6 +1523,7 @@ const char* XMLElement::GetText() const
 
 XMLDocument::XMLDocument() : XMLNode( XMLNode::TINYXML_DOCUMENT )
 {
+	InitMemory();
 	tabsize = 4;
 	useMicrosoftBOM = false;
 	ClearError();
@@ -895,6 +1531,7 @@ XMLDocument::XMLDocument() : XMLNode( XMLNode::TINYXML_DOCUMENT )
 
 XMLDocument::XMLDocument( const char * documentName ) : XMLNode( XMLNode::TINYXML_DOCUMENT )
 {
+	InitMemory();
 	tabsize = 4;
 	useMicrosoftBOM = false;
 	value = documentName;
@@ -905,6 +1542,7 @@ XMLDocument::XMLDocument( const char * documentName ) : XMLNode( XMLNode::TINYXM
 #ifdef USE_STL
 XMLDocument::XMLDocument( const std::string& documentName ) : XMLNode( XMLNode::TINYXML_DOCUMENT )
 {
+	InitMemory();
 	tabsize = 4;
 	useMicrosoftBOM = false;
     value = documentName;
@@ -915,6 +1553,7 @@ XMLDocument::XMLDocument( const std::string& documentName ) : XMLNode( XMLNode::
 
 XMLDocument::XMLDocument( const XMLDocument& copy ) : XMLNode( XMLNode::TINYXML_DOCUMENT )
 {
+	InitMemory();
 	copy.CopyTo( this );
 }
 
@@ -927,6 +1566,196 @@ XMLDocument& XMLDocument::operator=( const XMLDocument& copy )
 }
 
 
+XMLDocument::~XMLDocument()
+{
+	ReleaseMemory();
+}
+
+
+void XMLDocument::InitMemory()
+{
+	reuseMemory = false;
+	for ( int i=0; i<TINYXML_TYPECOUNT; ++i )
+		freeNodes[i] = 0;
+	freeAttributes = 0;
+	readBuffer = 0;
+	readBufferSize = 0;
+	allocator = 0;
+	givenEncoding = ENCODING_UNKNOWN;
+	parseEncoding = ENCODING_UNKNOWN;
+	collectStats = false;
+}
+
+
+void XMLDocument::Clear()
+{
+	#ifdef XML_STATS
+	XMLStatsTimer teardownTimer( collectStats ? &stats.teardownSeconds : 0 );
+	#endif
+
+	if ( reuseMemory )
+	{
+		XMLNode* node = firstChild;
+		firstChild = 0;
+		lastChild = 0;
+		while ( node )
+		{
+			XMLNode* next = node->next;
+			DeleteNode( node );
+			node = next;
+		}
+	}
+	XMLNode::Clear();
+}
+
+
+void XMLDocument::SetReuseMemory( bool reuse )
+{
+	reuseMemory = reuse;
+	if ( !reuse )
+		ReleaseMemory();
+}
+
+
+void XMLDocument::SetAllocator( XMLAllocator* _allocator )
+{
+	if ( _allocator == allocator )
+		return;
+
+	// What is kept for reuse came from the old allocator.
+	ReleaseMemory();
+	allocator = _allocator;
+}
+
+
+void XMLDocument::ReleaseMemory()
+{
+	for ( int i=0; i<TINYXML_TYPECOUNT; ++i )
+	{
+		while ( freeNodes[i] )
+		{
+			XMLNode* node = freeNodes[i];
+			freeNodes[i] = node->next;
+			delete node;
+		}
+	}
+	while ( freeAttributes )
+	{
+		XMLAttribute* attribute = freeAttributes;
+		freeAttributes = attribute->next;
+		delete attribute;
+	}
+	XMLFreeBlock( readBuffer, readBufferSize );
+	readBuffer = 0;
+	readBufferSize = 0;
+}
+
+
+void XMLDocument::DeleteNode( XMLNode* node )
+{
+	if ( !reuseMemory || node->type == TINYXML_DOCUMENT )
+	{
+		delete node;
+		return;
+	}
+
+	// Keep the children, then the node itself: emptied, but with the
+	// capacity of its strings, so that reusing it allocates nothing.
+	XMLNode* child = node->firstChild;
+	while ( child )
+	{
+		XMLNode* next = child->next;
+		DeleteNode( child );
+		child = next;
+	}
+	node->firstChild = 0;
+	node->lastChild = 0;
+	#ifdef XML_THREADS
+	delete node->shared;
+	node->shared = 0;
+	#endif
+	node->fingerprintHigh = 0;
+
+	XMLElement* element = node->ToElement();
+	if ( element )
+	{
+		while ( XMLAttribute* attribute = element->attributeSet.First() )
+		{
+			element->attributeSet.Remove( attribute );
+			DeleteAttribute( attribute );
+		}
+	}
+	if ( node->ToText() )
+		node->ToText()->SetCDATA( false );
+
+	node->value = "";
+	node->userData = 0;
+	node->location.Clear();
+	node->SetSource( NO_SOURCE, 0 );
+	node->parent = 0;
+	node->prev = 0;
+	node->next = freeNodes[ node->type ];
+	freeNodes[ node->type ] = node;
+}
+
+
+void XMLDocument::DeleteAttribute( XMLAttribute* attribute )
+{
+	if ( !reuseMemory )
+	{
+		delete attribute;
+		return;
+	}
+	attribute->name = "";
+	attribute->value = "";
+	attribute->document = 0;
+	attribute->owner = 0;
+	attribute->location.Clear();
+	attribute->prev = 0;
+	attribute->next = freeAttributes;
+	freeAttributes = attribute;
+}
+
+
+#ifdef XML_CXX11
+XMLDocument::XMLDocument( XMLDocument&& other ) : XMLNode( XMLNode::TINYXML_DOCUMENT )
+{
+	InitMemory();
+	MoveDocumentFrom( other );
+}
+
+
+XMLDocument& XMLDocument::operator=( XMLDocument&& other )
+{
+	if ( &other != this )
+		MoveDocumentFrom( other );
+	return *this;
+}
+
+
+void XMLDocument::MoveDocumentFrom( XMLDocument& other )
+{
+	MoveFrom( other );
+
+	error = other.error;
+	errorId = other.errorId;
+	errorDesc.swap( other.errorDesc );
+	tabsize = other.tabsize;
+	errorLocation = other.errorLocation;
+	useMicrosoftBOM = other.useMicrosoftBOM;
+	givenEncoding = other.givenEncoding;
+	parseEncoding = other.parseEncoding;
+
+	// Leave 'other' as a new document.
+	other.tabsize = 4;
+	other.useMicrosoftBOM = false;
+	other.givenEncoding = ENCODING_UNKNOWN;
+	other.parseEncoding = ENCODING_UNKNOWN;
+	other.ClearError();
+}
+#endif
+
+
 bool XMLDocument::LoadFile( XMLEncoding encoding )
 {
 	return LoadFile( Value(), encoding );
@@ -940,8 +1769,7 @@ bool XMLDocument::SaveFile() const
 
 bool XMLDocument::LoadFile( const char* _filename, XMLEncoding encoding )
 {
-	STRING filename( _filename );
-	value = filename;
+	value = _filename;
 
 	// reading in binary mode so that tinyxml can normalize the EOL
 	FILE* file = XMLFOpen( value.c_str (), "rb" );	
@@ -967,6 +1795,15 @@ bool XMLDocument::LoadFile( FILE* file, XMLEncoding encoding )
 		return false;
 	}
 
+	#ifdef XML_STATS
+	// The statistics cover the whole load; Clear() and Parse() add to them.
+	XMLParseStats* collect = collectStats ? &stats : 0;
+	if ( collect )
+		collect->Clear();
+	XMLStatsScope statsScope( collect );
+	#endif
+	XMLAllocatorScope allocatorScope( allocator );
+
 	// Delete the existing data:
 	Clear();
 	location.Clear();
@@ -1005,18 +1842,20 @@ bool XMLDocument::LoadFile( FILE* file, XMLEncoding encoding )
 	}
 	*/
 
-	char* buf = new char[ length+1 ];
+	char* buf = TakeReadBuffer( length+1 );
 	buf[0] = 0;
 
-	if ( fread( buf, length, 1, file ) != 1 ) {
-		delete [] buf;
-		SetError( ERROR_OPENING_FILE, 0, 0, ENCODING_UNKNOWN );
-		return false;
-	}
+	// The file is read and normalized (see below) a block at a time: each
+	// block is normalized while it is still in the cache, and, where the
+	// system takes hints, while the next one is being read ahead from disk.
+	#ifdef XML_READ_AHEAD
+	int fd = fileno( file );
+	posix_fadvise( fd, 0, length, POSIX_FADV_SEQUENTIAL );
+	#endif
 
-	// Process the buffer in place to normalize new lines. (See comment above.)
-	// Copies from the 'p' to 'q' pointer, where p can advance faster if
-	// a newline-carriage return is hit.
+	// Normalize the new lines. (See comment above.) The blocks are
+	// compacted in place: text is copied from the 'p' to the 'q' pointer,
+	// where p can advance faster if a newline-carriage return is hit.
 	//
 	// Wikipedia:
 	// Systems based on ASCII or a compatible character set use either LF  (Line feed, '\n', 0x0A, 10 in decimal) or 
@@ -1024,39 +1863,102 @@ bool XMLDocument::LoadFile( FILE* file, XMLEncoding encoding )
 	//		* LF:    Multics, Unix and Unix-like systems (GNU/Linux, AIX, Xenix, Mac OS X, FreeBSD, etc.), BeOS, Amiga, RISC OS, and others
     //		* CR+LF: DEC RT-11 and most other early non-Unix, non-IBM OSes, CP/M, MP/M, DOS, OS/2, Microsoft Windows, Symbian OS
     //		* CR:    Commodore 8-bit machines, Apple II family, Mac OS up to version 9 and OS-9
-
-	const char* p = buf;	// the read head
-	char* q = buf;			// the write head
-	const char CR = 0x0d;
-	const char LF = 0x0a;
-
-	buf[length] = 0;
-	while( *p ) {
-		assert( p < (buf+length) );
-		assert( q <= (buf+length) );
-		assert( q <= p );
-
-		if ( *p == CR ) {
-			*q++ = LF;
-			p++;
-			if ( *p == LF ) {		// check for CR+LF (and skip LF)
-				p++;
-			}
-		}
-		else {
-			*q++ = *p++;
+	char* q = buf;				// the write head
+	bool pendingCR = false;
+	size_t done = 0;
+	while ( done < (size_t) length )
+	{
+		size_t size = (size_t) length - done;
+		if ( size > LOAD_BLOCK_SIZE )
+			size = LOAD_BLOCK_SIZE;
+		#ifdef XML_READ_AHEAD
+		if ( done + size < (size_t) length )
+			posix_fadvise( fd, (off_t) ( done + size ), (off_t) LOAD_BLOCK_SIZE, POSIX_FADV_WILLNEED );
+		#endif
+
+		XML_STAT_CLOCK( readStart );
+		if ( fread( buf + done, size, 1, file ) != 1 ) {
+			GiveReadBuffer( buf, length+1 );
+			SetError( ERROR_OPENING_FILE, 0, 0, ENCODING_UNKNOWN );
+			return false;
 		}
+		XML_STAT( readSeconds += XMLStatsTimer::Now() - readStart );
+
+		XML_STAT_CLOCK( normalizeStart );
+		q = NormalizeNewLines( q, buf + done, size, &pendingCR );
+		XML_STAT( normalizeSeconds += XMLStatsTimer::Now() - normalizeStart );
+		done += size;
 	}
 	assert( q <= (buf+length) );
 	*q = 0;
 
 	Parse( buf, 0, encoding );
 
-	delete [] buf;
+	GiveReadBuffer( buf, length+1 );
 	return !Error();
 }
 
 
+char* XMLDocument::TakeReadBuffer( size_t size )
+{
+	// When reusing memory, the buffer is kept for the next load.
+	if ( !reuseMemory )
+	{
+		XML_STAT( allocations++ );
+		XML_STAT( allocatedBytes += size );
+		return static_cast<char*>( XMLAllocateBlock( size ) );
+	}
+	if ( readBufferSize < size )
+	{
+		XMLFreeBlock( readBuffer, readBufferSize );
+		readBuffer = 0;
+		readBufferSize = 0;
+		readBuffer = static_cast<char*>( XMLAllocateBlock( size ) );
+		readBufferSize = size;
+		XML_STAT( allocations++ );
+		XML_STAT( allocatedBytes += size );
+	}
+	return readBuffer;
+}
+
+
+void XMLDocument::GiveReadBuffer( char* buf, size_t size )
+{
+	if ( buf != readBuffer )
+		XMLFreeBlock( buf, size );
+}
+
+
+char* XMLDocument::NormalizeNewLines( char* q, const char* p, size_t size, bool* pendingCR )
+{
+	const char CR = 0x0d;
+	const char LF = 0x0a;
+	const char* end = p + size;
+	if ( *pendingCR && p < end && *p == LF )
+		p++;
+	*pendingCR = false;
+	while ( p < end )
+	{
+		// Runs without a CR are moved whole; most files have none.
+		const char* cr = static_cast< const char* >( memchr( p, CR, end - p ) );
+		const char* stop = cr ? cr : end;
+		if ( q != p )
+			memmove( q, p, stop - p );
+		q += stop - p;
+		p = stop;
+		if ( !cr )
+			break;
+		*q++ = LF;
+		p++;
+		if ( p == end )
+			*pendingCR = true;		// its LF may start the next block
+		else if ( *p == LF )		// check for CR+LF (and skip LF)
+			p++;
+	}
+	return q;
+}
+
+
 bool XMLDocument::SaveFile( const char * filename ) const
 {
 	// The old c stuff lives on...
@@ -1064,7 +1966,8 @@ bool XMLDocument::SaveFile( const char * filename ) const
 	if ( fp )
 	{
 		bool result = SaveFile( fp );
-		fclose( fp );
+		if ( fclose( fp ) != 0 )
+			result = false;
 		return result;
 	}
 	return false;
@@ -1073,22 +1976,31 @@ bool XMLDocument::SaveFile( const char * filename ) const
 
 bool XMLDocument::SaveFile( FILE* fp ) const
 {
-	if ( useMicrosoftBOM ) 
 	{
-		const unsigned char UTF_LEAD_0 = 0xefU;
-		const unsigned char UTF_LEAD_1 = 0xbbU;
-		const unsigned char UTF_LEAD_2 = 0xbfU;
-
-		fputc( UTF_LEAD_0, fp );
-		fputc( UTF_LEAD_1, fp );
-		fputc( UTF_LEAD_2, fp );
+		XMLFileWriter out( fp );
+		if ( useMicrosoftBOM ) 
+		{
+			const char UTF_BOM[] = { (char) 0xefU, (char) 0xbbU, (char) 0xbfU };
+			out.Write( UTF_BOM, 3 );
+		}
+		Print( out, 0 );
+		out.Flush();
+		if ( out.Failed() )
+			return false;
 	}
-	Print( fp, 0 );
 	return (ferror(fp) == 0);
 }
 
 
 void XMLDocument::CopyTo( XMLDocument* target ) const
+{
+	XMLAllocatorScope allocatorScope( target->allocator );
+	CopyStateTo( target );
+	CopyChildrenTo( target );
+}
+
+
+void XMLDocument::CopyStateTo( XMLDocument* target ) const
 {
 	XMLNode::CopyTo( target );
 
@@ -1098,33 +2010,40 @@ void XMLDocument::CopyTo( XMLDocument* target ) const
 	target->tabsize = tabsize;
 	target->errorLocation = errorLocation;
 	target->useMicrosoftBOM = useMicrosoftBOM;
+}
 
-	XMLNode* node = 0;
-	for ( node = firstChild; node; node = node->NextSibling() )
-	{
-		target->LinkEndChild( node->Clone() );
-	}	
+
+#ifdef XML_THREADS
+XMLNode* XMLDocument::CloneShared( const std::shared_ptr<const XMLDocument>& owner ) const
+{
+	XMLDocument* clone = new XMLDocument();
+	CopyStateTo( clone );
+	ShareChildrenWith( clone, owner );
+	return clone;
 }
+#endif
 
 
 XMLNode* XMLDocument::Clone() const
 {
+	// The clone allocates from the same allocator as this document.
+	XMLAllocatorScope allocatorScope( allocator );
 	XMLDocument* clone = new XMLDocument();
 	if ( !clone )
 		return 0;
 
+	clone->allocator = allocator;
 	CopyTo( clone );
 	return clone;
 }
 
 
-void XMLDocument::Print( FILE* cfile, int depth ) const
+void XMLDocument::Print( XMLFileWriter& out, int depth ) const
 {
-	assert( cfile );
 	for ( const XMLNode* node=FirstChild(); node; node=node->NextSibling() )
 	{
-		node->Print( cfile, depth );
-		fprintf( cfile, "\n" );
+		node->Print( out, depth );
+		out.Write( '\n' );
 	}
 }
 
@@ -1183,76 +2102,73 @@ XMLAttribute* XMLAttribute::Previous()
 }
 */
 
-void XMLAttribute::Print( FILE* cfile, int /*depth*/, STRING* str ) const
+void XMLAttribute::Print( FILE* cfile, int depth, STRING* str ) const
 {
-	STRING n, v;
-
-	EncodeString( name, &n );
-	EncodeString( value, &v );
-
-	if (value.find ('\"') == STRING::npos) {
-		if ( cfile ) {
-			fprintf (cfile, "%s=\"%s\"", n.c_str(), v.c_str() );
-		}
-		if ( str ) {
-			(*str) += n; (*str) += "=\""; (*str) += v; (*str) += "\"";
-		}
+	if ( cfile ) {
+		XMLFileWriter out( cfile );
+		Print( out, depth );
 	}
-	else {
-		if ( cfile ) {
-			fprintf (cfile, "%s='%s'", n.c_str(), v.c_str() );
-		}
-		if ( str ) {
-			(*str) += n; (*str) += "='"; (*str) += v; (*str) += "'";
-		}
+	if ( str ) {
+		char quote = ( value.find ('\"') == STRING::npos ) ? '\"' : '\'';
+
+		EncodeString( name, str );
+		(*str) += '=';
+		(*str) += quote;
+		EncodeString( value, str );
+		(*str) += quote;
 	}
 }
 
 
+void XMLAttribute::Print( XMLFileWriter& out, int /*depth*/ ) const
+{
+	char quote = ( value.find ('\"') == STRING::npos ) ? '\"' : '\'';
+
+	out.WriteEncoded( name );
+	out.Write( '=' );
+	out.Write( quote );
+	out.WriteEncoded( value );
+	out.Write( quote );
+}
+
+
 int XMLAttribute::QueryIntValue( int* ival ) const
 {
-	if ( SSCANF( value.c_str(), "%d", ival ) == 1 )
-		return SUCCESS;
-	return WRONG_TYPE;
+	return ConvertToInt( value.c_str(), ival );
 }
 
 int XMLAttribute::QueryDoubleValue( double* dval ) const
 {
-	if ( SSCANF( value.c_str(), "%lf", dval ) == 1 )
-		return SUCCESS;
-	return WRONG_TYPE;
+	return ConvertToDouble( value.c_str(), dval );
 }
 
 void XMLAttribute::SetIntValue( int _value )
 {
-	char buf [64];
-	#if defined(SNPRINTF)		
-		SNPRINTF(buf, sizeof(buf), "%d", _value);
-	#else
-		sprintf (buf, "%d", _value);
-	#endif
-	SetValue (buf);
+	// Format straight into the value's own storage.
+	value.resize( NUMBER_BUFFER_SIZE );
+	value.resize( FormatInt( _value, &value[0] ) );
+	ContentChanged();
 }
 
 void XMLAttribute::SetDoubleValue( double _value )
 {
-	char buf [256];
-	#if defined(SNPRINTF)		
-		SNPRINTF( buf, sizeof(buf), "%g", _value);
-	#else
-		sprintf (buf, "%g", _value);
-	#endif
-	SetValue (buf);
+	value.resize( NUMBER_BUFFER_SIZE );
+	value.resize( FormatDouble( _value, &value[0] ) );
+	ContentChanged();
 }
 
 int XMLAttribute::IntValue() const
 {
-	return atoi (value.c_str ());
+	int ival = 0;
+	ConvertToInt( value.c_str(), &ival );
+	return ival;
 }
 
 double  XMLAttribute::DoubleValue() const
 {
-	return atof (value.c_str ());
+	double dval = 0.0;
+	ConvertToDouble( value.c_str(), &dval );
+	return dval;
 }
 
 
@@ -1270,14 +2186,12 @@ XMLComment& XMLComment::operator=( const XMLComment& base )
 }
 
 
-void XMLComment::Print( FILE* cfile, int depth ) const
+void XMLComment::Print( XMLFileWriter& out, int depth ) const
 {
-	assert( cfile );
-	for ( int i=0; i<depth; i++ )
-	{
-		fprintf( cfile,  "    " );
-	}
-	fprintf( cfile, "<!--%s-->", value.c_str() );
+	out.Indent( depth );
+	out.Write( "<!--", 4 );
+	out.Write( value );
+	out.Write( "-->", 3 );
 }
 
 
@@ -1305,23 +2219,19 @@ XMLNode* XMLComment::Clone() const
 }
 
 
-void XMLText::Print( FILE* cfile, int depth ) const
+void XMLText::Print( XMLFileWriter& out, int depth ) const
 {
-	assert( cfile );
 	if ( cdata )
 	{
-		int i;
-		fprintf( cfile, "\n" );
-		for ( i=0; i<depth; i++ ) {
-			fprintf( cfile, "    " );
-		}
-		fprintf( cfile, "<![CDATA[%s]]>\n", value.c_str() );	// unformatted output
+		out.Write( '\n' );
+		out.Indent( depth );
+		out.Write( "<![CDATA[", 9 );
+		out.Write( value );			// unformatted output
+		out.Write( "]]>\n", 4 );
 	}
 	else
 	{
-		STRING buffer;
-		EncodeString( value, &buffer );
-		fprintf( cfile, "%s", buffer.c_str() );
+		out.WriteEncoded( value );
 	}
 }
 
@@ -1391,25 +2301,44 @@ XMLDeclaration& XMLDeclaration::operator=( const XMLDeclaration& copy )
 }
 
 
-void XMLDeclaration::Print( FILE* cfile, int /*depth*/, STRING* str ) const
+void XMLDeclaration::Print( FILE* cfile, int depth, STRING* str ) const
+{
+	if ( cfile ) {
+		XMLFileWriter out( cfile );
+		Print( out, depth );
+	}
+	if ( !str )
+		return;
+
+	(*str) += "<?xml ";
+
+	if ( !version.empty() ) {
+		(*str) += "version=\""; (*str) += version; (*str) += "\" ";
+	}
+	if ( !encoding.empty() ) {
+		(*str) += "encoding=\""; (*str) += encoding; (*str) += "\" ";
+	}
+	if ( !standalone.empty() ) {
+		(*str) += "standalone=\""; (*str) += standalone; (*str) += "\" ";
+	}
+	(*str) += "?>";
+}
+
+
+void XMLDeclaration::Print( XMLFileWriter& out, int /*depth*/ ) const
 {
-	if ( cfile ) fprintf( cfile, "<?xml " );
-	if ( str )	 (*str) += "<?xml ";
+	out.Write( "<?xml ", 6 );
 
 	if ( !version.empty() ) {
-		if ( cfile ) fprintf (cfile, "version=\"%s\" ", version.c_str ());
-		if ( str ) { (*str) += "version=\""; (*str) += version; (*str) += "\" "; }
+		out.Write( "version=\"", 9 ); out.Write( version ); out.Write( "\" ", 2 );
 	}
 	if ( !encoding.empty() ) {
-		if ( cfile ) fprintf (cfile, "encoding=\"%s\" ", encoding.c_str ());
-		if ( str ) { (*str) += "encoding=\""; (*str) += encoding; (*str) += "\" "; }
+		out.Write( "encoding=\"", 10 ); out.Write( encoding ); out.Write( "\" ", 2 );
 	}
 	if ( !standalone.empty() ) {
-		if ( cfile ) fprintf (cfile, "standalone=\"%s\" ", standalone.c_str ());
-		if ( str ) { (*str) += "standalone=\""; (*str) += standalone; (*str) += "\" "; }
+		out.Write( "standalone=\"", 12 ); out.Write( standalone ); out.Write( "\" ", 2 );
 	}
-	if ( cfile ) fprintf( cfile, "?>" );
-	if ( str )	 (*str) += "?>";
+	out.Write( "?>", 2 );
 }
 
 
@@ -1441,11 +2370,12 @@ XMLNode* XMLDeclaration::Clone() const
 }
 
 
-void XMLUnknown::Print( FILE* cfile, int depth ) const
+void XMLUnknown::Print( XMLFileWriter& out, int depth ) const
 {
-	for ( int i=0; i<depth; i++ )
-		fprintf( cfile, "    " );
-	fprintf( cfile, "<%s>", value.c_str() );
+	out.Indent( depth );
+	out.Write( '<' );
+	out.Write( value );
+	out.Write( '>' );
 }
 
 
@@ -1497,10 +2427,35 @@ void XMLAttributeSet::Add( XMLAttribute* addMe )
 
 	addMe->next = &sentinel;
 	addMe->prev = sentinel.prev;
+	addMe->owner = sentinel.owner;
 
 	sentinel.prev->next = addMe;
 	sentinel.prev      = addMe;
+	sentinel.ContentChanged();
+}
+
+#ifdef XML_CXX11
+void XMLAttributeSet::MoveFrom( XMLAttributeSet& other )
+{
+	assert( sentinel.next == &sentinel );
+	if ( other.sentinel.next == &other.sentinel )
+		return;
+
+	// Only the ends of the ring point at a sentinel; the attributes between stay linked.
+	sentinel.next = other.sentinel.next;
+	sentinel.prev = other.sentinel.prev;
+	sentinel.next->prev = &sentinel;
+	sentinel.prev->next = &sentinel;
+	for ( XMLAttribute* node = sentinel.next; node != &sentinel; node = node->next )
+		node->owner = sentinel.owner;
+
+	other.sentinel.next = &other.sentinel;
+	other.sentinel.prev = &other.sentinel;
+	sentinel.ContentChanged();
+	other.sentinel.ContentChanged();
 }
+#endif
+
 
 void XMLAttributeSet::Remove( XMLAttribute* removeMe )
 {
@@ -1514,6 +2469,8 @@ void XMLAttributeSet::Remove( XMLAttribute* removeMe )
 			node->next->prev = node->prev;
 			node->next = 0;
 			node->prev = 0;
+			node->owner = 0;
+			sentinel.ContentChanged();
 			return;
 		}
 	}
@@ -1576,6 +2533,7 @@ std::istream& operator>> (std::istream & in, XMLNode & base)
 	base.StreamIn( &in, &tag );
 
 	base.Parse( tag.c_str(), 0, DEFAULT_ENCODING );
+	base.ContentChanged();
 	return in;
 }
 #endif
@@ -1772,6 +2730,7 @@ bool XMLPrinter::VisitEnter( const XMLElement& element, const XMLAttribute* firs
 		}
 	}
 	++depth;	
+	Printed();
 	return true;
 }
 
@@ -1798,6 +2757,7 @@ bool XMLPrinter::VisitExit( const XMLElement& element )
 		buffer += ">";
 		DoLineBreak();
 	}
+	Printed();
 	return true;
 }
 
@@ -1814,18 +2774,15 @@ bool XMLPrinter::Visit( const XMLText& text )
 	}
 	else if ( simpleTextPrint )
 	{
-		STRING str;
-		XMLBase::EncodeString( text.ValueTStr(), &str );
-		buffer += str;
+		XMLBase::EncodeString( text.ValueTStr(), &buffer );
 	}
 	else
 	{
 		DoIndent();
-		STRING str;
-		XMLBase::EncodeString( text.ValueTStr(), &str );
-		buffer += str;
+		XMLBase::EncodeString( text.ValueTStr(), &buffer );
 		DoLineBreak();
 	}
+	Printed();
 	return true;
 }
 
@@ -1835,6 +2792,7 @@ bool XMLPrinter::Visit( const XMLDeclaration& declaration )
 	DoIndent();
 	declaration.Print( 0, 0, &buffer );
 	DoLineBreak();
+	Printed();
 	return true;
 }
 
@@ -1846,6 +2804,7 @@ bool XMLPrinter::Visit( const XMLComment& comment )
 	buffer += comment.Value();
 	buffer += "-->";
 	DoLineBreak();
+	Printed();
 	return true;
 }
 
@@ -1857,6 +2816,101 @@ bool XMLPrinter::Visit( const XMLUnknown& unknown )
 	buffer += unknown.Value();
 	buffer += ">";
 	DoLineBreak();
+	Printed();
 	return true;
 }
 
+
+
+XMLStreamPrinter::XMLStreamPrinter( FILE* _file, size_t _bufferSize )
+	: file( _file ), fd( -1 ), callback( 0 ), userData( 0 )
+{
+	Init( _bufferSize );
+}
+
+
+XMLStreamPrinter::XMLStreamPrinter( int _fd, size_t _bufferSize )
+	: file( 0 ), fd( _fd ), callback( 0 ), userData( 0 )
+{
+	Init( _bufferSize );
+}
+
+
+XMLStreamPrinter::XMLStreamPrinter( XMLWriteCallback _callback, void* _userData, size_t _bufferSize )
+	: file( 0 ), fd( -1 ), callback( _callback ), userData( _userData )
+{
+	Init( _bufferSize );
+}
+
+
+void XMLStreamPrinter::Init( size_t _bufferSize )
+{
+	bufferSize = _bufferSize ? _bufferSize : 1;
+	bytesWritten = 0;
+	error = false;
+	// Leave room for the node that crosses the limit.
+	buffer.reserve( bufferSize + bufferSize / 4 );
+}
+
+
+bool XMLStreamPrinter::Write( const char* data, size_t size )
+{
+	if ( error )
+		return false;
+
+	XML_TRACE_FLUSH( size );
+	size_t written = 0;
+	if ( file )
+	{
+		written = fwrite( data, 1, size, file );
+	}
+	else if ( fd >= 0 )
+	{
+		while ( written < size )
+		{
+			#if defined( _WIN32 )
+				int n = _write( fd, data + written, (unsigned)( size - written ) );
+			#else
+				ssize_t n = write( fd, data + written, size - written );
+				if ( n < 0 && errno == EINTR )
+					continue;
+			#endif
+			if ( n <= 0 )
+				break;
+			written += (size_t) n;
+		}
+	}
+	else if ( callback )
+	{
+		written = callback( data, size, userData );
+	}
+
+	bytesWritten += written;
+	if ( written != size )
+		error = true;
+	return !error;
+}
+
+
+bool XMLStreamPrinter::Flush()
+{
+	if ( !buffer.empty() )
+	{
+		Write( buffer.data(), buffer.size() );
+		// Keeps the capacity, so the buffer is reused.
+		buffer.resize( 0 );
+	}
+	if ( file && fflush( file ) != 0 )
+		error = true;
+	return !error;
+}
+
+
+void XMLStreamPrinter::Printed()
+{
+	if ( buffer.size() >= bufferSize || depth == 0 )
+	{
+		Write( buffer.data(), buffer.size() );
+		buffer.resize( 0 );
+	}
+}
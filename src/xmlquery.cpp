@@ -0,0 +1,468 @@
+#ifdef USE_STL
+
+#include "xmlquery.h"
+
+// The evaluator runs one step at a time over a context set kept in document
+// order with no duplicates. When the context nodes are unrelated (the common
+// case: every child step of a plain path) a step is just a loop over the
+// children of each context node. When the set can contain nested nodes (after
+// a '//' step) a single pre-order walk is used instead, merging the context
+// set into the walk, so that the output stays in document order.
+class XMLQuery::Evaluator
+{
+public:
+	Evaluator( const Step& _step, const std::vector<const XMLNode*>& _context,
+			   std::vector<const XMLNode*>* _out, size_t _limit, bool _own )
+		: step( _step ), context( _context ), out( _out ), limit( _limit ), own( _own ), pending( 0 )
+	{
+	}
+
+	// Run the step over the whole context set.
+	void Run( bool nested )
+	{
+		if ( !step.descendant && !nested )
+		{
+			for ( size_t i=0; i<context.size() && !Full(); ++i )
+				MatchChildren( context[i] );
+		}
+		else
+		{
+			while ( pending < context.size() && !Full() )
+			{
+				const XMLNode* root = context[pending++];
+				Walk( root, true, 0 );
+			}
+		}
+	}
+
+private:
+	bool Full() const	{ return limit && out->size() >= limit; }
+
+	// For a query on non-const nodes, whose results may be changed, the
+	// children read are first copied out of a XMLSnapshot if the node
+	// still shares them (see XMLSnapshot::Clone()).
+	const XMLNode* FirstChild( const XMLNode* parent ) const
+	{
+		return own ? const_cast< XMLNode* >( parent )->FirstChild() : parent->FirstChild();
+	}
+
+	bool NameMatches( const XMLElement* element ) const
+	{
+		if ( step.anyName )
+			return true;
+		const std::string& name = element->ValueTStr();
+		return    name.length() == step.name.length()
+			   && memcmp( name.data(), step.name.data(), name.length() ) == 0;
+	}
+
+	// Test the element against the step, advancing the per-parent position
+	// counters in 'counts' for every predicate that is reached.
+	bool Matches( const XMLElement* element, int* counts ) const
+	{
+		if ( !NameMatches( element ) )
+			return false;
+
+		for ( size_t i=0; i<step.predicates.size(); ++i )
+		{
+			const Predicate& pred = step.predicates[i];
+			if ( pred.position )
+			{
+				if ( ++counts[i] != pred.position )
+					return false;
+			}
+			else
+			{
+				const char* attrib = element->Attribute( pred.name.c_str() );
+				if ( !attrib )
+					return false;
+				if ( pred.hasValue && strcmp( attrib, pred.value.c_str() ) != 0 )
+					return false;
+			}
+		}
+		return true;
+	}
+
+	// True if a positional predicate can no longer be satisfied by any
+	// later sibling.
+	bool Exhausted( const int* counts ) const
+	{
+		for ( size_t i=0; i<step.predicates.size(); ++i )
+		{
+			if ( step.predicates[i].position && counts[i] >= step.predicates[i].position )
+				return true;
+		}
+		return false;
+	}
+
+	int* Counts( int depth )
+	{
+		size_t n = step.predicates.size();
+		if ( scratch.size() < (depth+1) * n )
+			scratch.resize( (depth+1) * n );
+		int* counts = n ? &scratch[depth*n] : 0;
+		for ( size_t i=0; i<n; ++i )
+			counts[i] = 0;
+		return counts;
+	}
+
+	void MatchChildren( const XMLNode* parent )
+	{
+		int* counts = Counts( 0 );
+		for ( const XMLNode* node = FirstChild( parent ); node; node = node->NextSibling() )
+		{
+			const XMLElement* element = node->ToElement();
+			if ( !element )
+				continue;
+			if ( Matches( element, counts ) )
+			{
+				out->push_back( element );
+				if ( Full() )
+					return;
+			}
+			if ( Exhausted( counts ) )
+				return;
+		}
+	}
+
+	// Is 'node' a strict ancestor of 'descendant'? In a clone of a
+	// XMLSnapshot, the parents of the nodes still shared lead up into the
+	// snapshot's document instead; the answer is then yes, to be safe, as
+	// walking a subtree without a context node in it finds nothing.
+	static bool Contains( const XMLNode* node, const XMLNode* descendant )
+	{
+		const XMLNode* p = descendant->Parent();
+		for ( ; p; p = p->Parent() )
+		{
+			if ( p == node )
+				return true;
+			if ( !p->Parent() )
+				break;
+		}
+		const XMLNode* top = node;
+		while ( top->Parent() )
+			top = top->Parent();
+		return p != top;
+	}
+
+	// Pre-order walk below 'parent'. Children are tested against the step when
+	// 'parent' is active, that is, a context node or (for '//') below one.
+	void Walk( const XMLNode* parent, bool active, int depth )
+	{
+		if ( active )
+			Counts( depth );
+
+		for ( const XMLNode* node = FirstChild( parent ); node; node = node->NextSibling() )
+		{
+			const XMLElement* element = node->ToElement();
+			if ( !element )
+				continue;
+
+			if ( active )
+			{
+				// Deeper levels may grow the scratch buffer, so index it afresh.
+				size_t n = step.predicates.size();
+				int* counts = n ? &scratch[depth*n] : 0;
+				if ( Matches( element, counts ) )
+				{
+					out->push_back( element );
+					if ( Full() )
+						return;
+				}
+			}
+
+			bool isContext = false;
+			if ( pending < context.size() && context[pending] == node )
+			{
+				isContext = true;
+				++pending;
+			}
+
+			bool childActive = isContext || ( active && step.descendant );
+			if (    childActive
+				 || ( pending < context.size() && Contains( node, context[pending] ) ) )
+			{
+				Walk( node, childActive, depth+1 );
+				if ( Full() )
+					return;
+			}
+		}
+	}
+
+	const Step& step;
+	const std::vector<const XMLNode*>& context;
+	std::vector<const XMLNode*>* out;
+	size_t limit;
+	bool own;
+	size_t pending;
+	std::vector<int> scratch;
+};
+
+
+XMLQuery::XMLQuery()
+{
+	Compile( "" );
+}
+
+
+XMLQuery::XMLQuery( const char* _expression )
+{
+	Compile( _expression );
+}
+
+
+XMLQuery::XMLQuery( const std::string& _expression )
+{
+	Compile( _expression.c_str() );
+}
+
+
+static bool IsQueryNameChar( char c )
+{
+	return    isalnum( (unsigned char) c ) || (unsigned char) c >= 0x80
+		   || c == '_' || c == '-' || c == '.' || c == ':';
+}
+
+
+static const char* SkipQueryWhiteSpace( const char* p )
+{
+	while ( *p && isspace( (unsigned char) *p ) )
+		++p;
+	return p;
+}
+
+
+void XMLQuery::SetError( const char* desc, const char* at )
+{
+	error = true;
+	errorDesc = desc;
+	errorOffset = (int)( at - expression.c_str() );
+	steps.clear();
+}
+
+
+bool XMLQuery::Compile( const char* _expression )
+{
+	error = false;
+	errorDesc = "";
+	errorOffset = 0;
+	absolute = false;
+	steps.clear();
+	expression = _expression ? _expression : "";
+
+	const char* p = SkipQueryWhiteSpace( expression.c_str() );
+	if ( !*p )
+	{
+		SetError( "Empty query expression.", p );
+		return false;
+	}
+
+	bool descendant = false;
+	if ( *p == '/' )
+	{
+		absolute = true;
+		++p;
+		if ( *p == '/' )
+		{
+			descendant = true;
+			++p;
+		}
+	}
+
+	for( ;; )
+	{
+		Step step;
+		step.descendant = descendant;
+		step.anyName = false;
+
+		// Name test.
+		p = SkipQueryWhiteSpace( p );
+		if ( *p == '*' )
+		{
+			step.anyName = true;
+			++p;
+		}
+		else
+		{
+			const char* start = p;
+			while ( IsQueryNameChar( *p ) )
+				++p;
+			if ( p == start )
+			{
+				SetError( "Expected an element name.", p );
+				return false;
+			}
+			step.name.assign( start, p - start );
+		}
+
+		// Predicates.
+		p = SkipQueryWhiteSpace( p );
+		while ( *p == '[' )
+		{
+			Predicate pred;
+			pred.position = 0;
+			pred.hasValue = false;
+
+			p = SkipQueryWhiteSpace( p+1 );
+			if ( *p == '@' )
+			{
+				const char* start = ++p;
+				while ( IsQueryNameChar( *p ) )
+					++p;
+				if ( p == start )
+				{
+					SetError( "Expected an attribute name.", p );
+					return false;
+				}
+				pred.name.assign( start, p - start );
+
+				p = SkipQueryWhiteSpace( p );
+				if ( *p == '=' )
+				{
+					p = SkipQueryWhiteSpace( p+1 );
+					char quote = *p;
+					if ( quote != '\'' && quote != '\"' )
+					{
+						SetError( "Expected a quoted attribute value.", p );
+						return false;
+					}
+					const char* end = strchr( p+1, quote );
+					if ( !end )
+					{
+						SetError( "Unterminated attribute value.", p );
+						return false;
+					}
+					pred.hasValue = true;
+					pred.value.assign( p+1, end - (p+1) );
+					p = SkipQueryWhiteSpace( end+1 );
+				}
+			}
+			else if ( *p >= '1' && *p <= '9' )
+			{
+				long position = 0;
+				while ( *p >= '0' && *p <= '9' )
+				{
+					position = position * 10 + ( *p - '0' );
+					if ( position > 0x7fffffffL )
+					{
+						SetError( "Position out of range.", p );
+						return false;
+					}
+					++p;
+				}
+				pred.position = (int) position;
+				p = SkipQueryWhiteSpace( p );
+			}
+			else
+			{
+				SetError( "Expected '@name' or a position (1 based) in predicate.", p );
+				return false;
+			}
+
+			if ( *p != ']' )
+			{
+				SetError( "Expected ']'.", p );
+				return false;
+			}
+			step.predicates.push_back( pred );
+			p = SkipQueryWhiteSpace( p+1 );
+		}
+		steps.push_back( step );
+
+		if ( !*p )
+			break;
+		if ( *p != '/' )
+		{
+			SetError( "Unexpected character in query.", p );
+			return false;
+		}
+		++p;
+		descendant = false;
+		if ( *p == '/' )
+		{
+			descendant = true;
+			++p;
+		}
+	}
+	return true;
+}
+
+
+size_t XMLQuery::Run( const XMLNode* context, std::vector<const XMLElement*>* result, size_t limit, bool own ) const
+{
+	if ( !context || steps.empty() )
+		return 0;
+
+	if ( absolute )
+	{
+		while ( context->Parent() )
+			context = context->Parent();
+	}
+
+	std::vector<const XMLNode*> current( 1, context );
+	std::vector<const XMLNode*> next;
+	bool nested = false;
+
+	for ( size_t i=0; i<steps.size() && !current.empty(); ++i )
+	{
+		bool last = ( i+1 == steps.size() );
+		next.clear();
+
+		Evaluator evaluator( steps[i], current, &next, last ? limit : 0, own );
+		evaluator.Run( nested );
+
+		// Children of unrelated parents are themselves unrelated; anything
+		// that went through a descendant step (or a nested set) may nest.
+		nested = nested || steps[i].descendant;
+		current.swap( next );
+	}
+
+	for ( size_t i=0; i<current.size(); ++i )
+		result->push_back( current[i]->ToElement() );
+	return current.size();
+}
+
+
+size_t XMLQuery::Select( const XMLNode* context, XMLConstElementList* result ) const
+{
+	return Run( context, result, 0, false );
+}
+
+
+size_t XMLQuery::Select( XMLNode* context, XMLElementList* result ) const
+{
+	// The DOM is not modified by the query, other than by copying shared
+	// nodes; the const_cast hands back the same mutability the caller passed in.
+	std::vector<const XMLElement*> found;
+	size_t count = Run( context, &found, 0, true );
+	result->reserve( result->size() + count );
+	for ( size_t i=0; i<count; ++i )
+		result->push_back( const_cast< XMLElement* >( found[i] ) );
+	return count;
+}
+
+
+const XMLElement* XMLQuery::SelectFirst( const XMLNode* context ) const
+{
+	std::vector<const XMLElement*> found;
+	if ( Run( context, &found, 1, false ) )
+		return found[0];
+	return 0;
+}
+
+
+XMLElement* XMLQuery::SelectFirst( XMLNode* context ) const
+{
+	std::vector<const XMLElement*> found;
+	if ( Run( context, &found, 1, true ) )
+		return const_cast< XMLElement* >( found[0] );
+	return 0;
+}
+
+
+size_t XMLQuery::Count( const XMLNode* context ) const
+{
+	std::vector<const XMLElement*> found;
+	return Run( context, &found, 0, false );
+}
+
+#endif	// USE_STL
@@ -0,0 +1,91 @@
+#include "xmlsnapshot.h"
+
+#ifdef XML_THREADS
+
+XMLSnapshot XMLSnapshot::Copy( const XMLDocument& document )
+{
+	XMLDocument* copy = new XMLDocument( document );
+	copy->UnshareAll();
+	return XMLSnapshot( copy );
+}
+
+
+XMLSnapshot XMLSnapshot::Adopt( XMLDocument* document )
+{
+	// Readers never change a snapshot, so nothing in it may be left to copy on read.
+	document->UnshareAll();
+	return XMLSnapshot( document );
+}
+
+
+XMLSnapshot XMLSnapshot::Parse( const char* xml, XMLEncoding encoding )
+{
+	XMLDocument* document = new XMLDocument();
+	document->Parse( xml, 0, encoding );
+	return XMLSnapshot( document );
+}
+
+
+XMLSnapshot XMLSnapshot::LoadFile( const char* filename, XMLEncoding encoding )
+{
+	XMLDocument* document = new XMLDocument();
+	document->LoadFile( filename, encoding );
+	return XMLSnapshot( document );
+}
+
+
+XMLDocument* XMLSnapshot::Clone() const
+{
+	if ( !document )
+		return 0;
+	XMLDocument* clone = new XMLDocument();
+	CloneTo( clone );
+	return clone;
+}
+
+
+void XMLSnapshot::CloneTo( XMLDocument* target ) const
+{
+	target->Clear();
+	if ( !document )
+	{
+		*target = XMLDocument();
+		return;
+	}
+	document->CopyStateTo( target );
+	document->ShareChildrenWith( target, document );
+}
+
+
+XMLNode* XMLSnapshot::CloneNode( const XMLNode* node ) const
+{
+	assert( node->GetDocument() == document.get() );
+	return node->CloneShared( document );
+}
+
+
+size_t XMLSnapshot::Select( const XMLQuery& query, XMLConstElementList* result ) const
+{
+	if ( !document )
+		return 0;
+	return query.Select( document.get(), result );
+}
+
+
+const XMLElement* XMLSnapshot::SelectFirst( const XMLQuery& query ) const
+{
+	if ( !document )
+		return 0;
+	return query.SelectFirst( document.get() );
+}
+
+
+const XMLElement* XMLSnapshot::SelectFirst( const char* expression ) const
+{
+	XMLQuery query( expression );
+	if ( query.Error() )
+		return 0;
+	return SelectFirst( query );
+}
+
+#endif	// XML_THREADS
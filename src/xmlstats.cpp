@@ -0,0 +1,168 @@
+#include "xmlparser.h"
+
+#include <math.h>
+
+#ifdef XML_STATS
+	#ifdef XML_CXX11
+		#include <chrono>
+	#else
+		#include <time.h>
+	#endif
+#endif
+
+// The pairs XMLParseStats exports, in order: the node counts by type first
+// (but the document, which is never parsed as a node).
+static const char* const KEYS[] =
+{
+	"nodes.element",
+	"nodes.comment",
+	"nodes.unknown",
+	"nodes.text",
+	"nodes.declaration",
+	"attributes",
+	"bytes",
+	"entities",
+	"allocations",
+	"allocated_bytes",
+	"max_depth",
+	"time.read_s",
+	"time.normalize_s",
+	"time.parse_s",
+	"time.teardown_s"
+};
+static const int KEY_COUNT = sizeof( KEYS ) / sizeof( KEYS[0] );
+static const int NODE_KEYS = XMLNode::TINYXML_TYPECOUNT - 1;
+static const int TIME_KEYS = 4;
+
+
+bool XMLParseStats::Enabled()
+{
+#ifdef XML_STATS
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+void XMLParseStats::Clear()
+{
+	for ( int i=0; i<XMLNode::TINYXML_TYPECOUNT; ++i )
+		nodes[i] = 0;
+	attributes = 0;
+	bytes = 0;
+	entities = 0;
+	allocations = 0;
+	allocatedBytes = 0;
+	maxDepth = 0;
+	readSeconds = 0;
+	normalizeSeconds = 0;
+	parseSeconds = 0;
+	teardownSeconds = 0;
+	depth = 0;
+}
+
+
+size_t XMLParseStats::NodeCount() const
+{
+	size_t count = 0;
+	for ( int i=0; i<XMLNode::TINYXML_TYPECOUNT; ++i )
+		count += nodes[i];
+	return count;
+}
+
+
+int XMLParseStats::KeyCount()
+{
+	return KEY_COUNT;
+}
+
+
+const char* XMLParseStats::Key( int i )
+{
+	return i >= 0 && i < KEY_COUNT ? KEYS[i] : 0;
+}
+
+
+double XMLParseStats::Value( int i ) const
+{
+	if ( i >= 0 && i < NODE_KEYS )
+		return (double) nodes[ i+1 ];
+
+	switch ( i - NODE_KEYS )
+	{
+		case 0:		return (double) attributes;
+		case 1:		return (double) bytes;
+		case 2:		return (double) entities;
+		case 3:		return (double) allocations;
+		case 4:		return (double) allocatedBytes;
+		case 5:		return (double) maxDepth;
+		case 6:		return readSeconds;
+		case 7:		return normalizeSeconds;
+		case 8:		return parseSeconds;
+		case 9:		return teardownSeconds;
+		default:	return 0;
+	}
+}
+
+
+STRING XMLParseStats::ToString( const char* prefix ) const
+{
+	STRING out;
+	char buf[ XMLBase::NUMBER_BUFFER_SIZE ];
+	for ( int i=0; i<KEY_COUNT; ++i )
+	{
+		// Times are given to the microsecond.
+		double value = Value( i );
+		if ( i >= KEY_COUNT - TIME_KEYS )
+			value = floor( value * 1e6 + 0.5 ) / 1e6;
+
+		out += prefix;
+		out += KEYS[i];
+		out += "=";
+		out.append( buf, XMLBase::FormatDouble( value, buf ) );
+		out += "\n";
+	}
+	return out;
+}
+
+
+#ifdef XML_STATS
+
+// Without C++11 there is no portable thread local storage, and the
+// statistics of parses running at once on several threads can get mixed.
+#ifdef XML_CXX11
+static thread_local XMLParseStats* current = 0;
+#else
+static XMLParseStats* current = 0;
+#endif
+
+
+XMLParseStats* XMLStatsCurrent()
+{
+	return current;
+}
+
+
+XMLStatsScope::XMLStatsScope( XMLParseStats* stats ) : previous( current )
+{
+	current = stats;
+}
+
+
+XMLStatsScope::~XMLStatsScope()
+{
+	current = previous;
+}
+
+
+double XMLStatsTimer::Now()
+{
+#ifdef XML_CXX11
+	return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+#else
+	return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+#endif	// XML_STATS
@@ -6,8 +6,23 @@
 const XMLString::size_type XMLString::npos = static_cast< XMLString::size_type >(-1);
 
 
-// Null rep.
-XMLString::Rep XMLString::nullrep_ = { 0, 0, { '\0' } };
+void XMLString::swap (XMLString& other)
+{
+	if (!is_small() && !other.is_small())
+	{
+		Rep* r = rep_;
+		rep_ = other.rep_;
+		other.rep_ = r;
+	}
+	else if (&other != this)
+	{
+		// An inline buffer can't change hands: its contents are moved instead.
+		XMLString tmp;
+		tmp.steal(other);
+		other.steal(*this);
+		steal(tmp);
+	}
+}
 
 
 void XMLString::reserve (size_type cap)
@@ -0,0 +1,50 @@
+#include "xmlparser.h"
+
+#ifdef XML_TRACE
+#ifdef XML_THREADS
+std::atomic< const XMLTraceHooks* > xmlTraceHooks( 0 );
+#else
+const XMLTraceHooks* xmlTraceHooks = 0;
+#endif
+#endif
+
+
+XMLTraceHooks::XMLTraceHooks()
+	: documentBegin( 0 ), documentEnd( 0 ), elementBegin( 0 ), elementEnd( 0 ), text( 0 ), error( 0 ), flush( 0 ),
+	  context( 0 ), textThreshold( 1024 )
+{
+}
+
+
+bool XMLTraceHooks::Enabled()
+{
+#ifdef XML_TRACE
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+void XMLTraceHooks::Install( const XMLTraceHooks* hooks )
+{
+#ifdef XML_TRACE
+	#ifdef XML_THREADS
+	xmlTraceHooks.store( hooks, std::memory_order_release );
+	#else
+	xmlTraceHooks = hooks;
+	#endif
+#else
+	(void) hooks;
+#endif
+}
+
+
+const XMLTraceHooks* XMLTraceHooks::Installed()
+{
+#ifdef XML_TRACE
+	return XMLTraceCurrent();
+#else
+	return 0;
+#endif
+}